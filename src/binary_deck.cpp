@@ -0,0 +1,899 @@
+#include "binary_deck.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "block_compression.h"
+#include "checksum.h"
+#include "mapped_file.h"
+
+static_assert(sizeof(BinaryDeckHeader) == 32, "header layout is part of the file format");
+static_assert(sizeof(BinaryDeckSection) == 24, "directory layout is part of the file format");
+static_assert(sizeof(BinaryCardRecord) == 32, "record layout is part of the file format");
+static_assert(sizeof(BinaryBodyBlock) == 16, "block layout is part of the file format");
+static_assert(sizeof(BinaryDeckSummary) == 24, "summary layout is part of the file format");
+
+namespace {
+constexpr size_t SECTION_ALIGNMENT = 8;
+constexpr size_t MIN_INDEX_SLOTS = 16;
+constexpr uint32_t NO_BLOCK = std::numeric_limits<uint32_t>::max();
+
+// One Cards section's records; card indices continue across runs.
+struct RecordRun {
+    const BinaryCardRecord* records;
+    size_t count;
+    uint64_t fileOffset;
+    // The run's Fingerprints section, if the deck has them.
+    const uint64_t* fingerprints{nullptr};
+    uint64_t fingerprintsOffset{0};
+};
+
+struct Segment {
+    std::string_view ids{};
+    const BinaryBodyBlock* blocks{nullptr};
+    size_t blockCount{0};
+    std::string_view bodies{};
+};
+
+// The sections of a deck, bounds-checked against the mapping.
+struct DeckView {
+    BinaryDeckHeader header{};
+    const BinaryDeckSection* directory{nullptr};
+    std::vector<RecordRun> runs{};
+    size_t cardCount{0};
+    std::vector<Segment> segments{};
+    std::string_view templates{};
+    const uint32_t* index{nullptr};
+    size_t indexSlots{0};
+    uint64_t indexOffset{0};
+    BinaryDeckSummary summary{};
+    bool hasSummary{false};
+
+    // The run holding card and the card's index within it.
+    const RecordRun& Locate(size_t& card) const {
+        for (const RecordRun& run : runs) {
+            if (card < run.count) {
+                return run;
+            }
+            card -= run.count;
+        }
+        card = runs.back().count - 1;
+        return runs.back();
+    }
+
+    const BinaryCardRecord& Record(size_t card, uint64_t* fileOffset = nullptr) const {
+        const RecordRun& run = Locate(card);
+        if (fileOffset != nullptr) {
+            *fileOffset = run.fileOffset + card * sizeof(BinaryCardRecord);
+        }
+        return run.records[card];
+    }
+};
+
+bool InBounds(std::string_view data, uint64_t offset, uint64_t size) {
+    return offset <= data.size() && size <= data.size() - offset;
+}
+
+Segment& SegmentAt(std::vector<Segment>& segments, size_t& nextOfType) {
+    if (nextOfType >= segments.size()) {
+        segments.resize(nextOfType + 1);
+    }
+    return segments[nextOfType++];
+}
+
+bool OpenDeckView(std::string_view data, DeckView& view, std::string& error) {
+    if (!IsBinaryDeck(data) || data.size() < sizeof(BinaryDeckHeader)) {
+        error = "not a packed deck";
+        return false;
+    }
+    std::memcpy(&view.header, data.data(), sizeof(view.header));
+    const BinaryDeckHeader& header = view.header;
+    if (header.version != BINARY_DECK_VERSION) {
+        error = "unsupported version " + std::to_string(header.version);
+        return false;
+    }
+    if (header.headerSize < sizeof(BinaryDeckHeader) ||
+        Crc32c(data.substr(0, offsetof(BinaryDeckHeader, headerCrc)), 0) != header.headerCrc) {
+        error = "header checksum mismatch";
+        return false;
+    }
+
+    const uint64_t directorySize = uint64_t{header.sectionCount} * sizeof(BinaryDeckSection);
+    if (header.directoryOffset % SECTION_ALIGNMENT != 0 ||
+        !InBounds(data, header.directoryOffset, directorySize)) {
+        error = "directory out of bounds";
+        return false;
+    }
+    const std::string_view directory = data.substr(
+        static_cast<size_t>(header.directoryOffset), static_cast<size_t>(directorySize));
+    if (Crc32c(directory, 0) != header.directoryCrc) {
+        error = "directory checksum mismatch";
+        return false;
+    }
+    view.directory = reinterpret_cast<const BinaryDeckSection*>(directory.data());
+
+    size_t idSections = 0;
+    size_t blockSections = 0;
+    size_t bodySections = 0;
+    std::vector<const BinaryDeckSection*> fingerprintSections;
+    for (uint32_t i = 0; i < header.sectionCount; ++i) {
+        const BinaryDeckSection& section = view.directory[i];
+        if (section.offset % SECTION_ALIGNMENT != 0 ||
+            !InBounds(data, section.offset, section.size)) {
+            error = std::string(BinaryDeckSectionName(section.type)) + " section out of bounds";
+            return false;
+        }
+        const std::string_view bytes =
+            data.substr(static_cast<size_t>(section.offset), static_cast<size_t>(section.size));
+        switch (section.type) {
+        case BinaryDeckSectionType::Cards: {
+            const size_t count = bytes.size() / sizeof(BinaryCardRecord);
+            view.runs.push_back({reinterpret_cast<const BinaryCardRecord*>(bytes.data()), count,
+                                 section.offset});
+            view.cardCount += count;
+            break;
+        }
+        case BinaryDeckSectionType::Ids:
+            SegmentAt(view.segments, idSections).ids = bytes;
+            break;
+        case BinaryDeckSectionType::BodyBlocks: {
+            Segment& segment = SegmentAt(view.segments, blockSections);
+            segment.blocks = reinterpret_cast<const BinaryBodyBlock*>(bytes.data());
+            segment.blockCount = bytes.size() / sizeof(BinaryBodyBlock);
+            break;
+        }
+        case BinaryDeckSectionType::Bodies:
+            SegmentAt(view.segments, bodySections).bodies = bytes;
+            break;
+        case BinaryDeckSectionType::Templates:
+            view.templates = bytes;
+            break;
+        case BinaryDeckSectionType::IdIndex:
+            view.index = reinterpret_cast<const uint32_t*>(bytes.data());
+            view.indexSlots = bytes.size() / sizeof(uint32_t);
+            view.indexOffset = section.offset;
+            break;
+        case BinaryDeckSectionType::Summary:
+            if (bytes.size() >= sizeof(BinaryDeckSummary)) {
+                std::memcpy(&view.summary, bytes.data(), sizeof(view.summary));
+                view.hasSummary = true;
+            }
+            break;
+        case BinaryDeckSectionType::Fingerprints:
+            fingerprintSections.push_back(&section);
+            break;
+        default:
+            break;
+        }
+    }
+    if (view.runs.empty() || view.segments.empty()) {
+        error = "missing card or body sections";
+        return false;
+    }
+    if (view.indexSlots != 0 && (view.indexSlots & (view.indexSlots - 1)) != 0) {
+        error = "id index size is not a power of two";
+        return false;
+    }
+
+    // Fingerprints are used only if every run has a matching section.
+    bool fingerprintsMatch = fingerprintSections.size() == view.runs.size();
+    for (size_t i = 0; fingerprintsMatch && i < view.runs.size(); ++i) {
+        fingerprintsMatch = fingerprintSections[i]->size == view.runs[i].count * sizeof(uint64_t);
+    }
+    for (size_t i = 0; fingerprintsMatch && i < view.runs.size(); ++i) {
+        view.runs[i].fingerprints =
+            reinterpret_cast<const uint64_t*>(data.data() + fingerprintSections[i]->offset);
+        view.runs[i].fingerprintsOffset = fingerprintSections[i]->offset;
+    }
+    return true;
+}
+
+// The uncompressed bytes of the most recently used body block.
+struct BlockCursor {
+    uint32_t segment{NO_BLOCK};
+    uint32_t index{NO_BLOCK};
+    std::string scratch{};
+    std::string_view raw{};
+};
+
+bool LoadBlock(const DeckView& view, uint32_t segmentIndex, uint32_t index, BlockCursor& cursor) {
+    if (cursor.segment == segmentIndex && cursor.index == index) {
+        return true;
+    }
+    cursor.index = NO_BLOCK;
+    if (segmentIndex >= view.segments.size() || index >= view.segments[segmentIndex].blockCount) {
+        return false;
+    }
+
+    const Segment& segment = view.segments[segmentIndex];
+    const BinaryBodyBlock& block = segment.blocks[index];
+    if (!InBounds(segment.bodies, block.offset, block.storedSize)) {
+        return false;
+    }
+    const std::string_view stored =
+        segment.bodies.substr(static_cast<size_t>(block.offset), block.storedSize);
+    if (block.storedSize == block.rawSize) {
+        cursor.raw = stored;
+    } else if (DecompressBlock(stored, block.rawSize, cursor.scratch)) {
+        cursor.raw = cursor.scratch;
+    } else {
+        return false;
+    }
+    cursor.segment = segmentIndex;
+    cursor.index = index;
+    return true;
+}
+
+bool ReadRecordBody(const DeckView& view, const BinaryCardRecord& record, BlockCursor& cursor,
+                    Card& card) {
+    if (!LoadBlock(view, record.segment, record.block, cursor)) {
+        return false;
+    }
+    const uint64_t bodyEnd =
+        uint64_t{record.bodyOffset} + record.questionLength + record.answerLength;
+    if (bodyEnd > cursor.raw.size()) {
+        return false;
+    }
+    card.question = ToWide(cursor.raw.substr(record.bodyOffset, record.questionLength));
+    card.answer = ToWide(
+        cursor.raw.substr(record.bodyOffset + record.questionLength, record.answerLength));
+    return true;
+}
+
+bool RecordIdBytes(const DeckView& view, const BinaryCardRecord& record, std::string_view& id) {
+    if (record.segment >= view.segments.size() ||
+        !InBounds(view.segments[record.segment].ids, record.idOffset, record.idLength)) {
+        return false;
+    }
+    id = view.segments[record.segment].ids.substr(record.idOffset, record.idLength);
+    return true;
+}
+
+bool ReadRecordId(const DeckView& view, const BinaryCardRecord& record, std::wstring& id) {
+    std::string_view bytes;
+    if (!RecordIdBytes(view, record, bytes)) {
+        return false;
+    }
+    id = ToWide(bytes);
+    return true;
+}
+
+void ReadTemplates(std::string_view bytes, Deck& deck) {
+    uint32_t lengths[2] = {};
+    if (bytes.size() < sizeof(lengths)) {
+        return;
+    }
+    std::memcpy(lengths, bytes.data(), sizeof(lengths));
+    bytes.remove_prefix(sizeof(lengths));
+    if (uint64_t{lengths[0]} + lengths[1] > bytes.size()) {
+        return;
+    }
+    deck.questionTemplate = ToWide(bytes.substr(0, lengths[0]));
+    deck.answerTemplate = ToWide(bytes.substr(lengths[0], lengths[1]));
+}
+
+bool FitsUint32(size_t value) {
+    return value <= std::numeric_limits<uint32_t>::max();
+}
+
+size_t IndexSlotsFor(size_t cardCount) {
+    size_t slots = MIN_INDEX_SLOTS;
+    while (slots < 2 * cardCount) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+size_t HomeSlot(std::string_view id, size_t slotCount) {
+    return static_cast<size_t>(Xxh64(id, 0)) & (slotCount - 1);
+}
+
+// Ids, records and body blocks of one segment, built card by card.
+class SegmentBuilder {
+public:
+    SegmentBuilder(uint32_t segmentIndex, const BinaryDeckOptions& deckOptions)
+        : segment(segmentIndex), options(deckOptions) {}
+
+    bool Add(const Card& card, BinaryCardRecord& record) {
+        const std::string id = ToUtf8(card.id);
+        const std::string question = ToUtf8(card.question);
+        const std::string answer = ToUtf8(card.answer);
+        if (!block.empty() && block.size() + question.size() + answer.size() > options.blockSize) {
+            FlushBlock();
+        }
+        if (!FitsUint32(ids.size() + id.size()) ||
+            !FitsUint32(block.size() + question.size() + answer.size())) {
+            return false;
+        }
+
+        record = BinaryCardRecord{};
+        record.flags = (card.reverse ? BINARY_CARD_REVERSE : 0) |
+                       (card.clozeGaps.empty() ? 0 : BINARY_CARD_CLOZE);
+        record.idOffset = static_cast<uint32_t>(ids.size());
+        record.idLength = static_cast<uint32_t>(id.size());
+        record.block = static_cast<uint32_t>(blocks.size());
+        record.bodyOffset = static_cast<uint32_t>(block.size());
+        record.questionLength = static_cast<uint32_t>(question.size());
+        record.answerLength = static_cast<uint32_t>(answer.size());
+        record.segment = segment;
+
+        ids += id;
+        block += question;
+        block += answer;
+        return true;
+    }
+
+    void FlushBlock() {
+        if (block.empty()) {
+            return;
+        }
+        BinaryBodyBlock entry{bodies.size(), static_cast<uint32_t>(block.size()),
+                              static_cast<uint32_t>(block.size())};
+        if (options.compress) {
+            CompressBlock(block, compressed);
+        }
+        if (options.compress && compressed.size() < block.size()) {
+            entry.storedSize = static_cast<uint32_t>(compressed.size());
+            bodies += compressed;
+        } else {
+            bodies += block;
+        }
+        blocks.push_back(entry);
+        block.clear();
+    }
+
+    std::string ids{};
+    std::vector<BinaryBodyBlock> blocks{};
+    std::string bodies{};
+
+private:
+    uint32_t segment;
+    BinaryDeckOptions options;
+    std::string block{};
+    std::string compressed{};
+};
+
+std::string_view BytesOf(const void* data, size_t size) {
+    return {static_cast<const char*>(data), size};
+}
+
+template <typename Record>
+std::string_view BytesOf(const std::vector<Record>& records) {
+    return BytesOf(records.data(), records.size() * sizeof(Record));
+}
+
+// Appends sections to a deck file, keeping each one aligned, and finally
+// writes the directory after them and the header at the start.
+class SectionWriter {
+public:
+    SectionWriter(std::ostream& stream, uint64_t start, std::vector<BinaryDeckSection> sections)
+        : out(stream), position(start), directory(std::move(sections)) {}
+
+    void Add(BinaryDeckSectionType type, std::string_view bytes) {
+        Pad();
+        directory.push_back({type, Crc32c(bytes, 0), position, bytes.size()});
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        position += bytes.size();
+    }
+
+    bool Finish() {
+        Pad();
+        const std::string_view bytes = BytesOf(directory);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+        BinaryDeckHeader header{};
+        std::memcpy(header.magic, BINARY_DECK_MAGIC, sizeof(header.magic));
+        header.version = BINARY_DECK_VERSION;
+        header.headerSize = sizeof(BinaryDeckHeader);
+        header.sectionCount = static_cast<uint32_t>(directory.size());
+        header.directoryOffset = position;
+        header.directoryCrc = Crc32c(bytes, 0);
+        header.headerCrc = Crc32c(BytesOf(&header, offsetof(BinaryDeckHeader, headerCrc)), 0);
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        return static_cast<bool>(out.flush());
+    }
+
+private:
+    void Pad() {
+        static const char padding[SECTION_ALIGNMENT] = {};
+        const size_t size = static_cast<size_t>((SECTION_ALIGNMENT - position % SECTION_ALIGNMENT) %
+                                                SECTION_ALIGNMENT);
+        out.write(padding, static_cast<std::streamsize>(size));
+        position += size;
+    }
+
+    std::ostream& out;
+    uint64_t position;
+    std::vector<BinaryDeckSection> directory;
+};
+
+std::string TemplatesSection(const Deck& deck) {
+    const std::string questionTemplate = ToUtf8(deck.questionTemplate);
+    const std::string answerTemplate = ToUtf8(deck.answerTemplate);
+    const uint32_t lengths[2] = {static_cast<uint32_t>(questionTemplate.size()),
+                                 static_cast<uint32_t>(answerTemplate.size())};
+    std::string bytes(BytesOf(lengths, sizeof(lengths)));
+    bytes += questionTemplate;
+    bytes += answerTemplate;
+    return bytes;
+}
+
+// An in-place overwrite of bytes inside an existing section.
+struct SectionEdit {
+    size_t section;
+    uint64_t fileOffset;
+    std::string before;
+    std::string after;
+};
+
+// Loads the whole packed deck, applies patch and packs it again; used when
+// the id index has no room left for the insertions.
+bool RepackWithPatch(const std::filesystem::path& path, const DeckPatch& patch, bool compress,
+                     std::string& error) {
+    Deck deck;
+    {
+        MappedFile file;
+        if (!file.Open(path, MapOptions{})) {
+            error = "cannot map deck";
+            return false;
+        }
+        deck = ParseBinaryDeck(file.View(), 0);
+    }
+    if (!ApplyDeckPatch(deck, patch, error)) {
+        return false;
+    }
+
+    std::filesystem::path repacked = path;
+    repacked += ".tmp";
+    BinaryDeckOptions options;
+    options.compress = compress;
+    if (!WriteBinaryDeck(deck, options, repacked)) {
+        error = "cannot write repacked deck";
+        return false;
+    }
+    std::error_code renameError;
+    std::filesystem::rename(repacked, path, renameError);
+    if (renameError) {
+        error = "cannot replace deck: " + renameError.message();
+        return false;
+    }
+    return true;
+}
+}
+
+bool IsBinaryDeck(std::string_view data) {
+    return data.substr(0, sizeof(BINARY_DECK_MAGIC)) ==
+           std::string_view(BINARY_DECK_MAGIC, sizeof(BINARY_DECK_MAGIC));
+}
+
+const char* BinaryDeckSectionName(BinaryDeckSectionType type) {
+    switch (type) {
+    case BinaryDeckSectionType::Cards:
+        return "cards";
+    case BinaryDeckSectionType::Ids:
+        return "ids";
+    case BinaryDeckSectionType::BodyBlocks:
+        return "body-blocks";
+    case BinaryDeckSectionType::Bodies:
+        return "bodies";
+    case BinaryDeckSectionType::Templates:
+        return "templates";
+    case BinaryDeckSectionType::IdIndex:
+        return "id-index";
+    case BinaryDeckSectionType::Summary:
+        return "summary";
+    case BinaryDeckSectionType::Fingerprints:
+        return "fingerprints";
+    default:
+        return "unknown";
+    }
+}
+
+bool WriteBinaryDeck(const Deck& deck, const BinaryDeckOptions& options,
+                     const std::filesystem::path& path) {
+    if (!FitsUint32(deck.cards.size())) {
+        return false;
+    }
+
+    SegmentBuilder builder(0, options);
+    std::vector<BinaryCardRecord> records(deck.cards.size());
+    std::vector<uint64_t> fingerprints(deck.cards.size());
+    std::vector<uint32_t> index(IndexSlotsFor(deck.cards.size()), BINARY_INDEX_EMPTY);
+    BinaryDeckSummary summary{0, deck.cards.size(), deck.cards.size()};
+    for (size_t i = 0; i < deck.cards.size(); ++i) {
+        const Card& card = deck.cards[i];
+        if (!builder.Add(card, records[i])) {
+            return false;
+        }
+        summary.contentHash += CardContentHash(card);
+        fingerprints[i] = CardFingerprint(card.question, card.answer);
+
+        size_t slot = HomeSlot(ToUtf8(card.id), index.size());
+        while (index[slot] != BINARY_INDEX_EMPTY) {
+            slot = (slot + 1) & (index.size() - 1);
+        }
+        index[slot] = static_cast<uint32_t>(i + 1);
+    }
+    builder.FlushBlock();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    const BinaryDeckHeader placeholder{};
+    out.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+
+    SectionWriter writer(out, sizeof(placeholder), {});
+    writer.Add(BinaryDeckSectionType::Cards, BytesOf(records));
+    writer.Add(BinaryDeckSectionType::Ids, builder.ids);
+    writer.Add(BinaryDeckSectionType::BodyBlocks, BytesOf(builder.blocks));
+    writer.Add(BinaryDeckSectionType::Bodies, builder.bodies);
+    writer.Add(BinaryDeckSectionType::Templates, TemplatesSection(deck));
+    writer.Add(BinaryDeckSectionType::IdIndex, BytesOf(index));
+    writer.Add(BinaryDeckSectionType::Summary, BytesOf(&summary, sizeof(summary)));
+    writer.Add(BinaryDeckSectionType::Fingerprints, BytesOf(fingerprints));
+    return writer.Finish();
+}
+
+Deck ParseBinaryDeck(std::string_view data, size_t bodyBudget) {
+    DeckView view;
+    std::string error;
+    if (!OpenDeckView(data, view, error)) {
+        return {};
+    }
+
+    Deck deck;
+    ReadTemplates(view.templates, deck);
+    deck.cards.reserve(view.cardCount);
+
+    BlockCursor cursor;
+    size_t residentBytes = 0;
+    size_t cardIndex = 0;
+    for (const RecordRun& run : view.runs) {
+        for (size_t i = 0; i < run.count; ++i, ++cardIndex) {
+            const BinaryCardRecord& record = run.records[i];
+            Card card{};
+            if ((record.flags & BINARY_CARD_DELETED) != 0 || !ReadRecordId(view, record, card.id)) {
+                continue;
+            }
+            card.reverse = (record.flags & BINARY_CARD_REVERSE) != 0;
+            card.source = CardSource::DeckFile;
+            card.sourceOffset = static_cast<std::streamoff>(cardIndex);
+            card.fingerprint = run.fingerprints != nullptr ? run.fingerprints[i] : 0;
+
+            const bool overBudget = bodyBudget != 0 && residentBytes > bodyBudget;
+            if (!overBudget || (record.flags & BINARY_CARD_CLOZE) != 0) {
+                if (!ReadRecordBody(view, record, cursor, card)) {
+                    continue;
+                }
+                ParseClozeGaps(card.question, card.clozeGaps);
+                if (card.fingerprint == 0) {
+                    card.fingerprint = CardFingerprint(card.question, card.answer);
+                }
+                residentBytes += CardBodyBytes(card);
+                if (bodyBudget != 0 && residentBytes > bodyBudget) {
+                    ReleaseCardBody(card);
+                }
+            }
+            deck.cards.push_back(std::move(card));
+        }
+    }
+    return deck;
+}
+
+void StreamBinaryDeck(std::string_view data, const DeckCardVisitor& visit, Deck& rest) {
+    DeckView view;
+    std::string error;
+    if (!OpenDeckView(data, view, error)) {
+        return;
+    }
+    ReadTemplates(view.templates, rest);
+
+    BlockCursor cursor;
+    CardFieldList extras;
+    size_t cardIndex = 0;
+    for (const RecordRun& run : view.runs) {
+        for (size_t i = 0; i < run.count; ++i, ++cardIndex) {
+            const BinaryCardRecord& record = run.records[i];
+            Card card{};
+            if ((record.flags & BINARY_CARD_DELETED) != 0 || !ReadRecordId(view, record, card.id) ||
+                !ReadRecordBody(view, record, cursor, card)) {
+                continue;
+            }
+            card.reverse = (record.flags & BINARY_CARD_REVERSE) != 0;
+            card.source = CardSource::DeckFile;
+            card.sourceOffset = static_cast<std::streamoff>(cardIndex);
+            card.fingerprint = run.fingerprints != nullptr
+                                   ? run.fingerprints[i]
+                                   : CardFingerprint(card.question, card.answer);
+            ParseClozeGaps(card.question, card.clozeGaps);
+            if (!visit(card, extras, 0)) {
+                return;
+            }
+        }
+    }
+}
+
+bool ReadBinaryCardBodyAt(std::string_view data, size_t index, Card& card) {
+    DeckView view;
+    std::string error;
+    if (!OpenDeckView(data, view, error) || index >= view.cardCount) {
+        return false;
+    }
+
+    const BinaryCardRecord& record = view.Record(index);
+    std::wstring id;
+    BlockCursor cursor;
+    Card parsed{};
+    if ((record.flags & BINARY_CARD_DELETED) != 0 || !ReadRecordId(view, record, id) ||
+        id != card.id || !ReadRecordBody(view, record, cursor, parsed)) {
+        return false;
+    }
+
+    card.question = std::move(parsed.question);
+    card.answer = std::move(parsed.answer);
+    return true;
+}
+
+bool ApplyBinaryDeckPatch(const std::filesystem::path& path, const DeckPatch& patch,
+                          std::string& error) {
+    MappedFile file;
+    if (!file.Open(path, MapOptions{})) {
+        error = "cannot map deck";
+        return false;
+    }
+    const std::string_view data = file.View();
+    DeckView view;
+    if (!OpenDeckView(data, view, error)) {
+        return false;
+    }
+    if (view.indexSlots == 0 || !view.hasSummary) {
+        error = "deck has no id index; pack it again";
+        return false;
+    }
+    if (view.summary.contentHash != patch.baseHash) {
+        error = "patch does not apply to this version of the deck";
+        return false;
+    }
+
+    bool compressed = false;
+    for (const Segment& segment : view.segments) {
+        for (size_t i = 0; i < segment.blockCount && !compressed; ++i) {
+            compressed = segment.blocks[i].storedSize != segment.blocks[i].rawSize;
+        }
+    }
+
+    size_t insertions = 0;
+    for (const PatchOperation& operation : patch.operations) {
+        insertions += operation.kind == PatchKind::Insert ? 1 : 0;
+    }
+    if ((view.summary.usedSlots + insertions) * 4 > view.indexSlots * 3 ||
+        !FitsUint32(view.cardCount + insertions)) {
+        file.Close();
+        return RepackWithPatch(path, patch, compressed, error);
+    }
+
+    // Plan every change against the mapping first; nothing is written until
+    // the patch is known to produce the promised content hash.
+    const uint32_t newSegment = static_cast<uint32_t>(view.segments.size());
+    BinaryDeckOptions options;
+    options.compress = compressed;
+    SegmentBuilder builder(newSegment, options);
+    std::vector<BinaryCardRecord> inserted;
+    std::vector<std::string> insertedIds;
+    std::unordered_map<size_t, uint32_t> slotUpdates;
+    std::unordered_map<uint64_t, BinaryCardRecord> recordUpdates;
+    std::unordered_map<uint64_t, uint64_t> fingerprintUpdates;
+    std::vector<uint64_t> insertedFingerprints;
+    std::unordered_set<std::wstring> touched;
+    BinaryDeckSummary summary = view.summary;
+    BlockCursor cursor;
+    const bool fingerprinted =
+        std::all_of(view.runs.begin(), view.runs.end(),
+                    [](const RecordRun& run) { return run.fingerprints != nullptr; });
+
+    const auto slotValue = [&](size_t slot) {
+        const auto updated = slotUpdates.find(slot);
+        return updated != slotUpdates.end() ? updated->second : view.index[slot];
+    };
+    for (const PatchOperation& operation : patch.operations) {
+        if (!touched.insert(operation.id).second) {
+            error = "patch changes card " + ToUtf8(operation.id) + " twice";
+            return false;
+        }
+
+        // Find the card's slot, remembering the first reusable one on the way.
+        const std::string id = ToUtf8(operation.id);
+        const size_t mask = view.indexSlots - 1;
+        size_t slot = HomeSlot(id, view.indexSlots);
+        size_t freeSlot = view.indexSlots;
+        size_t found = view.cardCount + inserted.size();
+        for (size_t probes = 0; probes < view.indexSlots; ++probes, slot = (slot + 1) & mask) {
+            const uint32_t value = slotValue(slot);
+            if (value == BINARY_INDEX_EMPTY || value == BINARY_INDEX_DELETED) {
+                freeSlot = freeSlot == view.indexSlots ? slot : freeSlot;
+                if (value == BINARY_INDEX_EMPTY) {
+                    break;
+                }
+                continue;
+            }
+
+            const size_t card = value - 1;
+            std::string_view cardId;
+            if (card >= view.cardCount) {
+                cardId = card - view.cardCount < insertedIds.size()
+                             ? std::string_view(insertedIds[card - view.cardCount])
+                             : std::string_view();
+            } else if (!RecordIdBytes(view, view.Record(card), cardId)) {
+                error = "damaged card record " + std::to_string(card);
+                return false;
+            }
+            if (cardId == id) {
+                found = card;
+                break;
+            }
+        }
+
+        const bool exists = found < view.cardCount + inserted.size();
+        if (exists != (operation.kind != PatchKind::Insert)) {
+            error = "patch does not match card " + id;
+            return false;
+        }
+
+        if (operation.kind == PatchKind::Insert) {
+            Card card{};
+            card.id = operation.id;
+            ApplyPatchFields(operation, card);
+            BinaryCardRecord record{};
+            if (freeSlot == view.indexSlots || !builder.Add(card, record)) {
+                error = "no room for card " + id;
+                return false;
+            }
+            summary.contentHash += CardContentHash(card);
+            ++summary.liveCards;
+            summary.usedSlots += slotValue(freeSlot) == BINARY_INDEX_EMPTY ? 1 : 0;
+            slotUpdates[freeSlot] = static_cast<uint32_t>(view.cardCount + inserted.size() + 1);
+            inserted.push_back(record);
+            insertedIds.push_back(id);
+            insertedFingerprints.push_back(card.fingerprint);
+            continue;
+        }
+
+        uint64_t recordOffset = 0;
+        const BinaryCardRecord& record = view.Record(found, &recordOffset);
+        Card card{};
+        card.id = operation.id;
+        card.reverse = (record.flags & BINARY_CARD_REVERSE) != 0;
+        if (!ReadRecordBody(view, record, cursor, card)) {
+            error = "damaged card body " + id;
+            return false;
+        }
+        summary.contentHash -= CardContentHash(card);
+
+        if (operation.kind == PatchKind::Delete) {
+            BinaryCardRecord deleted = record;
+            deleted.flags |= BINARY_CARD_DELETED;
+            recordUpdates[recordOffset] = deleted;
+            slotUpdates[slot] = BINARY_INDEX_DELETED;
+            --summary.liveCards;
+            continue;
+        }
+
+        ParseClozeGaps(card.question, card.clozeGaps);
+        ApplyPatchFields(operation, card);
+        BinaryCardRecord replaced{};
+        if (!builder.Add(card, replaced)) {
+            error = "no room for card " + id;
+            return false;
+        }
+        summary.contentHash += CardContentHash(card);
+        recordUpdates[recordOffset] = replaced;
+        if (fingerprinted) {
+            size_t local = found;
+            const RecordRun& run = view.Locate(local);
+            fingerprintUpdates[run.fingerprintsOffset + local * sizeof(uint64_t)] =
+                card.fingerprint;
+        }
+    }
+    builder.FlushBlock();
+
+    if (summary.contentHash != patch.resultHash) {
+        error = "patched deck does not match the patch's content hash";
+        return false;
+    }
+
+    // Collect the in-place edits with the bytes they replace, so that each
+    // section's CRC can be updated without reading the rest of it.
+    std::vector<BinaryDeckSection> directory(view.directory,
+                                             view.directory + view.header.sectionCount);
+    const auto sectionAt = [&](uint64_t fileOffset) {
+        for (size_t i = 0; i < directory.size(); ++i) {
+            if (fileOffset >= directory[i].offset &&
+                fileOffset < directory[i].offset + directory[i].size) {
+                return i;
+            }
+        }
+        return directory.size();
+    };
+    std::vector<SectionEdit> edits;
+    const auto addEdit = [&](uint64_t fileOffset, std::string_view after) {
+        const std::string_view before = data.substr(static_cast<size_t>(fileOffset), after.size());
+        edits.push_back(
+            {sectionAt(fileOffset), fileOffset, std::string(before), std::string(after)});
+    };
+    for (const auto& [fileOffset, record] : recordUpdates) {
+        addEdit(fileOffset, BytesOf(&record, sizeof(record)));
+    }
+    for (const auto& [fileOffset, fingerprint] : fingerprintUpdates) {
+        addEdit(fileOffset, BytesOf(&fingerprint, sizeof(fingerprint)));
+    }
+    for (const auto& [slot, value] : slotUpdates) {
+        addEdit(view.indexOffset + slot * sizeof(uint32_t), BytesOf(&value, sizeof(value)));
+    }
+    for (size_t i = 0; i < directory.size(); ++i) {
+        if (directory[i].type == BinaryDeckSectionType::Summary) {
+            addEdit(directory[i].offset, BytesOf(&summary, sizeof(summary)));
+        }
+    }
+    for (const SectionEdit& edit : edits) {
+        BinaryDeckSection& section = directory[edit.section];
+        section.crc = Crc32cReplace(section.crc, section.size, edit.fileOffset - section.offset,
+                                    edit.before, edit.after);
+    }
+    const uint64_t end = data.size();
+    file.Close();
+
+    std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!out) {
+        error = "cannot open deck for writing";
+        return false;
+    }
+    out.seekp(static_cast<std::streamoff>(end));
+    SectionWriter writer(out, end, std::move(directory));
+    writer.Add(BinaryDeckSectionType::Cards, BytesOf(inserted));
+    writer.Add(BinaryDeckSectionType::Ids, builder.ids);
+    writer.Add(BinaryDeckSectionType::BodyBlocks, BytesOf(builder.blocks));
+    writer.Add(BinaryDeckSectionType::Bodies, builder.bodies);
+    if (fingerprinted) {
+        writer.Add(BinaryDeckSectionType::Fingerprints, BytesOf(insertedFingerprints));
+    }
+    for (const SectionEdit& edit : edits) {
+        out.seekp(static_cast<std::streamoff>(edit.fileOffset));
+        out.write(edit.after.data(), static_cast<std::streamsize>(edit.after.size()));
+    }
+    out.seekp(0, std::ios::end);
+    if (!writer.Finish()) {
+        error = "cannot write deck";
+        return false;
+    }
+    return true;
+}
+
+bool VerifyBinaryDeck(std::string_view data, std::vector<BinaryDeckSectionCheck>& sections,
+                      std::string& error) {
+    sections.clear();
+    DeckView view;
+    if (!OpenDeckView(data, view, error)) {
+        return false;
+    }
+
+    bool valid = true;
+    for (uint32_t i = 0; i < view.header.sectionCount; ++i) {
+        const BinaryDeckSection& section = view.directory[i];
+        const std::string_view bytes =
+            data.substr(static_cast<size_t>(section.offset), static_cast<size_t>(section.size));
+        const bool sectionValid = Crc32c(bytes, 0) == section.crc;
+        sections.push_back({section.type, section.size, sectionValid});
+        if (!sectionValid && valid) {
+            error = std::string(BinaryDeckSectionName(section.type)) + " checksum mismatch";
+            valid = false;
+        }
+    }
+    return valid;
+}
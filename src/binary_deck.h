@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "deck.h"
+#include "deck_patch.h"
+
+// A .qadeck file is a deck packed for distribution:
+//   header     BinaryDeckHeader at offset 0
+//   sections   8-byte aligned, in any order
+//   directory  sectionCount BinaryDeckSection entries at directoryOffset
+// Integers are little-endian, as on every Windows target, and the fixed-size
+// records are read in place from the mapping. Card ids are kept apart from
+// the bodies so that a deck loads without reading any question or answer.
+// Bodies are UTF-8 in blocks that are LZ-compressed when that saves space;
+// one card's text never spans two blocks. Readers skip section types they
+// do not know, so new sections do not need a new version.
+//
+// Patches are applied in place by appending a segment: one more Cards, Ids,
+// BodyBlocks and Bodies section. The Nth section of each of the last three
+// types belongs to segment N, and records name their segment. Card indices
+// run through the Cards sections in directory order; replaced and deleted
+// records are rewritten where they are, and the id index and summary are
+// updated slot by slot.
+
+constexpr char BINARY_DECK_MAGIC[8] = {'Q', 'A', 'D', 'E', 'C', 'K', '\r', '\n'};
+constexpr uint16_t BINARY_DECK_VERSION = 1;
+
+enum class BinaryDeckSectionType : uint32_t {
+    Cards = 1,       // BinaryCardRecord per card
+    Ids = 2,         // UTF-8 card ids, referenced by the records
+    BodyBlocks = 3,  // BinaryBodyBlock per body block
+    Bodies = 4,      // stored body blocks
+    Templates = 5,   // uint32 question length, uint32 answer length, UTF-8 text
+    IdIndex = 6,     // open-addressing table of uint32 slots, see below
+    Summary = 7,     // BinaryDeckSummary
+    // uint64 CardFingerprint per record; the Nth one belongs to the Nth
+    // Cards section.
+    Fingerprints = 8,
+};
+
+struct BinaryDeckHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t sectionCount;
+    uint64_t directoryOffset;
+    // CRC32C of the directory, and of the header bytes before headerCrc.
+    uint32_t directoryCrc;
+    uint32_t headerCrc;
+};
+
+struct BinaryDeckSection {
+    BinaryDeckSectionType type;
+    // CRC32C of the section's bytes.
+    uint32_t crc;
+    uint64_t offset;
+    uint64_t size;
+};
+
+constexpr uint32_t BINARY_CARD_REVERSE = 1u << 0;
+constexpr uint32_t BINARY_CARD_CLOZE = 1u << 1;
+constexpr uint32_t BINARY_CARD_DELETED = 1u << 2;
+
+struct BinaryCardRecord {
+    uint32_t flags;
+    uint32_t idOffset;
+    uint32_t idLength;
+    uint32_t block;
+    // Offset of the question, followed directly by the answer, in the
+    // block's uncompressed bytes.
+    uint32_t bodyOffset;
+    uint32_t questionLength;
+    uint32_t answerLength;
+    uint32_t segment;
+};
+
+struct BinaryBodyBlock {
+    // Offset within the Bodies section.
+    uint64_t offset;
+    uint32_t storedSize;
+    // Equal to storedSize for a block stored uncompressed.
+    uint32_t rawSize;
+};
+
+// Id index slots hold a card index plus one, probed linearly from the low
+// bits of the XXH64 of the UTF-8 id. The table is a power of two at least
+// twice the card count.
+constexpr uint32_t BINARY_INDEX_EMPTY = 0;
+constexpr uint32_t BINARY_INDEX_DELETED = 0xFFFFFFFFu;
+
+struct BinaryDeckSummary {
+    // DeckContentHash of the live cards.
+    uint64_t contentHash;
+    uint64_t liveCards;
+    // Index slots ever filled, deleted ones included.
+    uint64_t usedSlots;
+};
+
+struct BinaryDeckOptions {
+    bool compress{false};
+    size_t blockSize{64 * 1024};
+};
+
+// Checksum result for one section, as reported by VerifyBinaryDeck.
+struct BinaryDeckSectionCheck {
+    BinaryDeckSectionType type;
+    uint64_t size;
+    bool valid;
+};
+
+bool IsBinaryDeck(std::string_view data);
+const char* BinaryDeckSectionName(BinaryDeckSectionType type);
+
+// Packs the cards and templates of deck, whose cards must hold their
+// bodies. Generators are not packed; they only exist in compiled form.
+bool WriteBinaryDeck(const Deck& deck, const BinaryDeckOptions& options,
+                     const std::filesystem::path& path);
+
+// Loads a packed deck after checking the header and directory checksums.
+// Section checksums are left to VerifyBinaryDeck, which has to read the
+// whole file. Bodies are kept for the leading cards within bodyBudget as in
+// ParseDeckFromYaml; cloze bodies are always read once to find their gaps.
+// Each card's sourceOffset is its card index; deleted cards are skipped.
+// Fingerprints come from the Fingerprints sections, or from the body where
+// an older deck has none and the body is read.
+Deck ParseBinaryDeck(std::string_view data, size_t bodyBudget);
+
+// Hands the live cards to visit with their bodies, one block at a time; see
+// StreamDeckCards. consumed is always 0 as the sections are read in parallel.
+void StreamBinaryDeck(std::string_view data, const DeckCardVisitor& visit, Deck& rest);
+
+// Re-reads the question/answer of card index.
+bool ReadBinaryCardBodyAt(std::string_view data, size_t index, Card& card);
+
+// Applies patch to the packed deck at path, reading and writing only what
+// the patch touches: the stored content hash is checked against the patch
+// before anything is written, and the resulting hash must equal the one the
+// patch promises. When the id index has no room for the insertions the deck
+// is repacked instead. A crash midway leaves a deck that fails verification.
+bool ApplyBinaryDeckPatch(const std::filesystem::path& path, const DeckPatch& patch,
+                          std::string& error);
+
+// Checks the header, the directory and every section checksum. Returns
+// false with a message in error if any of them is damaged.
+bool VerifyBinaryDeck(std::string_view data, std::vector<BinaryDeckSectionCheck>& sections,
+                      std::string& error);
@@ -0,0 +1,143 @@
+#include "block_compression.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr unsigned HASH_BITS = 13;
+
+uint32_t Read32(const char* data) {
+    uint32_t value = 0;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t HashOf(uint32_t value) {
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void AppendLength(size_t length, std::string& out) {
+    while (length >= 255) {
+        out += static_cast<char>(255);
+        length -= 255;
+    }
+    out += static_cast<char>(length);
+}
+
+void AppendSequence(std::string_view literals, size_t matchLength, size_t offset,
+                    std::string& out) {
+    const size_t literalNibble = literals.size() < 15 ? literals.size() : 15;
+    const size_t matchCode = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+    const size_t matchNibble = matchCode < 15 ? matchCode : 15;
+    out += static_cast<char>((literalNibble << 4) | matchNibble);
+    if (literalNibble == 15) {
+        AppendLength(literals.size() - 15, out);
+    }
+    out.append(literals);
+    if (matchLength == 0) {
+        return;
+    }
+
+    out += static_cast<char>(offset & 0xFF);
+    out += static_cast<char>(offset >> 8);
+    if (matchNibble == 15) {
+        AppendLength(matchCode - 15, out);
+    }
+}
+
+bool ReadLength(std::string_view input, size_t& position, size_t& length) {
+    unsigned char next = 255;
+    while (next == 255) {
+        if (position >= input.size()) {
+            return false;
+        }
+        next = static_cast<unsigned char>(input[position++]);
+        length += next;
+    }
+    return true;
+}
+}
+
+void CompressBlock(std::string_view input, std::string& out) {
+    out.clear();
+    out.reserve(input.size() + input.size() / 255 + 16);
+
+    // Positions are stored plus one so that zero marks an empty slot.
+    std::vector<uint32_t> table(size_t{1} << HASH_BITS, 0);
+    size_t anchor = 0;
+    size_t position = 0;
+    while (position + MIN_MATCH <= input.size()) {
+        const uint32_t word = Read32(input.data() + position);
+        uint32_t& slot = table[HashOf(word)];
+        const size_t candidate = slot;
+        slot = static_cast<uint32_t>(position + 1);
+        if (candidate == 0 || position + 1 - candidate > MAX_OFFSET ||
+            Read32(input.data() + candidate - 1) != word) {
+            ++position;
+            continue;
+        }
+
+        const size_t matchStart = candidate - 1;
+        size_t length = MIN_MATCH;
+        while (position + length < input.size() &&
+               input[matchStart + length] == input[position + length]) {
+            ++length;
+        }
+        AppendSequence(input.substr(anchor, position - anchor), length, position - matchStart,
+                       out);
+        position += length;
+        anchor = position;
+    }
+    AppendSequence(input.substr(anchor), 0, 0, out);
+}
+
+bool DecompressBlock(std::string_view input, size_t rawSize, std::string& out) {
+    out.clear();
+    out.reserve(rawSize);
+    size_t position = 0;
+    while (position < input.size()) {
+        const auto token = static_cast<unsigned char>(input[position++]);
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(input, position, literalLength)) {
+            return false;
+        }
+        if (literalLength > input.size() - position || out.size() + literalLength > rawSize) {
+            return false;
+        }
+        out.append(input.substr(position, literalLength));
+        position += literalLength;
+        if (position == input.size()) {
+            break;
+        }
+
+        if (input.size() - position < 2) {
+            return false;
+        }
+        const size_t offset = static_cast<unsigned char>(input[position]) |
+                              (static_cast<size_t>(static_cast<unsigned char>(input[position + 1]))
+                               << 8);
+        position += 2;
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !ReadLength(input, position, matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+        if (offset == 0 || offset > out.size() || out.size() + matchLength > rawSize) {
+            return false;
+        }
+
+        size_t from = out.size() - offset;
+        if (offset >= matchLength) {
+            out.append(out, from, matchLength);
+            continue;
+        }
+        // Byte by byte: an overlapping match repeats the bytes it is producing.
+        for (size_t i = 0; i < matchLength; ++i) {
+            out += out[from++];
+        }
+    }
+    return out.size() == rawSize;
+}
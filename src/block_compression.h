@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Byte-oriented LZ77 in the style of LZ4 blocks: sequences of literals and
+// back references of at least 4 bytes up to 64 KiB back. Compression is a
+// single greedy pass, so decompression costs little more than a copy.
+
+// Replaces out with the compressed form of input.
+void CompressBlock(std::string_view input, std::string& out);
+
+// Replaces out with the rawSize bytes input decompresses to. Returns false
+// for corrupt input instead of reading or writing out of bounds.
+bool DecompressBlock(std::string_view input, size_t rawSize, std::string& out);
@@ -0,0 +1,348 @@
+#include "card_clusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <thread>
+
+namespace {
+// Points whose distances are computed together; the per-block scratch
+// arrays stay in L1.
+constexpr size_t CLUSTER_BLOCK_POINTS = 256;
+// Below this many points per thread, starting a thread costs more than
+// its share of an iteration.
+constexpr size_t PARALLEL_CLUSTER_MIN_POINTS = 1 << 16;
+
+struct FeatureColumns {
+    const float* columns[CARD_FEATURE_COUNT];
+};
+
+// Sums of one run of points for the update step.
+struct ClusterPartial {
+    std::vector<double> sums{};
+    std::vector<uint64_t> counts{};
+    size_t changed{0};
+    double inertia{0.0};
+};
+
+size_t RunBegin(size_t count, size_t partCount, size_t part) {
+    return part == partCount ? count : count / partCount * part;
+}
+
+// Calls work(part) for part 0 .. partCount - 1, the last on this thread.
+template <typename Work>
+void RunParts(size_t partCount, const Work& work) {
+    std::vector<std::thread> workers;
+    for (size_t part = 0; part + 1 < partCount; ++part) {
+        workers.emplace_back(work, part);
+    }
+    work(partCount - 1);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// The kernels below are written so that compilers vectorize them without
+// fast-math: the features of a point are combined in registers, there are
+// no branches, and sums are kept in CLUSTER_SUM_LANES separate accumulators
+// rather than one that every add would have to wait for.
+constexpr size_t CLUSTER_SUM_LANES = 8;
+
+// For points [begin, begin + count), keeps in best and nearest whichever
+// is closer: the centroid already there or centroid, numbered cluster.
+void KeepNearest(const FeatureColumns& points, size_t begin, size_t count, const float* centroid,
+                 uint32_t cluster, float* best, uint32_t* nearest) {
+    const FeatureColumns local = points;
+    float center[CARD_FEATURE_COUNT];
+    std::copy(centroid, centroid + CARD_FEATURE_COUNT, center);
+    for (size_t i = 0; i < count; ++i) {
+        float distance = 0.0f;
+        for (size_t feature = 0; feature < CARD_FEATURE_COUNT; ++feature) {
+            const float difference = local.columns[feature][begin + i] - center[feature];
+            distance += difference * difference;
+        }
+        const uint32_t closer = distance < best[i] ? 1 : 0;
+        nearest[i] += (cluster - nearest[i]) * closer;
+        best[i] = std::min(best[i], distance);
+    }
+}
+
+float SumFloats(const float* values, size_t count) {
+    float lanes[CLUSTER_SUM_LANES] = {};
+    size_t i = 0;
+    for (; i + CLUSTER_SUM_LANES <= count; i += CLUSTER_SUM_LANES) {
+        for (size_t lane = 0; lane < CLUSTER_SUM_LANES; ++lane) {
+            lanes[lane] += values[i + lane];
+        }
+    }
+    float sum = 0.0f;
+    for (; i < count; ++i) {
+        sum += values[i];
+    }
+    for (const float lane : lanes) {
+        sum += lane;
+    }
+    return sum;
+}
+
+// Adds the features of the points of [begin, begin + count) nearest to
+// cluster to sums and returns how many there are.
+uint32_t SumMembers(const FeatureColumns& points, size_t begin, size_t count,
+                    const uint32_t* nearest, uint32_t cluster, double* sums) {
+    const FeatureColumns local = points;
+    float lanes[CARD_FEATURE_COUNT][CLUSTER_SUM_LANES] = {};
+    uint32_t members[CLUSTER_SUM_LANES] = {};
+    size_t i = 0;
+    for (; i + CLUSTER_SUM_LANES <= count; i += CLUSTER_SUM_LANES) {
+        for (size_t lane = 0; lane < CLUSTER_SUM_LANES; ++lane) {
+            const uint32_t member = nearest[i + lane] == cluster ? 1 : 0;
+            members[lane] += member;
+            for (size_t feature = 0; feature < CARD_FEATURE_COUNT; ++feature) {
+                lanes[feature][lane] +=
+                    local.columns[feature][begin + i + lane] * static_cast<float>(member);
+            }
+        }
+    }
+    uint32_t total = 0;
+    for (; i < count; ++i) {
+        if (nearest[i] == cluster) {
+            ++total;
+            for (size_t feature = 0; feature < CARD_FEATURE_COUNT; ++feature) {
+                sums[feature] += local.columns[feature][begin + i];
+            }
+        }
+    }
+    for (size_t lane = 0; lane < CLUSTER_SUM_LANES; ++lane) {
+        total += members[lane];
+        for (size_t feature = 0; feature < CARD_FEATURE_COUNT; ++feature) {
+            sums[feature] += lanes[feature][lane];
+        }
+    }
+    return total;
+}
+
+// Assigns points [begin, end) to their nearest centroid and adds them to
+// partial.
+void AssignRun(const FeatureColumns& points, size_t begin, size_t end,
+               const std::vector<float>& centroids, uint32_t* assignments,
+               ClusterPartial& partial) {
+    const size_t clusters = centroids.size() / CARD_FEATURE_COUNT;
+    float best[CLUSTER_BLOCK_POINTS];
+    uint32_t nearest[CLUSTER_BLOCK_POINTS];
+    for (size_t block = begin; block < end; block += CLUSTER_BLOCK_POINTS) {
+        const size_t count = std::min(CLUSTER_BLOCK_POINTS, end - block);
+        std::fill(best, best + count, std::numeric_limits<float>::max());
+        std::fill(nearest, nearest + count, 0);
+        for (uint32_t cluster = 0; cluster < clusters; ++cluster) {
+            KeepNearest(points, block, count, &centroids[cluster * CARD_FEATURE_COUNT], cluster,
+                        best, nearest);
+        }
+        partial.inertia += SumFloats(best, count);
+        for (size_t i = 0; i < count; ++i) {
+            partial.changed += assignments[block + i] != nearest[i] ? 1 : 0;
+            assignments[block + i] = nearest[i];
+        }
+        // Masked sums per cluster rather than adding each point to its
+        // cluster's sums, which vectorizes and has no chain of dependent adds.
+        for (uint32_t cluster = 0; cluster < clusters; ++cluster) {
+            partial.counts[cluster] += SumMembers(points, block, count, nearest, cluster,
+                                                  &partial.sums[cluster * CARD_FEATURE_COUNT]);
+        }
+    }
+}
+
+// Lowers distances[i] of points [begin, end) to their squared distance to
+// centroid and returns the sum of the results.
+double NarrowDistances(const FeatureColumns& points, size_t begin, size_t end,
+                       const float* centroid, float* distances) {
+    uint32_t unused[CLUSTER_BLOCK_POINTS] = {};
+    double total = 0.0;
+    for (size_t block = begin; block < end; block += CLUSTER_BLOCK_POINTS) {
+        const size_t count = std::min(CLUSTER_BLOCK_POINTS, end - block);
+        KeepNearest(points, block, count, centroid, 0, distances + block, unused);
+        total += SumFloats(distances + block, count);
+    }
+    return total;
+}
+
+// k-means++: each further centroid is a point drawn with probability
+// proportional to its squared distance from the nearest centroid so far.
+std::vector<float> SeedCentroids(const FeatureColumns& points, size_t pointCount,
+                                 size_t clusters, size_t partCount, uint64_t seed) {
+    std::mt19937_64 random(seed);
+    std::vector<float> centroids;
+    const auto addCentroid = [&](size_t point) {
+        for (size_t feature = 0; feature < CARD_FEATURE_COUNT; ++feature) {
+            centroids.push_back(points.columns[feature][point]);
+        }
+    };
+    addCentroid(std::uniform_int_distribution<size_t>(0, pointCount - 1)(random));
+
+    std::vector<float> distances(pointCount, std::numeric_limits<float>::max());
+    std::vector<double> partTotals(partCount);
+    while (centroids.size() < clusters * CARD_FEATURE_COUNT) {
+        const float* latest = &centroids[centroids.size() - CARD_FEATURE_COUNT];
+        RunParts(partCount, [&](size_t part) {
+            partTotals[part] =
+                NarrowDistances(points, RunBegin(pointCount, partCount, part),
+                                RunBegin(pointCount, partCount, part + 1), latest,
+                                distances.data());
+        });
+        const double total = std::accumulate(partTotals.begin(), partTotals.end(), 0.0);
+        if (!(total > 0.0)) {
+            // Every point sits on a centroid already.
+            addCentroid(std::uniform_int_distribution<size_t>(0, pointCount - 1)(random));
+            continue;
+        }
+
+        double target = std::uniform_real_distribution<double>(0.0, total)(random);
+        size_t part = 0;
+        while (part + 1 < partCount && target >= partTotals[part]) {
+            target -= partTotals[part++];
+        }
+        size_t point = RunBegin(pointCount, partCount, part);
+        const size_t end = RunBegin(pointCount, partCount, part + 1);
+        while (point + 1 < end && target >= distances[point]) {
+            target -= distances[point++];
+        }
+        addCentroid(point);
+    }
+    return centroids;
+}
+}
+
+CardFeatures BuildCardFeatures(const std::vector<CardStats>& stats,
+                               const std::vector<CardResponseTimes>& times, uint32_t minReviews) {
+    CardFeatures features;
+    std::vector<float> rows;
+    std::vector<bool> timed;
+    for (size_t card = 0; card < stats.size(); ++card) {
+        const uint32_t reviews = ReviewCount(stats[card]);
+        if (reviews == 0 || reviews < minReviews) {
+            continue;
+        }
+        const float perReview = 1.0f / static_cast<float>(reviews);
+        const bool hasTime = card < times.size() && times[card].think.count != 0;
+        features.cards.push_back(static_cast<uint32_t>(card));
+        rows.push_back(stats[card].counts[static_cast<size_t>(ReviewRating::Bad)] * perReview);
+        rows.push_back(stats[card].counts[static_cast<size_t>(ReviewRating::Meh)] * perReview);
+        rows.push_back(stats[card].lapses * perReview);
+        rows.push_back(hasTime ? static_cast<float>(std::log1p(
+                                     SketchQuantile(times[card].think, 0.5) / 1000.0))
+                               : 0.0f);
+        timed.push_back(hasTime);
+    }
+
+    // Standardize so that no feature dominates the distance by its scale;
+    // cards without think times get the mean, which standardizes to 0.
+    const size_t count = features.cards.size();
+    features.values.resize(count * CARD_FEATURE_COUNT);
+    for (size_t feature = 0; feature < CARD_FEATURE_COUNT; ++feature) {
+        const bool timeFeature = feature == CARD_FEATURE_COUNT - 1;
+        double sum = 0.0;
+        double squares = 0.0;
+        size_t known = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (!timeFeature || timed[i]) {
+                const double value = rows[i * CARD_FEATURE_COUNT + feature];
+                sum += value;
+                squares += value * value;
+                ++known;
+            }
+        }
+        const double mean = known == 0 ? 0.0 : sum / static_cast<double>(known);
+        const double variance =
+            known == 0 ? 0.0 : std::max(0.0, squares / static_cast<double>(known) - mean * mean);
+        const double scale = variance > 0.0 ? 1.0 / std::sqrt(variance) : 0.0;
+        float* column = &features.values[feature * count];
+        for (size_t i = 0; i < count; ++i) {
+            column[i] = !timeFeature || timed[i]
+                            ? static_cast<float>((rows[i * CARD_FEATURE_COUNT + feature] - mean) *
+                                                 scale)
+                            : 0.0f;
+        }
+    }
+    return features;
+}
+
+ClusterResult ClusterCards(const CardFeatures& features, const ClusterOptions& options) {
+    ClusterResult result;
+    const size_t pointCount = features.cards.size();
+    const size_t clusters = std::min(options.clusters, pointCount);
+    if (clusters == 0) {
+        return result;
+    }
+    FeatureColumns points{};
+    for (size_t feature = 0; feature < CARD_FEATURE_COUNT; ++feature) {
+        points.columns[feature] = &features.values[feature * pointCount];
+    }
+    const size_t hardwareThreads =
+        options.threads != 0 ? options.threads
+                             : std::max<size_t>(1, std::thread::hardware_concurrency());
+    const size_t partCount = std::max<size_t>(
+        1, std::min(hardwareThreads, pointCount / PARALLEL_CLUSTER_MIN_POINTS));
+
+    result.centroids = SeedCentroids(points, pointCount, clusters, partCount, options.seed);
+    result.assignments.assign(pointCount, UINT32_MAX);
+    std::vector<ClusterPartial> partials(partCount);
+    while (result.iterations < std::max<size_t>(1, options.maxIterations)) {
+        ++result.iterations;
+        RunParts(partCount, [&](size_t part) {
+            ClusterPartial& partial = partials[part];
+            partial = ClusterPartial{};
+            partial.sums.assign(clusters * CARD_FEATURE_COUNT, 0.0);
+            partial.counts.assign(clusters, 0);
+            AssignRun(points, RunBegin(pointCount, partCount, part),
+                      RunBegin(pointCount, partCount, part + 1), result.centroids,
+                      result.assignments.data(), partial);
+        });
+
+        ClusterPartial total = std::move(partials[0]);
+        for (size_t part = 1; part < partCount; ++part) {
+            for (size_t i = 0; i < total.sums.size(); ++i) {
+                total.sums[i] += partials[part].sums[i];
+            }
+            for (size_t cluster = 0; cluster < clusters; ++cluster) {
+                total.counts[cluster] += partials[part].counts[cluster];
+            }
+            total.changed += partials[part].changed;
+            total.inertia += partials[part].inertia;
+        }
+        result.inertia = total.inertia;
+        if (total.changed == 0) {
+            break;
+        }
+        // An emptied cluster keeps its centroid.
+        for (size_t cluster = 0; cluster < clusters; ++cluster) {
+            for (size_t feature = 0; feature < CARD_FEATURE_COUNT && total.counts[cluster] != 0;
+                 ++feature) {
+                result.centroids[cluster * CARD_FEATURE_COUNT + feature] =
+                    static_cast<float>(total.sums[cluster * CARD_FEATURE_COUNT + feature] /
+                                       static_cast<double>(total.counts[cluster]));
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<uint32_t> RankClustersByDifficulty(const ClusterResult& result) {
+    // Every feature grows with difficulty, so their standardized sum orders
+    // the centroids.
+    const size_t clusters = result.centroids.size() / CARD_FEATURE_COUNT;
+    std::vector<float> scores(clusters);
+    std::vector<uint32_t> order(clusters);
+    for (size_t cluster = 0; cluster < clusters; ++cluster) {
+        const auto centroid = result.centroids.begin() + cluster * CARD_FEATURE_COUNT;
+        scores[cluster] = std::accumulate(centroid, centroid + CARD_FEATURE_COUNT, 0.0f);
+        order[cluster] = static_cast<uint32_t>(cluster);
+    }
+    std::sort(order.begin(), order.end(),
+              [&](uint32_t a, uint32_t b) { return scores[a] < scores[b]; });
+    std::vector<uint32_t> tiers(clusters);
+    for (size_t rank = 0; rank < clusters; ++rank) {
+        tiers[order[rank]] = static_cast<uint32_t>(rank);
+    }
+    return tiers;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "review_stats.h"
+
+// Difficulty tiers: cards are described by a few features of their review
+// history and grouped with k-means. Points are stored feature by feature,
+// so the distance kernel runs down contiguous floats a block of points at a
+// time and vectorizes; assignment and the centroid sums run on separate
+// threads over contiguous runs of points.
+
+// Share of Bad ratings, share of Meh ratings, lapses per review and the
+// log of the median think time, each standardized over the clustered cards.
+constexpr size_t CARD_FEATURE_COUNT = 4;
+
+struct CardFeatures {
+    // Deck index of each point.
+    std::vector<uint32_t> cards{};
+    // Feature f of point i at f * cards.size() + i.
+    std::vector<float> values{};
+};
+
+// Features of the cards with at least minReviews reviews. times may be
+// shorter than stats.
+CardFeatures BuildCardFeatures(const std::vector<CardStats>& stats,
+                               const std::vector<CardResponseTimes>& times, uint32_t minReviews);
+
+struct ClusterOptions {
+    size_t clusters{4};
+    size_t maxIterations{100};
+    // 0 uses one per hardware thread.
+    size_t threads{0};
+    uint64_t seed{1};
+};
+
+struct ClusterResult {
+    // Centroid c's feature f at c * CARD_FEATURE_COUNT + f.
+    std::vector<float> centroids{};
+    // Cluster of each point.
+    std::vector<uint32_t> assignments{};
+    size_t iterations{0};
+    // Sum of squared distances to the assigned centroids.
+    double inertia{0.0};
+};
+
+// k-means with k-means++ seeding, until no point changes cluster or
+// maxIterations. Fewer points than clusters gives one cluster per point.
+ClusterResult ClusterCards(const CardFeatures& features, const ClusterOptions& options);
+
+// Cluster numbers ordered from easiest to hardest centroid: tier[c] is the
+// 0-based tier of cluster c.
+std::vector<uint32_t> RankClustersByDifficulty(const ClusterResult& result);
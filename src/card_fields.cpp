@@ -0,0 +1,81 @@
+#include "card_fields.h"
+
+#include <bitset>
+#include <utility>
+
+namespace {
+constexpr size_t BITS_PER_WORD = 64;
+
+size_t BitCount(uint64_t word) {
+    return std::bitset<BITS_PER_WORD>(word).count();
+}
+
+bool IsPresent(const CardFieldColumn& column, size_t card) {
+    const size_t word = card / BITS_PER_WORD;
+    return word < column.present.size() &&
+           (column.present[word] >> (card % BITS_PER_WORD) & 1u) != 0;
+}
+}
+
+uint32_t FindCardField(const CardFieldTable& table, std::wstring_view name) {
+    for (size_t i = 0; i < table.columns.size(); ++i) {
+        if (table.columns[i].name == name) {
+            return static_cast<uint32_t>(i);
+        }
+    }
+    return MISSING_CARD_FIELD;
+}
+
+std::wstring_view CardFieldValue(const CardFieldTable& table, uint32_t field, size_t card) {
+    if (field >= table.columns.size() || !IsPresent(table.columns[field], card)) {
+        return {};
+    }
+    const CardFieldColumn& column = table.columns[field];
+    const size_t word = card / BITS_PER_WORD;
+    const uint64_t below = (uint64_t{1} << (card % BITS_PER_WORD)) - 1;
+    return column.values[column.rank[word] + BitCount(column.present[word] & below)];
+}
+
+void AppendCardField(CardFieldTable& table, std::wstring_view name, size_t card,
+                     std::wstring value) {
+    uint32_t field = FindCardField(table, name);
+    if (field == MISSING_CARD_FIELD) {
+        field = static_cast<uint32_t>(table.columns.size());
+        table.columns.push_back({std::wstring(name)});
+    }
+
+    CardFieldColumn& column = table.columns[field];
+    const size_t word = card / BITS_PER_WORD;
+    if (IsPresent(column, card)) {
+        // A repeated key within one card: the last one wins, as for the
+        // built-in fields. It is always the most recently added value.
+        column.values.back() = std::move(value);
+        return;
+    }
+    while (column.present.size() <= word) {
+        column.present.push_back(0);
+        column.rank.push_back(static_cast<uint32_t>(column.values.size()));
+    }
+    column.present[word] |= uint64_t{1} << (card % BITS_PER_WORD);
+    column.values.push_back(std::move(value));
+}
+
+void RemoveCardField(CardFieldTable& table, std::wstring_view name) {
+    const uint32_t field = FindCardField(table, name);
+    if (field != MISSING_CARD_FIELD) {
+        table.columns.erase(table.columns.begin() + field);
+    }
+}
+
+CardFieldTable SelectCardFields(const CardFieldTable& table, const std::vector<size_t>& kept) {
+    CardFieldTable selected;
+    for (uint32_t field = 0; field < table.columns.size(); ++field) {
+        for (size_t i = 0; i < kept.size(); ++i) {
+            if (IsPresent(table.columns[field], kept[i])) {
+                AppendCardField(selected, table.columns[field].name, i,
+                                std::wstring(CardFieldValue(table, field, kept[i])));
+            }
+        }
+    }
+    return selected;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Optional per-card fields beyond id/question/answer ("hint:", "source:",
+// "notes:" ...), kept outside Card so that cards without them cost nothing.
+// Each field name is one sparse column: a presence bit per card index and
+// the values of the cards that have it, in card order.
+struct CardFieldColumn {
+    std::wstring name{};
+    std::vector<uint64_t> present{};
+    // Values set before each word of present, so a lookup is one popcount.
+    std::vector<uint32_t> rank{};
+    std::vector<std::wstring> values{};
+};
+
+struct CardFieldTable {
+    std::vector<CardFieldColumn> columns{};
+};
+
+constexpr uint32_t MISSING_CARD_FIELD = UINT32_MAX;
+
+// Name/value pairs of one card's extra fields, in the order they were read.
+using CardFieldList = std::vector<std::pair<std::wstring, std::wstring>>;
+
+// Resolves name to a field id once, for CardFieldValue to use per card.
+uint32_t FindCardField(const CardFieldTable& table, std::wstring_view name);
+
+// The field's value for card index, or empty when the card does not set it.
+std::wstring_view CardFieldValue(const CardFieldTable& table, uint32_t field, size_t card);
+
+// Sets name for card index. Within a column cards must be added in
+// increasing index order, as loaders do.
+void AppendCardField(CardFieldTable& table, std::wstring_view name, size_t card,
+                     std::wstring value);
+
+// Drops the column name, if any, so that it can be appended afresh.
+void RemoveCardField(CardFieldTable& table, std::wstring_view name);
+
+// The fields of cards kept[0], kept[1], ... renumbered 0, 1, ...
+CardFieldTable SelectCardFields(const CardFieldTable& table, const std::vector<size_t>& kept);
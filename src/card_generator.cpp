@@ -0,0 +1,361 @@
+#include "card_generator.h"
+
+#include <climits>
+#include <cwctype>
+
+#include "deck.h"
+
+namespace {
+// Generators with more cards are refused. Migrating a log expands every
+// generated card, and review item indices must fit in size_t.
+constexpr size_t MAX_GENERATOR_CARDS = size_t{1} << 24;
+
+// Values param takes, or MAX_GENERATOR_CARDS + 1 for any more than the cap.
+size_t ParamSize(const GeneratorParam& param) {
+    if (!param.values.empty()) {
+        return param.values.size();
+    }
+    if (param.last < param.first) {
+        return 0;
+    }
+    // Unsigned, since last - first can exceed LLONG_MAX.
+    const unsigned long long span = static_cast<unsigned long long>(param.last) -
+                                    static_cast<unsigned long long>(param.first);
+    return span < MAX_GENERATOR_CARDS ? static_cast<size_t>(span) + 1 : MAX_GENERATOR_CARDS + 1;
+}
+
+std::wstring_view TrimView(std::wstring_view text) {
+    const auto first = text.find_first_not_of(L" \t");
+    if (first == std::wstring_view::npos) {
+        return {};
+    }
+    const auto last = text.find_last_not_of(L" \t");
+    return text.substr(first, last - first + 1);
+}
+
+bool ParseInteger(std::wstring_view text, long long& value) {
+    text = TrimView(text);
+    if (text.empty()) {
+        return false;
+    }
+
+    size_t i = 0;
+    const bool negative = text[0] == L'-';
+    if (negative || text[0] == L'+') {
+        ++i;
+    }
+    if (i == text.size()) {
+        return false;
+    }
+
+    long long result = 0;
+    for (; i < text.size(); ++i) {
+        if (!std::iswdigit(text[i])) {
+            return false;
+        }
+        const int digit = text[i] - L'0';
+        if (result > (LLONG_MAX - digit) / 10) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    value = negative ? -result : result;
+    return true;
+}
+
+bool ParseParams(std::wstring_view text, std::vector<GeneratorParam>& params) {
+    while (!TrimView(text).empty()) {
+        const size_t comma = text.find(L',');
+        const std::wstring_view item = text.substr(0, comma);
+        text = comma == std::wstring_view::npos ? std::wstring_view{} : text.substr(comma + 1);
+
+        const size_t equals = item.find(L'=');
+        if (equals == std::wstring_view::npos) {
+            return false;
+        }
+
+        GeneratorParam param{};
+        param.name = TrimView(item.substr(0, equals));
+        const std::wstring_view domain = TrimView(item.substr(equals + 1));
+        const size_t range = domain.find(L"..");
+        if (range != std::wstring_view::npos) {
+            if (!ParseInteger(domain.substr(0, range), param.first) ||
+                !ParseInteger(domain.substr(range + 2), param.last) || param.last < param.first) {
+                return false;
+            }
+        } else {
+            std::wstring_view rest = domain;
+            while (true) {
+                const size_t bar = rest.find(L'|');
+                param.values.emplace_back(TrimView(rest.substr(0, bar)));
+                if (bar == std::wstring_view::npos) {
+                    break;
+                }
+                rest = rest.substr(bar + 1);
+            }
+        }
+
+        if (param.name.empty()) {
+            return false;
+        }
+        params.push_back(std::move(param));
+    }
+    return !params.empty();
+}
+
+bool ParseOperand(std::wstring_view text, const std::vector<GeneratorParam>& params,
+                  GeneratorOperand& operand) {
+    text = TrimView(text);
+    for (size_t i = 0; i < params.size(); ++i) {
+        if (params[i].name == text) {
+            operand.isParam = true;
+            operand.param = i;
+            return true;
+        }
+    }
+    return ParseInteger(text, operand.value);
+}
+
+bool CompileTemplate(std::wstring_view text, const std::vector<GeneratorParam>& params,
+                     std::vector<GeneratorPart>& parts) {
+    while (!text.empty()) {
+        const size_t open = text.find(L'{');
+        if (open != 0) {
+            GeneratorPart literal{};
+            literal.text = text.substr(0, open);
+            parts.push_back(std::move(literal));
+            if (open == std::wstring_view::npos) {
+                break;
+            }
+        }
+
+        const size_t close = text.find(L'}', open);
+        if (close == std::wstring_view::npos) {
+            return false;
+        }
+
+        const std::wstring_view inner = text.substr(open + 1, close - open - 1);
+        text = text.substr(close + 1);
+
+        GeneratorPart part{};
+        // Skip a leading sign so "{-1+a}" is not split at the minus.
+        const size_t op = inner.find_first_of(L"+-*/%", inner.find_first_not_of(L" \t-+"));
+        if (op == std::wstring_view::npos) {
+            part.kind = GeneratorPart::Kind::Param;
+            if (!ParseOperand(inner, params, part.lhs) || !part.lhs.isParam) {
+                return false;
+            }
+        } else {
+            part.kind = GeneratorPart::Kind::Expression;
+            part.op = inner[op];
+            if (!ParseOperand(inner.substr(0, op), params, part.lhs) ||
+                !ParseOperand(inner.substr(op + 1), params, part.rhs)) {
+                return false;
+            }
+        }
+        parts.push_back(std::move(part));
+    }
+    return true;
+}
+
+const std::wstring* ListValue(const CardGenerator& generator, const std::vector<size_t>& digits,
+                              size_t param) {
+    const GeneratorParam& definition = generator.params[param];
+    return definition.values.empty() ? nullptr : &definition.values[digits[param]];
+}
+
+bool OperandValue(const CardGenerator& generator, const std::vector<size_t>& digits,
+                  const GeneratorOperand& operand, long long& value) {
+    if (!operand.isParam) {
+        value = operand.value;
+        return true;
+    }
+
+    const GeneratorParam& param = generator.params[operand.param];
+    if (param.values.empty()) {
+        value = param.first + static_cast<long long>(digits[operand.param]);
+        return true;
+    }
+    return ParseInteger(param.values[digits[operand.param]], value);
+}
+
+// lhs op rhs for +, - and *, or false when the result does not fit a long
+// long. Works on magnitudes in unsigned arithmetic, so it never overflows
+// itself.
+bool CheckedArithmetic(wchar_t op, long long lhs, long long rhs, long long& result) {
+    const auto magnitude = [](long long value) {
+        return value < 0 ? 0ULL - static_cast<unsigned long long>(value)
+                         : static_cast<unsigned long long>(value);
+    };
+    if (op == L'-') {
+        if (rhs == LLONG_MIN) {
+            // -rhs does not fit; lhs - LLONG_MIN fits only for negative lhs.
+            if (lhs >= 0) {
+                return false;
+            }
+            result = lhs + LLONG_MAX + 1;
+            return true;
+        }
+        rhs = -rhs;
+    }
+
+    const unsigned long long lhsMagnitude = magnitude(lhs);
+    const unsigned long long rhsMagnitude = magnitude(rhs);
+    unsigned long long resultMagnitude = 0;
+    bool negative = false;
+    if (op == L'*') {
+        if (lhsMagnitude != 0 && rhsMagnitude > ULLONG_MAX / lhsMagnitude) {
+            return false;
+        }
+        resultMagnitude = lhsMagnitude * rhsMagnitude;
+        negative = (lhs < 0) != (rhs < 0);
+    } else if ((lhs < 0) == (rhs < 0)) {
+        if (rhsMagnitude > ULLONG_MAX - lhsMagnitude) {
+            return false;
+        }
+        resultMagnitude = lhsMagnitude + rhsMagnitude;
+        negative = lhs < 0;
+    } else {
+        negative = lhsMagnitude > rhsMagnitude ? lhs < 0 : rhs < 0;
+        resultMagnitude = negative == (lhs < 0) ? lhsMagnitude - rhsMagnitude
+                                                : rhsMagnitude - lhsMagnitude;
+    }
+
+    const unsigned long long limit =
+        static_cast<unsigned long long>(LLONG_MAX) + (negative ? 1 : 0);
+    if (resultMagnitude > limit) {
+        return false;
+    }
+    result = negative ? static_cast<long long>(0ULL - resultMagnitude)
+                      : static_cast<long long>(resultMagnitude);
+    return true;
+}
+
+void AppendExpression(const CardGenerator& generator, const std::vector<size_t>& digits,
+                      const GeneratorPart& part, std::wstring& out) {
+    long long lhs = 0;
+    long long rhs = 0;
+    if (!OperandValue(generator, digits, part.lhs, lhs) ||
+        !OperandValue(generator, digits, part.rhs, rhs)) {
+        out += L'?';
+        return;
+    }
+
+    long long result = 0;
+    switch (part.op) {
+    case L'+':
+    case L'-':
+    case L'*':
+        if (CheckedArithmetic(part.op, lhs, rhs, result)) {
+            out += std::to_wstring(result);
+        } else {
+            out += L'?';
+        }
+        return;
+    case L'%':
+        // LLONG_MIN % -1 is undefined behaviour in C++, though the remainder is 0.
+        out += rhs == 0    ? std::wstring(L"undefined")
+               : rhs == -1 ? std::wstring(L"0")
+                           : std::to_wstring(lhs % rhs);
+        return;
+    case L'/':
+        break;
+    default:
+        out += L'?';
+        return;
+    }
+
+    if (rhs == 0) {
+        out += L"undefined";
+    } else if (lhs == LLONG_MIN && rhs == -1) {
+        // The quotient, 2^63, does not fit a long long.
+        out += L'?';
+    } else if (lhs % rhs == 0) {
+        out += std::to_wstring(lhs / rhs);
+    } else {
+        std::wstring decimal = std::to_wstring(static_cast<double>(lhs) / rhs);
+        decimal.erase(decimal.find_last_not_of(L'0') + 1);
+        if (decimal.back() == L'.') {
+            decimal.pop_back();
+        }
+        out += decimal;
+    }
+}
+
+void Render(const CardGenerator& generator, const std::vector<size_t>& digits,
+            const std::vector<GeneratorPart>& parts, std::wstring& out) {
+    out.clear();
+    for (const GeneratorPart& part : parts) {
+        switch (part.kind) {
+        case GeneratorPart::Kind::Text:
+            out += part.text;
+            break;
+        case GeneratorPart::Kind::Param:
+            if (const std::wstring* value = ListValue(generator, digits, part.lhs.param)) {
+                out += *value;
+            } else {
+                out += std::to_wstring(generator.params[part.lhs.param].first +
+                                       static_cast<long long>(digits[part.lhs.param]));
+            }
+            break;
+        case GeneratorPart::Kind::Expression:
+            AppendExpression(generator, digits, part, out);
+            break;
+        }
+    }
+}
+}
+
+bool CompileGenerator(const std::wstring& id, std::wstring_view params,
+                      std::wstring_view question, std::wstring_view answer,
+                      CardGenerator& generator) {
+    generator = CardGenerator{};
+    generator.id = id;
+    if (id.empty() || !ParseParams(params, generator.params) ||
+        !CompileTemplate(question, generator.params, generator.question) ||
+        !CompileTemplate(answer, generator.params, generator.answer) ||
+        generator.question.empty() || generator.answer.empty()) {
+        return false;
+    }
+
+    generator.cardCount = 1;
+    for (const GeneratorParam& param : generator.params) {
+        const size_t size = ParamSize(param);
+        if (size == 0 || size > MAX_GENERATOR_CARDS / generator.cardCount) {
+            generator.cardCount = 0;
+            return false;
+        }
+        generator.cardCount *= size;
+    }
+    return true;
+}
+
+void GenerateCard(const CardGenerator& generator, size_t ordinal, Card& card) {
+    // Mixed-radix decomposition with the last parameter varying fastest.
+    std::vector<size_t> digits(generator.params.size());
+    for (size_t i = generator.params.size(); i-- > 0;) {
+        const size_t size = ParamSize(generator.params[i]);
+        digits[i] = ordinal % size;
+        ordinal /= size;
+    }
+
+    card.id = generator.id;
+    for (size_t i = 0; i < generator.params.size(); ++i) {
+        card.id += L'/';
+        if (const std::wstring* value = ListValue(generator, digits, i)) {
+            card.id += *value;
+        } else {
+            card.id +=
+                std::to_wstring(generator.params[i].first + static_cast<long long>(digits[i]));
+        }
+    }
+
+    Render(generator, digits, generator.question, card.question);
+    Render(generator, digits, generator.answer, card.answer);
+    card.source = CardSource::Generated;
+    card.reverse = generator.reverse;
+}
+
+size_t GeneratorItemCount(const CardGenerator& generator) {
+    return generator.reverse ? 2 * generator.cardCount : generator.cardCount;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct Card;
+
+// One axis of a generator's parameter space: an inclusive integer range
+// (a=1..12) or a list of values (unit=km|mi).
+struct GeneratorParam {
+    std::wstring name;
+    long long first{0};
+    long long last{0};
+    std::vector<std::wstring> values{};
+};
+
+// A piece of a question/answer template: literal text, {param} or
+// {lhs op rhs} where each operand is a parameter or an integer.
+struct GeneratorOperand {
+    bool isParam{false};
+    size_t param{0};
+    long long value{0};
+};
+
+struct GeneratorPart {
+    enum class Kind { Text, Param, Expression } kind{Kind::Text};
+    std::wstring text{};
+    GeneratorOperand lhs{};
+    wchar_t op{0};
+    GeneratorOperand rhs{};
+};
+
+// Produces cards on demand from the cross product of its parameters, so a
+// generated card costs nothing until it is shown.
+struct CardGenerator {
+    std::wstring id;
+    std::vector<GeneratorParam> params;
+    std::vector<GeneratorPart> question;
+    std::vector<GeneratorPart> answer;
+    size_t cardCount{0};
+    bool reverse{false};
+};
+
+// Builds a generator from its deck fields; returns false if the parameter
+// list or a template does not parse, or the generator would have more than
+// 2^24 cards.
+bool CompileGenerator(const std::wstring& id, std::wstring_view params,
+                      std::wstring_view question, std::wstring_view answer,
+                      CardGenerator& generator);
+
+// Fills card with generated card number ordinal (0 <= ordinal < cardCount).
+// Its id is "<generator id>/<value>/<value>..." so it is stable across runs.
+void GenerateCard(const CardGenerator& generator, size_t ordinal, Card& card);
+
+// Review items the generator contributes: cardCount, or twice that with reverse.
+size_t GeneratorItemCount(const CardGenerator& generator);
@@ -0,0 +1,88 @@
+#include "card_template.h"
+
+#include <utility>
+
+namespace {
+std::wstring_view TrimTag(std::wstring_view text) {
+    const auto first = text.find_first_not_of(L" \t");
+    if (first == std::wstring_view::npos) {
+        return {};
+    }
+    const auto last = text.find_last_not_of(L" \t");
+    return text.substr(first, last - first + 1);
+}
+
+void AppendText(CompiledTemplate& compiled, std::wstring_view text) {
+    if (text.empty()) {
+        return;
+    }
+
+    const uint32_t offset = static_cast<uint32_t>(compiled.literals.size());
+    compiled.literals.append(text);
+    compiled.ops.push_back({TemplateOp::Code::Text, offset, static_cast<uint32_t>(text.size())});
+}
+}
+
+uint32_t BuiltinTemplateField(std::wstring_view name) {
+    if (name == L"front") {
+        return TEMPLATE_FIELD_FRONT;
+    }
+    if (name == L"back") {
+        return TEMPLATE_FIELD_BACK;
+    }
+    if (name == L"id") {
+        return TEMPLATE_FIELD_ID;
+    }
+    if (name == L"question") {
+        return TEMPLATE_FIELD_QUESTION;
+    }
+    if (name == L"answer") {
+        return TEMPLATE_FIELD_ANSWER;
+    }
+    return MISSING_TEMPLATE_FIELD;
+}
+
+bool CompileCardTemplate(std::wstring_view source,
+                         const std::function<uint32_t(std::wstring_view)>& resolveField,
+                         CompiledTemplate& compiled) {
+    compiled = CompiledTemplate{};
+    // Open sections as (op index of the jump, section name).
+    std::vector<std::pair<size_t, std::wstring_view>> sections;
+
+    while (!source.empty()) {
+        const size_t open = source.find(L"{{");
+        AppendText(compiled, source.substr(0, open));
+        if (open == std::wstring_view::npos) {
+            break;
+        }
+
+        const size_t close = source.find(L"}}", open + 2);
+        if (close == std::wstring_view::npos) {
+            return false;
+        }
+
+        const std::wstring_view tag = TrimTag(source.substr(open + 2, close - open - 2));
+        source = source.substr(close + 2);
+        if (tag.empty()) {
+            return false;
+        }
+
+        const wchar_t sigil = tag[0];
+        const std::wstring_view name = TrimTag(tag.substr(1));
+        if (sigil == L'#' || sigil == L'^') {
+            const auto code =
+                sigil == L'#' ? TemplateOp::Code::JumpIfEmpty : TemplateOp::Code::JumpIfPresent;
+            sections.emplace_back(compiled.ops.size(), name);
+            compiled.ops.push_back({code, 0, resolveField(name)});
+        } else if (sigil == L'/') {
+            if (sections.empty() || sections.back().second != name) {
+                return false;
+            }
+            compiled.ops[sections.back().first].a = static_cast<uint32_t>(compiled.ops.size());
+            sections.pop_back();
+        } else {
+            compiled.ops.push_back({TemplateOp::Code::Field, resolveField(tag), 0});
+        }
+    }
+    return sections.empty();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Field ids understood by every deck. Names that resolve to nothing compile
+// to MISSING_TEMPLATE_FIELD and render as empty.
+enum TemplateField : uint32_t {
+    TEMPLATE_FIELD_FRONT,     // prompt for the item being reviewed
+    TEMPLATE_FIELD_BACK,      // response for the item being reviewed
+    TEMPLATE_FIELD_ID,
+    TEMPLATE_FIELD_QUESTION,  // stored question, regardless of direction
+    TEMPLATE_FIELD_ANSWER,    // stored answer, regardless of direction
+    TEMPLATE_BUILTIN_FIELD_COUNT,
+};
+
+constexpr uint32_t MISSING_TEMPLATE_FIELD = UINT32_MAX;
+
+struct TemplateOp {
+    enum class Code : uint8_t {
+        Text,           // append literals[a, a + b)
+        Field,          // append field a
+        JumpIfEmpty,    // {{#b}}: continue at op a when field b is empty
+        JumpIfPresent,  // {{^b}}: continue at op a when field b is not empty
+    } code;
+    uint32_t a;
+    uint32_t b;
+};
+
+// "{{front}} ({{hint}})" style template compiled to a flat op list with
+// field names already resolved to ids.
+struct CompiledTemplate {
+    std::vector<TemplateOp> ops{};
+    std::wstring literals{};
+};
+
+uint32_t BuiltinTemplateField(std::wstring_view name);
+
+// Compiles {{field}}, {{#field}}...{{/field}} and {{^field}}...{{/field}}.
+// resolveField maps a field name to its id. Returns false on unbalanced
+// or malformed tags.
+bool CompileCardTemplate(std::wstring_view source,
+                         const std::function<uint32_t(std::wstring_view)>& resolveField,
+                         CompiledTemplate& compiled);
+
+// Appends the rendering to out after clearing it, so a buffer reused across
+// renders stops allocating once it has grown to the longest output.
+template <typename FieldLookup>
+void RenderCardTemplate(const CompiledTemplate& compiled, const FieldLookup& field,
+                        std::wstring& out) {
+    out.clear();
+    const size_t count = compiled.ops.size();
+    for (size_t i = 0; i < count; ++i) {
+        const TemplateOp& op = compiled.ops[i];
+        switch (op.code) {
+        case TemplateOp::Code::Text:
+            out.append(compiled.literals, op.a, op.b);
+            break;
+        case TemplateOp::Code::Field:
+            if (op.a != MISSING_TEMPLATE_FIELD) {
+                out.append(field(op.a));
+            }
+            break;
+        case TemplateOp::Code::JumpIfEmpty:
+            if (op.b == MISSING_TEMPLATE_FIELD || field(op.b).empty()) {
+                i = op.a - 1;
+            }
+            break;
+        case TemplateOp::Code::JumpIfPresent:
+            if (op.b != MISSING_TEMPLATE_FIELD && !field(op.b).empty()) {
+                i = op.a - 1;
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,240 @@
+#include "checksum.h"
+
+#include <array>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define QATRAINER_CRC32C_X64 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define QATRAINER_TARGET_SSE42
+#else
+#include <cpuid.h>
+#define QATRAINER_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+namespace {
+constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F63B78u;
+
+constexpr uint64_t XXH64_PRIME1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t XXH64_PRIME2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t XXH64_PRIME3 = 0x165667B19E3779F9ull;
+constexpr uint64_t XXH64_PRIME4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t XXH64_PRIME5 = 0x27D4EB2F165667C5ull;
+
+using Crc32cTables = std::array<std::array<uint32_t, 256>, 8>;
+
+const Crc32cTables& SoftwareTables() {
+    static const Crc32cTables tables = [] {
+        Crc32cTables built{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ ((crc & 1u) != 0 ? CRC32C_POLYNOMIAL : 0);
+            }
+            built[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (size_t slice = 1; slice < 8; ++slice) {
+                const uint32_t previous = built[slice - 1][i];
+                built[slice][i] = (previous >> 8) ^ built[0][previous & 0xFFu];
+            }
+        }
+        return built;
+    }();
+    return tables;
+}
+
+uint32_t SoftwareCrc32c(const unsigned char* data, size_t size, uint32_t crc) {
+    const Crc32cTables& tables = SoftwareTables();
+    while (size >= 8) {
+        uint32_t low = 0;
+        uint32_t high = 0;
+        std::memcpy(&low, data, 4);
+        std::memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^
+              tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24] ^
+              tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^
+              tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *data++) & 0xFFu];
+    }
+    return crc;
+}
+
+#if defined(QATRAINER_CRC32C_X64)
+QATRAINER_TARGET_SSE42 uint32_t HardwareCrc32c(const unsigned char* data, size_t size,
+                                               uint32_t crc) {
+    uint64_t crc64 = crc;
+    while (size >= 8) {
+        uint64_t word = 0;
+        std::memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (size-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+bool DetectSse42() {
+#if defined(_MSC_VER)
+    int registers[4] = {};
+    __cpuid(registers, 1);
+    return (registers[2] & (1 << 20)) != 0;
+#else
+    unsigned eax = 0;
+    unsigned ebx = 0;
+    unsigned ecx = 0;
+    unsigned edx = 0;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) != 0 && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+#endif
+}
+
+bool HasHardwareCrc32c() {
+#if defined(QATRAINER_CRC32C_X64)
+    static const bool supported = DetectSse42();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+uint32_t Crc32c(std::string_view data, uint32_t crc) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    crc = ~crc;
+#if defined(QATRAINER_CRC32C_X64)
+    if (HasHardwareCrc32c()) {
+        return ~HardwareCrc32c(bytes, data.size(), crc);
+    }
+#endif
+    return ~SoftwareCrc32c(bytes, data.size(), crc);
+}
+
+namespace {
+// Product of two polynomials modulo the CRC32C polynomial, bit-reflected.
+uint32_t MultiplyModPolynomial(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t bit = 1u << 31; bit != 0; bit >>= 1) {
+        if ((a & bit) != 0) {
+            product ^= b;
+        }
+        b = (b & 1u) != 0 ? (b >> 1) ^ CRC32C_POLYNOMIAL : b >> 1;
+    }
+    return product;
+}
+
+// x^(8 * bytes) modulo the polynomial: appending that many zero bytes to a
+// message multiplies its raw CRC by this.
+uint32_t ZeroBytesOperator(uint64_t bytes) {
+    // x^(2^k) for k = 0..63, squared up from x^1.
+    static const std::array<uint32_t, 64> powers = [] {
+        std::array<uint32_t, 64> built{};
+        built[0] = 1u << 30;
+        for (size_t k = 1; k < built.size(); ++k) {
+            built[k] = MultiplyModPolynomial(built[k - 1], built[k - 1]);
+        }
+        return built;
+    }();
+
+    uint32_t result = 1u << 31;
+    for (size_t k = 3; bytes != 0; bytes >>= 1, ++k) {
+        if ((bytes & 1u) != 0) {
+            result = MultiplyModPolynomial(powers[k % powers.size()], result);
+        }
+    }
+    return result;
+}
+
+uint64_t RotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t Read64(const unsigned char* data) {
+    uint64_t value = 0;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint64_t Xxh64Round(uint64_t accumulator, uint64_t input) {
+    accumulator += input * XXH64_PRIME2;
+    return RotateLeft(accumulator, 31) * XXH64_PRIME1;
+}
+
+uint64_t Xxh64Merge(uint64_t hash, uint64_t accumulator) {
+    hash ^= Xxh64Round(0, accumulator);
+    return hash * XXH64_PRIME1 + XXH64_PRIME4;
+}
+}
+
+uint32_t Crc32cReplace(uint32_t crc, uint64_t size, uint64_t offset, std::string_view before,
+                       std::string_view after) {
+    // CRC is linear: for equal-length messages crc(a) ^ crc(b) is the raw
+    // (no pre/post inversion) CRC of a ^ b. Leading zeros leave a raw CRC
+    // unchanged and trailing zeros multiply it by a power of x.
+    std::string difference(before.size(), '\0');
+    for (size_t i = 0; i < before.size(); ++i) {
+        difference[i] = static_cast<char>(before[i] ^ after[i]);
+    }
+    const uint32_t rawDifference = ~Crc32c(difference, 0xFFFFFFFFu);
+    const uint64_t trailing = size - offset - before.size();
+    return crc ^ MultiplyModPolynomial(ZeroBytesOperator(trailing), rawDifference);
+}
+
+uint64_t Xxh64(std::string_view data, uint64_t seed) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    const unsigned char* const end = bytes + data.size();
+    uint64_t hash = 0;
+    if (data.size() >= 32) {
+        uint64_t lanes[4] = {seed + XXH64_PRIME1 + XXH64_PRIME2, seed + XXH64_PRIME2, seed,
+                             seed - XXH64_PRIME1};
+        for (; end - bytes >= 32; bytes += 32) {
+            for (size_t lane = 0; lane < 4; ++lane) {
+                lanes[lane] = Xxh64Round(lanes[lane], Read64(bytes + 8 * lane));
+            }
+        }
+        hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) +
+               RotateLeft(lanes[3], 18);
+        for (const uint64_t lane : lanes) {
+            hash = Xxh64Merge(hash, lane);
+        }
+    } else {
+        hash = seed + XXH64_PRIME5;
+    }
+    hash += data.size();
+
+    for (; end - bytes >= 8; bytes += 8) {
+        hash ^= Xxh64Round(0, Read64(bytes));
+        hash = RotateLeft(hash, 27) * XXH64_PRIME1 + XXH64_PRIME4;
+    }
+    if (end - bytes >= 4) {
+        uint32_t word = 0;
+        std::memcpy(&word, bytes, sizeof(word));
+        hash ^= uint64_t{word} * XXH64_PRIME1;
+        hash = RotateLeft(hash, 23) * XXH64_PRIME2 + XXH64_PRIME3;
+        bytes += 4;
+    }
+    for (; bytes < end; ++bytes) {
+        hash ^= *bytes * XXH64_PRIME5;
+        hash = RotateLeft(hash, 11) * XXH64_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH64_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH64_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// CRC32C (Castagnoli) of data, continuing from crc; pass 0 to start. Uses
+// the SSE4.2 crc32 instruction when the CPU has it and slice-by-8 tables
+// otherwise; both give the same result.
+uint32_t Crc32c(std::string_view data, uint32_t crc);
+
+// True when Crc32c runs on the hardware instruction.
+bool HasHardwareCrc32c();
+
+// CRC32C of a size-byte buffer whose checksum was crc, after the bytes at
+// offset changed from before to after (same length). Costs O(log size)
+// rather than a pass over the buffer.
+uint32_t Crc32cReplace(uint32_t crc, uint64_t size, uint64_t offset, std::string_view before,
+                       std::string_view after);
+
+// XXH64 of data.
+uint64_t Xxh64(std::string_view data, uint64_t seed);
@@ -0,0 +1,106 @@
+#include "cloze.h"
+
+#include <algorithm>
+
+namespace {
+constexpr wchar_t GAP_OPEN[] = L"{{c";
+constexpr wchar_t GAP_SEPARATOR[] = L"::";
+constexpr wchar_t GAP_CLOSE[] = L"}}";
+
+void AppendSpan(std::wstring_view text, uint32_t begin, uint32_t end, std::wstring& out) {
+    out.append(text.substr(begin, end - begin));
+}
+
+template <typename AppendGap>
+void Render(std::wstring_view text, const std::vector<ClozeGap>& gaps, std::wstring& out,
+            AppendGap appendGap) {
+    out.clear();
+    uint32_t position = 0;
+    for (const ClozeGap& gap : gaps) {
+        AppendSpan(text, position, gap.begin, out);
+        appendGap(gap);
+        position = gap.end;
+    }
+    out.append(text.substr(position));
+}
+}
+
+void ParseClozeGaps(std::wstring_view text, std::vector<ClozeGap>& gaps) {
+    gaps.clear();
+    size_t position = text.find(GAP_OPEN);
+    while (position != std::wstring_view::npos) {
+        size_t cursor = position + 3;
+        uint32_t number = 0;
+        while (cursor < text.size() && text[cursor] >= L'0' && text[cursor] <= L'9' &&
+               number < 10000) {
+            number = number * 10 + static_cast<uint32_t>(text[cursor] - L'0');
+            ++cursor;
+        }
+
+        const size_t close = text.find(GAP_CLOSE, cursor);
+        // Numbers that do not fit a gap number make the gap malformed.
+        if (number == 0 || number > UINT16_MAX || text.compare(cursor, 2, GAP_SEPARATOR) != 0 ||
+            close == std::wstring_view::npos) {
+            position = text.find(GAP_OPEN, position + 1);
+            continue;
+        }
+
+        ClozeGap gap{};
+        gap.begin = static_cast<uint32_t>(position);
+        gap.end = static_cast<uint32_t>(close + 2);
+        gap.contentBegin = static_cast<uint32_t>(cursor + 2);
+        const size_t hint = text.find(GAP_SEPARATOR, gap.contentBegin);
+        if (hint != std::wstring_view::npos && hint < close) {
+            gap.contentEnd = static_cast<uint32_t>(hint);
+            gap.hintBegin = static_cast<uint32_t>(hint + 2);
+        } else {
+            gap.contentEnd = static_cast<uint32_t>(close);
+            gap.hintBegin = gap.contentEnd;
+        }
+        gap.number = static_cast<uint16_t>(number);
+        gaps.push_back(gap);
+
+        position = text.find(GAP_OPEN, close + 2);
+    }
+}
+
+std::vector<uint16_t> ClozeNumbers(const std::vector<ClozeGap>& gaps) {
+    std::vector<uint16_t> numbers;
+    for (const ClozeGap& gap : gaps) {
+        numbers.push_back(gap.number);
+    }
+    std::sort(numbers.begin(), numbers.end());
+    numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+    return numbers;
+}
+
+void RenderClozeQuestion(std::wstring_view text, const std::vector<ClozeGap>& gaps,
+                         uint16_t number, std::wstring& out) {
+    Render(text, gaps, out, [&](const ClozeGap& gap) {
+        if (gap.number != number) {
+            AppendSpan(text, gap.contentBegin, gap.contentEnd, out);
+            return;
+        }
+
+        out += L'[';
+        if (gap.hintBegin != gap.contentEnd) {
+            AppendSpan(text, gap.hintBegin, gap.end - 2, out);
+        } else {
+            out += L"...";
+        }
+        out += L']';
+    });
+}
+
+void RenderClozeAnswer(std::wstring_view text, const std::vector<ClozeGap>& gaps,
+                       uint16_t number, std::wstring& out) {
+    Render(text, gaps, out, [&](const ClozeGap& gap) {
+        if (gap.number == number) {
+            out += L'[';
+        }
+        AppendSpan(text, gap.contentBegin, gap.contentEnd, out);
+        if (gap.number == number) {
+            out += L']';
+        }
+    });
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Span of one {{cN::content}} or {{cN::content::hint}} marker inside a
+// card's text. Only offsets are kept; the text itself is never duplicated.
+struct ClozeGap {
+    uint32_t begin;
+    uint32_t end;
+    uint32_t contentBegin;
+    uint32_t contentEnd;
+    // Equal to contentEnd when the marker has no hint.
+    uint32_t hintBegin;
+    uint16_t number;
+};
+
+// Replaces gaps with the markers found in text, in order of appearance.
+void ParseClozeGaps(std::wstring_view text, std::vector<ClozeGap>& gaps);
+
+// Distinct gap numbers in ascending order; each becomes one review item.
+std::vector<uint16_t> ClozeNumbers(const std::vector<ClozeGap>& gaps);
+
+// Renders text with the gaps numbered `number` hidden ("[...]" or "[hint]")
+// and all other gaps filled in. out is cleared first and can be reused.
+void RenderClozeQuestion(std::wstring_view text, const std::vector<ClozeGap>& gaps,
+                         uint16_t number, std::wstring& out);
+
+// Renders text with every gap filled in and gap `number` bracketed.
+void RenderClozeAnswer(std::wstring_view text, const std::vector<ClozeGap>& gaps,
+                       uint16_t number, std::wstring& out);
@@ -0,0 +1,1087 @@
+#include "deck.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+#include "binary_deck.h"
+#include "checksum.h"
+#include "deck_jsonl.h"
+#include "mapped_file.h"
+
+std::wstring ToWide(std::string_view text) {
+    // UTF-16 on Windows; wider wchar_t gets code points. Malformed input
+    // becomes U+FFFD rather than failing the whole deck.
+    std::wstring wide(text.size(), L'\0');
+    size_t out = 0;
+    size_t i = 0;
+    while (i < text.size()) {
+        const auto lead = static_cast<unsigned char>(text[i]);
+        if (lead < 0x80) {
+            wide[out++] = static_cast<wchar_t>(lead);
+            ++i;
+            continue;
+        }
+
+        const size_t length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+        uint32_t codePoint = length == 4 ? lead & 0x07u : length == 3 ? lead & 0x0Fu : lead & 0x1Fu;
+        bool valid = length != 0 && i + length <= text.size();
+        for (size_t k = 1; valid && k < length; ++k) {
+            const auto next = static_cast<unsigned char>(text[i + k]);
+            valid = (next & 0xC0u) == 0x80u;
+            codePoint = (codePoint << 6) | (next & 0x3Fu);
+        }
+        if (!valid || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+            wide[out++] = static_cast<wchar_t>(0xFFFD);
+            ++i;
+            continue;
+        }
+        i += length;
+
+        if (sizeof(wchar_t) == 2 && codePoint > 0xFFFF) {
+            codePoint -= 0x10000;
+            wide[out++] = static_cast<wchar_t>(0xD800 + (codePoint >> 10));
+            wide[out++] = static_cast<wchar_t>(0xDC00 + (codePoint & 0x3FFu));
+        } else {
+            wide[out++] = static_cast<wchar_t>(codePoint);
+        }
+    }
+    wide.resize(out);
+    return wide;
+}
+
+std::string ToUtf8(const std::wstring& text) {
+    // Narrow the leading ASCII run, usually all of it, without per-byte appends.
+    size_t ascii = 0;
+    while (ascii < text.size() && static_cast<uint32_t>(text[ascii]) < 0x80) {
+        ++ascii;
+    }
+    std::string utf8(ascii, '\0');
+    for (size_t i = 0; i < ascii; ++i) {
+        utf8[i] = static_cast<char>(text[i]);
+    }
+    if (ascii == text.size()) {
+        return utf8;
+    }
+
+    utf8.reserve(text.size() + text.size() / 2);
+    for (size_t i = ascii; i < text.size(); ++i) {
+        auto codePoint = static_cast<uint32_t>(text[i]);
+        if (codePoint < 0x80) {
+            utf8 += static_cast<char>(codePoint);
+            continue;
+        }
+
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 1 < text.size() &&
+            static_cast<uint32_t>(text[i + 1]) >= 0xDC00 &&
+            static_cast<uint32_t>(text[i + 1]) <= 0xDFFF) {
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) +
+                        (static_cast<uint32_t>(text[++i]) - 0xDC00);
+        } else if ((codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF) {
+            codePoint = 0xFFFD;
+        }
+
+        if (codePoint < 0x800) {
+            utf8 += static_cast<char>(0xC0 | (codePoint >> 6));
+        } else if (codePoint < 0x10000) {
+            utf8 += static_cast<char>(0xE0 | (codePoint >> 12));
+            utf8 += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        } else {
+            utf8 += static_cast<char>(0xF0 | (codePoint >> 18));
+            utf8 += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+            utf8 += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        }
+        utf8 += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    return utf8;
+}
+
+std::wstring TrimWide(const std::wstring& text) {
+    const auto first = text.find_first_not_of(L" \t\r\n");
+    if (first == std::wstring::npos) {
+        return L"";
+    }
+
+    const auto last = text.find_last_not_of(L" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+std::string_view Trim(std::string_view text) {
+    const auto first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+
+    const auto last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+bool IsCardComplete(const Card& card) {
+    return !card.id.empty() && !card.question.empty() &&
+           (!card.answer.empty() || !card.clozeGaps.empty());
+}
+
+namespace {
+bool StartsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+// Returns the line starting at position and moves position past its newline.
+std::string_view NextLine(std::string_view text, size_t& position) {
+    const size_t end = text.find('\n', position);
+    const size_t lineEnd = end == std::string_view::npos ? text.size() : end;
+    const std::string_view line = text.substr(position, lineEnd - position);
+    position = end == std::string_view::npos ? text.size() : end + 1;
+    return line;
+}
+
+// One deck line with its "- " list marker (if any) removed. column is where
+// content starts, which block scalars need to find their indented body.
+struct YamlLine {
+    std::string_view content;
+    size_t column;
+    bool entryStart;
+};
+
+YamlLine ReadYamlLine(std::string_view text, size_t& position) {
+    const std::string_view line = NextLine(text, position);
+    YamlLine result{Trim(line), 0, false};
+    if (result.content.empty()) {
+        return result;
+    }
+
+    result.column = line.find_first_not_of(" \t");
+    if (result.content == "-" || StartsWith(result.content, "- ")) {
+        const std::string_view rest = line.substr(result.column + 1);
+        const size_t offset = rest.find_first_not_of(" \t");
+        result.column += 1 + (offset == std::string_view::npos ? 0 : offset);
+        result.content = Trim(rest);
+        result.entryStart = true;
+    }
+    return result;
+}
+
+bool IsSectionHeader(const YamlLine& line) {
+    return !line.entryStart && (line.content == "cards:" || line.content == "generators:" ||
+                                line.content == "templates:");
+}
+
+struct YamlField {
+    std::string_view key;
+    std::string_view value;
+    size_t column;
+};
+
+bool SplitYamlField(const YamlLine& line, YamlField& field) {
+    const size_t colon = line.content.find(':');
+    if (colon == std::string_view::npos || colon == 0 ||
+        (colon + 1 < line.content.size() && line.content[colon + 1] != ' ' &&
+         line.content[colon + 1] != '\t')) {
+        return false;
+    }
+    field = {Trim(line.content.substr(0, colon)), Trim(line.content.substr(colon + 1)),
+             line.column};
+    return true;
+}
+
+void AppendUtf8(uint32_t codePoint, std::string& out) {
+    if (codePoint < 0x80) {
+        out += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codePoint >> 12));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (codePoint >> 18));
+        out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+bool ParseHexDigits(std::string_view digits, uint32_t& value) {
+    value = 0;
+    for (const char digit : digits) {
+        value <<= 4;
+        if (digit >= '0' && digit <= '9') {
+            value |= static_cast<uint32_t>(digit - '0');
+        } else if (digit >= 'a' && digit <= 'f') {
+            value |= static_cast<uint32_t>(digit - 'a' + 10);
+        } else if (digit >= 'A' && digit <= 'F') {
+            value |= static_cast<uint32_t>(digit - 'A' + 10);
+        } else {
+            return false;
+        }
+    }
+    return !digits.empty();
+}
+
+std::wstring ReadDoubleQuoted(std::string_view value) {
+    size_t end = 1;
+    while (end < value.size() && value[end] != '"') {
+        end += value[end] == '\\' ? 2 : 1;
+    }
+    if (end >= value.size()) {
+        return ToWide(value);
+    }
+
+    const std::string_view inner = value.substr(1, end - 1);
+    if (inner.find('\\') == std::string_view::npos) {
+        return ToWide(inner);
+    }
+
+    std::string unescaped;
+    unescaped.reserve(inner.size());
+    for (size_t i = 0; i < inner.size(); ++i) {
+        if (inner[i] != '\\' || i + 1 == inner.size()) {
+            unescaped += inner[i];
+            continue;
+        }
+
+        const char escape = inner[++i];
+        size_t hexDigits = 0;
+        switch (escape) {
+        case 'n':
+            unescaped += '\n';
+            break;
+        case 't':
+            unescaped += '\t';
+            break;
+        case 'r':
+            unescaped += '\r';
+            break;
+        case '0':
+            unescaped += '\0';
+            break;
+        case 'x':
+            hexDigits = 2;
+            break;
+        case 'u':
+            hexDigits = 4;
+            break;
+        case 'U':
+            hexDigits = 8;
+            break;
+        default:
+            // \\, \", \/ and anything unknown stand for the character itself.
+            unescaped += escape;
+            break;
+        }
+
+        uint32_t codePoint = 0;
+        if (hexDigits != 0 && ParseHexDigits(inner.substr(i + 1, hexDigits), codePoint) &&
+            i + hexDigits < inner.size()) {
+            i += hexDigits;
+            // A UTF-16 surrogate pair written as two \u escapes is one code point.
+            uint32_t low = 0;
+            if (codePoint >= 0xD800 && codePoint <= 0xDBFF &&
+                inner.substr(i + 1, 2) == "\\u" && i + 6 < inner.size() &&
+                ParseHexDigits(inner.substr(i + 3, 4), low) && low >= 0xDC00 && low <= 0xDFFF) {
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                i += 6;
+            }
+            AppendUtf8(codePoint, unescaped);
+        } else if (hexDigits != 0) {
+            unescaped += escape;
+        }
+    }
+    return ToWide(unescaped);
+}
+
+std::wstring ReadSingleQuoted(std::string_view value) {
+    const size_t end = value.rfind('\'');
+    if (end == 0) {
+        return ToWide(value);
+    }
+
+    const std::string_view inner = value.substr(1, end - 1);
+    if (inner.find("''") == std::string_view::npos) {
+        return ToWide(inner);
+    }
+
+    std::string unescaped;
+    unescaped.reserve(inner.size());
+    for (size_t i = 0; i < inner.size(); ++i) {
+        unescaped += inner[i];
+        if (inner[i] == '\'' && i + 1 < inner.size() && inner[i + 1] == '\'') {
+            ++i;
+        }
+    }
+    return ToWide(unescaped);
+}
+
+// Reads the body of a | (literal) or > (folded) block scalar that follows a
+// field at column, leaving position on the first line after it.
+std::wstring ReadBlockScalar(std::string_view header, size_t column, std::string_view text,
+                             size_t& position) {
+    const bool folded = header[0] == '>';
+    char chomping = 'c';
+    size_t contentIndent = 0;
+    for (size_t i = 1; i < header.size() && header[i] != ' ' && header[i] != '#'; ++i) {
+        if (header[i] == '-' || header[i] == '+') {
+            chomping = header[i];
+        } else if (header[i] >= '1' && header[i] <= '9') {
+            contentIndent = column + static_cast<size_t>(header[i] - '0');
+        }
+    }
+
+    std::string block;
+    size_t blankRun = 0;
+    bool hasContent = false;
+    while (position < text.size()) {
+        const size_t lineStart = position;
+        std::string_view line = NextLine(text, position);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+
+        const size_t indent = line.find_first_not_of(' ');
+        if (indent == std::string_view::npos) {
+            ++blankRun;
+            continue;
+        }
+        if (indent <= column || (contentIndent != 0 && indent < contentIndent)) {
+            position = lineStart;
+            break;
+        }
+        if (contentIndent == 0) {
+            contentIndent = indent;
+        }
+
+        if (!hasContent || !folded) {
+            block.append(blankRun + (hasContent ? 1 : 0), '\n');
+        } else if (blankRun == 0) {
+            block += ' ';
+        } else {
+            block.append(blankRun, '\n');
+        }
+        block.append(line.substr(contentIndent));
+        blankRun = 0;
+        hasContent = true;
+    }
+
+    if (hasContent && chomping != '-') {
+        block += '\n';
+    }
+    if (chomping == '+') {
+        block.append(blankRun, '\n');
+    }
+    return ToWide(block);
+}
+
+// Where the quote closing a scalar quoted with quote would be in line,
+// searching from from; npos if the line does not close it.
+size_t FindClosingQuote(std::string_view line, size_t from, char quote) {
+    for (size_t i = from; i < line.size(); ++i) {
+        if (quote == '"' && line[i] == '\\') {
+            ++i;
+        } else if (line[i] == quote) {
+            if (quote == '"' || i + 1 == line.size() || line[i + 1] != '\'') {
+                return i;
+            }
+            ++i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// Joins a quoted value that its field's line leaves open with the lines up
+// to its closing quote, which must be indented past column. As in YAML, a
+// line break folds into a space, a run of empty lines into that many line
+// breaks, and a double-quoted line ending in an escaping backslash joins
+// the next without a space. Returns false, leaving position alone, when the
+// value closes on its own line or never closes.
+bool JoinQuotedLines(std::string_view value, size_t column, std::string_view text,
+                     size_t& position, std::string& joined) {
+    const char quote = value[0];
+    if (FindClosingQuote(value, 1, quote) != std::string_view::npos) {
+        return false;
+    }
+
+    joined.assign(value);
+    size_t next = position;
+    size_t blankRun = 0;
+    while (next < text.size()) {
+        const std::string_view line = NextLine(text, next);
+        const std::string_view content = Trim(line);
+        if (content.empty()) {
+            ++blankRun;
+            continue;
+        }
+        if (line.find_first_not_of(" \t") <= column) {
+            return false;
+        }
+
+        size_t backslashes = 0;
+        while (backslashes < joined.size() && joined[joined.size() - 1 - backslashes] == '\\') {
+            ++backslashes;
+        }
+        if (quote == '"' && backslashes % 2 == 1) {
+            joined.pop_back();
+        } else if (blankRun == 0) {
+            joined += ' ';
+        }
+        joined.append(blankRun, '\n');
+        joined += content;
+        blankRun = 0;
+        if (FindClosingQuote(content, 0, quote) != std::string_view::npos) {
+            position = next;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Decodes a field's value. Plain values, by far the most common, convert
+// straight from the mapped text; quoting and blocks take the slower paths.
+std::wstring ReadScalar(const YamlField& field, std::string_view text, size_t& position) {
+    if (field.value.empty()) {
+        return L"";
+    }
+
+    switch (field.value[0]) {
+    case '|':
+    case '>':
+        return ReadBlockScalar(field.value, field.column, text, position);
+    case '"':
+    case '\'': {
+        std::string joined;
+        const std::string_view quoted =
+            JoinQuotedLines(field.value, field.column, text, position, joined) ? joined
+                                                                               : field.value;
+        return quoted[0] == '"' ? ReadDoubleQuoted(quoted) : ReadSingleQuoted(quoted);
+    }
+    default:
+        return ToWide(field.value);
+    }
+}
+
+bool ParseFlag(std::string_view value) {
+    return value == "true" || value == "yes" || value == "on" || value == "1";
+}
+
+// Returns false, leaving the value unread, for keys that are not Card members.
+bool ApplyCardField(Card& card, const YamlField& field, std::string_view text, size_t& position) {
+    if (field.key == "id") {
+        card.id = ReadScalar(field, text, position);
+    } else if (field.key == "question" || field.key == "cloze") {
+        card.question = ReadScalar(field, text, position);
+    } else if (field.key == "answer") {
+        card.answer = ReadScalar(field, text, position);
+    } else if (field.key == "reverse") {
+        card.reverse = ParseFlag(field.value);
+    } else {
+        return false;
+    }
+    return true;
+}
+}
+
+namespace {
+void AppendNormalizedText(std::wstring_view text, std::string& out) {
+    bool pendingSpace = false;
+    const size_t start = out.size();
+    for (size_t i = 0; i < text.size(); ++i) {
+        auto codePoint = static_cast<uint32_t>(text[i]);
+        if (codePoint == L' ' || codePoint == L'\t' || codePoint == L'\r' || codePoint == L'\n') {
+            pendingSpace = out.size() != start;
+            continue;
+        }
+        if (pendingSpace) {
+            out += ' ';
+            pendingSpace = false;
+        }
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 1 < text.size() &&
+            static_cast<uint32_t>(text[i + 1]) >= 0xDC00 &&
+            static_cast<uint32_t>(text[i + 1]) <= 0xDFFF) {
+            // Hash code points, so UTF-16 and UTF-32 wchar_t agree.
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) +
+                        (static_cast<uint32_t>(text[++i]) - 0xDC00);
+        } else if (codePoint >= L'A' && codePoint <= L'Z') {
+            codePoint += L'a' - L'A';
+        }
+        AppendUtf8(codePoint, out);
+    }
+}
+}
+
+uint64_t CardFingerprint(std::wstring_view question, std::wstring_view answer) {
+    std::string normalized;
+    normalized.reserve(question.size() + answer.size() + 1);
+    AppendNormalizedText(question, normalized);
+    normalized += '\0';
+    AppendNormalizedText(answer, normalized);
+    const uint64_t fingerprint = Xxh64(normalized, 0);
+    return fingerprint != 0 ? fingerprint : 1;
+}
+
+size_t CardBodyBytes(const Card& card) {
+    return (card.question.capacity() + card.answer.capacity()) * sizeof(wchar_t);
+}
+
+bool IsCardBodyResident(const Card& card) {
+    return !card.question.empty();
+}
+
+void ReleaseCardBody(Card& card) {
+    std::wstring().swap(card.question);
+    std::wstring().swap(card.answer);
+}
+
+std::vector<ReviewItem> BuildReviewItems(const std::vector<Card>& cards) {
+    std::vector<ReviewItem> items;
+    items.reserve(cards.size());
+    for (size_t i = 0; i < cards.size(); ++i) {
+        if (cards[i].clozeGaps.empty()) {
+            items.push_back({i, CardDirection::Forward});
+            continue;
+        }
+        for (const uint16_t number : ClozeNumbers(cards[i].clozeGaps)) {
+            items.push_back({i, CardDirection::Forward, number});
+        }
+    }
+    for (size_t i = 0; i < cards.size(); ++i) {
+        if (cards[i].reverse && cards[i].clozeGaps.empty()) {
+            items.push_back({i, CardDirection::Reverse});
+        }
+    }
+    return items;
+}
+
+const std::wstring& PromptText(const Card& card, const ReviewItem& item, std::wstring& scratch) {
+    if (item.cloze != 0) {
+        RenderClozeQuestion(card.question, card.clozeGaps, item.cloze, scratch);
+        return scratch;
+    }
+    return item.direction == CardDirection::Reverse ? card.answer : card.question;
+}
+
+const std::wstring& ResponseText(const Card& card, const ReviewItem& item,
+                                 std::wstring& scratch) {
+    if (item.cloze != 0) {
+        RenderClozeAnswer(card.question, card.clozeGaps, item.cloze, scratch);
+        if (!card.answer.empty()) {
+            scratch += L"\n\n";
+            scratch += card.answer;
+        }
+        return scratch;
+    }
+    return item.direction == CardDirection::Reverse ? card.question : card.answer;
+}
+
+bool CompileDeckTemplates(const Deck& deck, CompiledTemplate& question, CompiledTemplate& answer) {
+    question = CompiledTemplate{};
+    answer = CompiledTemplate{};
+    const auto resolve = [&deck](std::wstring_view name) {
+        const uint32_t builtin = BuiltinTemplateField(name);
+        if (builtin != MISSING_TEMPLATE_FIELD) {
+            return builtin;
+        }
+        const uint32_t extra = FindCardField(deck.fields, name);
+        return extra == MISSING_CARD_FIELD ? MISSING_TEMPLATE_FIELD
+                                           : TEMPLATE_BUILTIN_FIELD_COUNT + extra;
+    };
+    bool compiled = true;
+    if (!deck.questionTemplate.empty()) {
+        compiled = CompileCardTemplate(deck.questionTemplate, resolve, question) && compiled;
+    }
+    if (!deck.answerTemplate.empty()) {
+        compiled = CompileCardTemplate(deck.answerTemplate, resolve, answer) && compiled;
+    }
+    return compiled;
+}
+
+const std::wstring& RenderCardSide(const Card& card, const ReviewItem& item,
+                                   const CardFieldTable& fields, const CompiledTemplate& compiled,
+                                   bool answerSide, CardRenderBuffers& buffers) {
+    if (compiled.ops.empty()) {
+        return answerSide ? ResponseText(card, item, buffers.back)
+                          : PromptText(card, item, buffers.front);
+    }
+
+    const std::wstring& front = PromptText(card, item, buffers.front);
+    const std::wstring& back = ResponseText(card, item, buffers.back);
+    RenderCardTemplate(
+        compiled,
+        [&](uint32_t field) -> std::wstring_view {
+            switch (field) {
+            case TEMPLATE_FIELD_FRONT:
+                return front;
+            case TEMPLATE_FIELD_BACK:
+                return back;
+            case TEMPLATE_FIELD_ID:
+                return card.id;
+            case TEMPLATE_FIELD_QUESTION:
+                return card.question;
+            case TEMPLATE_FIELD_ANSWER:
+                return card.answer;
+            default:
+                return CardFieldValue(fields, field - TEMPLATE_BUILTIN_FIELD_COUNT, item.handle);
+            }
+        },
+        buffers.output);
+    return buffers.output;
+}
+
+std::string ReviewItemKey(const Card& card, const ReviewItem& item) {
+    std::string key = ToUtf8(card.id);
+    if (item.cloze != 0) {
+        key += "@c" + std::to_string(item.cloze);
+    } else if (item.direction == CardDirection::Reverse) {
+        key += "@reverse";
+    }
+    return key;
+}
+
+namespace {
+// Reads a YAML deck front to back. Generators and templates go to rest; each
+// complete card (or every card entry, with keepIncomplete) is handed to sink
+// with its extra fields and the offset its entry ends at. Stops early when
+// sink returns false.
+template <typename CardSink>
+void ScanYamlDeck(std::string_view text, Deck& rest, bool keepIncomplete, const CardSink& sink) {
+    Card currentCard{};
+    CardFieldList currentExtras;
+    std::wstring generatorParams;
+    enum class Section { Cards, Generators, Templates } section = Section::Cards;
+    bool inCard = false;
+    const auto pushCard = [&](size_t entryEnd) {
+        if (!inCard) {
+            return true;
+        }
+        inCard = false;
+
+        if (section == Section::Generators) {
+            CardGenerator generator;
+            if (CompileGenerator(currentCard.id, generatorParams, currentCard.question,
+                                 currentCard.answer, generator)) {
+                generator.reverse = currentCard.reverse;
+                rest.generators.push_back(std::move(generator));
+            }
+            return true;
+        }
+
+        ParseClozeGaps(currentCard.question, currentCard.clozeGaps);
+        if (!keepIncomplete && !IsCardComplete(currentCard)) {
+            return true;
+        }
+        currentCard.source = CardSource::DeckFile;
+        currentCard.fingerprint = CardFingerprint(currentCard.question, currentCard.answer);
+        return sink(currentCard, currentExtras, entryEnd);
+    };
+    const auto applyField = [&](const YamlField& field, size_t& position) {
+        if (section == Section::Generators && field.key == "params") {
+            generatorParams = ReadScalar(field, text, position);
+        } else if (!ApplyCardField(currentCard, field, text, position)) {
+            std::wstring value = ReadScalar(field, text, position);
+            if (section == Section::Cards) {
+                currentExtras.emplace_back(ToWide(field.key), std::move(value));
+            }
+        }
+    };
+
+    size_t position = 0;
+    while (position < text.size()) {
+        const size_t lineOffset = position;
+        const YamlLine line = ReadYamlLine(text, position);
+        if (line.content.empty() ? !line.entryStart : line.content[0] == '#') {
+            continue;
+        }
+
+        if (IsSectionHeader(line)) {
+            if (!pushCard(lineOffset)) {
+                return;
+            }
+            section = line.content == "cards:"        ? Section::Cards
+                      : line.content == "generators:" ? Section::Generators
+                                                      : Section::Templates;
+            continue;
+        }
+
+        YamlField field{};
+        const bool hasField = SplitYamlField(line, field);
+        if (section == Section::Templates) {
+            if (hasField && field.key == "question") {
+                rest.questionTemplate = ReadScalar(field, text, position);
+            } else if (hasField && field.key == "answer") {
+                rest.answerTemplate = ReadScalar(field, text, position);
+            }
+            continue;
+        }
+
+        if (line.entryStart) {
+            if (!pushCard(lineOffset)) {
+                return;
+            }
+
+            currentCard = Card{};
+            currentCard.sourceOffset = static_cast<std::streamoff>(lineOffset);
+            currentExtras.clear();
+            generatorParams.clear();
+            inCard = true;
+        }
+
+        if (inCard && hasField) {
+            applyField(field, position);
+        }
+    }
+
+    pushCard(text.size());
+}
+}
+
+Deck ParseDeckFromYaml(std::string_view text, size_t bodyBudget) {
+    Deck deck;
+    size_t residentBytes = 0;
+    ScanYamlDeck(text, deck, false, [&](Card& card, CardFieldList& extras, size_t) {
+        residentBytes += CardBodyBytes(card);
+        if (bodyBudget != 0 && residentBytes > bodyBudget) {
+            ReleaseCardBody(card);
+        }
+        for (auto& [name, value] : extras) {
+            AppendCardField(deck.fields, name, deck.cards.size(), std::move(value));
+        }
+        deck.cards.push_back(std::move(card));
+        return true;
+    });
+    return deck;
+}
+
+Deck LoadDeckFromYaml(const std::filesystem::path& path, size_t bodyBudget) {
+    MappedFile file;
+    if (!file.Open(path, MapOptions{})) {
+        return {};
+    }
+    return ParseDeckFromYaml(file.View(), bodyBudget);
+}
+
+Deck ParseDeck(std::string_view text, const std::filesystem::path& path, size_t bodyBudget) {
+    if (IsBinaryDeck(text)) {
+        return ParseBinaryDeck(text, bodyBudget);
+    }
+    if (IsJsonlDeckPath(path)) {
+        return ParseDeckFromJsonl(text, bodyBudget);
+    }
+    return ParseDeckFromYaml(text, bodyBudget);
+}
+
+void StreamDeckCards(std::string_view text, const std::filesystem::path& path,
+                     const DeckCardVisitor& visit, Deck& rest) {
+    if (IsBinaryDeck(text)) {
+        StreamBinaryDeck(text, visit, rest);
+    } else if (IsJsonlDeckPath(path)) {
+        StreamDeckFromJsonl(text, false, visit, rest);
+    } else {
+        ScanYamlDeck(text, rest, false, visit);
+    }
+}
+
+void StreamDeckEntries(std::string_view text, const std::filesystem::path& path,
+                       const DeckCardVisitor& visit, Deck& rest) {
+    // Packed decks are written from loaded decks, so every card is complete.
+    if (IsBinaryDeck(text)) {
+        StreamBinaryDeck(text, visit, rest);
+    } else if (IsJsonlDeckPath(path)) {
+        StreamDeckFromJsonl(text, true, visit, rest);
+    } else {
+        ScanYamlDeck(text, rest, true, visit);
+    }
+}
+
+Deck LoadDeckFile(const std::filesystem::path& path, size_t bodyBudget) {
+    MappedFile file;
+    if (!file.Open(path, MapOptions{})) {
+        return {};
+    }
+    return ParseDeck(file.View(), path, bodyBudget);
+}
+
+bool ReadCardBodyAt(std::string_view text, size_t offset, Card& card) {
+    if (offset >= text.size()) {
+        return false;
+    }
+    if (IsBinaryDeck(text)) {
+        return ReadBinaryCardBodyAt(text, offset, card);
+    }
+    // JSONL lines may be indented, as the JSONL loader allows.
+    const size_t content = text.find_first_not_of(" \t", offset);
+    if (content != std::string_view::npos && text[content] == '{') {
+        return ReadJsonlCardBodyAt(text, offset, card);
+    }
+
+    Card parsed{};
+    size_t position = offset;
+    bool first = true;
+    while (position < text.size()) {
+        const YamlLine line = ReadYamlLine(text, position);
+        if (line.content.empty() ? !line.entryStart : line.content[0] == '#') {
+            continue;
+        }
+        if ((line.entryStart && !first) || IsSectionHeader(line)) {
+            break;
+        }
+        first = false;
+
+        YamlField field{};
+        if (SplitYamlField(line, field) && !ApplyCardField(parsed, field, text, position)) {
+            ReadScalar(field, text, position);
+        }
+    }
+
+    ParseClozeGaps(parsed.question, parsed.clozeGaps);
+    if (parsed.id != card.id || !IsCardComplete(parsed)) {
+        return false;
+    }
+
+    card.question = std::move(parsed.question);
+    card.answer = std::move(parsed.answer);
+    return true;
+}
+
+Deck LoadEmbeddedDeck(const EmbeddedDeck& deck) {
+    Deck loaded;
+    loaded.cards.reserve(deck.cardCount);
+    for (size_t i = 0; i < deck.cardCount; ++i) {
+        const EmbeddedCardEntry& entry = deck.cards[i];
+        Card card{};
+        card.id = deck.text + entry.id;
+        card.reverse = entry.reverse;
+        card.clozeGaps.assign(deck.clozeGaps + entry.firstClozeGap,
+                              deck.clozeGaps + entry.firstClozeGap + entry.clozeGapCount);
+        card.fingerprint = entry.fingerprint;
+        card.source = CardSource::Embedded;
+        card.sourceOffset = static_cast<std::streamoff>(i);
+        loaded.cards.push_back(std::move(card));
+    }
+    for (size_t i = 0; i < deck.fieldCount; ++i) {
+        const EmbeddedCardField& field = deck.fields[i];
+        AppendCardField(loaded.fields, deck.text + field.name, field.card,
+                        deck.text + field.value);
+    }
+    loaded.questionTemplate = deck.text + deck.questionTemplate;
+    loaded.answerTemplate = deck.text + deck.answerTemplate;
+    return loaded;
+}
+
+void ReadEmbeddedCardBody(const EmbeddedDeck& deck, Card& card) {
+    const EmbeddedCardEntry& entry = deck.cards[static_cast<size_t>(card.sourceOffset)];
+    card.question = deck.text + entry.question;
+    card.answer = deck.text + entry.answer;
+}
+
+namespace {
+// Plain scalars are kept for readability; anything the loader could read
+// differently is double-quoted.
+bool IsPlainYamlScalar(std::string_view value) {
+    if (value.empty() || value != Trim(value) ||
+        std::string_view("\"'|>-#{}[]&*!%@`,?:").find(value[0]) != std::string_view::npos ||
+        value.back() == ':') {
+        return false;
+    }
+    // One pass for line breaks, tabs, ": " and " #".
+    for (size_t i = 1; i < value.size(); ++i) {
+        const char c = value[i];
+        if (c == '\r' || c == '\n' || c == '\t' || (c == ' ' && value[i - 1] == ':') ||
+            (c == '#' && value[i - 1] == ' ')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AppendYamlScalar(const std::wstring& value, std::string& out) {
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    const std::string utf8 = ToUtf8(value);
+    if (IsPlainYamlScalar(utf8)) {
+        out += utf8;
+        return;
+    }
+
+    // Runs of bytes that need no escape are appended whole.
+    out += '"';
+    size_t run = 0;
+    for (size_t i = 0; i < utf8.size(); ++i) {
+        const char c = utf8[i];
+        if (c != '"' && c != '\\' && static_cast<unsigned char>(c) >= 0x20) {
+            continue;
+        }
+        out.append(utf8, run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            out += "\\x";
+            out += HEX_DIGITS[(c >> 4) & 0xF];
+            out += HEX_DIGITS[c & 0xF];
+            break;
+        }
+    }
+    out.append(utf8, run, std::string::npos);
+    out += '"';
+}
+}
+
+void AppendYamlCard(const Card& card, std::string& out) {
+    out += "  - id: ";
+    AppendYamlScalar(card.id, out);
+    out += card.clozeGaps.empty() ? "\n    question: " : "\n    cloze: ";
+    AppendYamlScalar(card.question, out);
+    if (!card.answer.empty()) {
+        out += "\n    answer: ";
+        AppendYamlScalar(card.answer, out);
+    }
+    if (card.reverse) {
+        out += "\n    reverse: true";
+    }
+    out += '\n';
+}
+
+void AppendYamlField(const std::wstring& name, const std::wstring& value, std::string& out) {
+    out += "    ";
+    out += ToUtf8(name);
+    out += ": ";
+    AppendYamlScalar(value, out);
+    out += '\n';
+}
+
+void AppendYamlTemplates(const Deck& deck, std::string& out) {
+    if (deck.questionTemplate.empty() && deck.answerTemplate.empty()) {
+        return;
+    }
+    out += "templates:\n  question: ";
+    AppendYamlScalar(deck.questionTemplate, out);
+    out += "\n  answer: ";
+    AppendYamlScalar(deck.answerTemplate, out);
+    out += '\n';
+}
+
+std::string DeckToYaml(const Deck& deck) {
+    std::string out = "cards:\n";
+    const std::vector<CardFieldColumn>& columns = deck.fields.columns;
+    for (size_t i = 0; i < deck.cards.size(); ++i) {
+        AppendYamlCard(deck.cards[i], out);
+        for (uint32_t field = 0; field < columns.size(); ++field) {
+            const std::wstring_view value = CardFieldValue(deck.fields, field, i);
+            if (!value.empty()) {
+                AppendYamlField(columns[field].name, std::wstring(value), out);
+            }
+        }
+    }
+    AppendYamlTemplates(deck, out);
+    return out;
+}
+
+bool WriteEmbeddedDeckHeader(const Deck& deck, const std::string& name,
+                             const std::filesystem::path& path) {
+    std::wstring text;
+    std::vector<EmbeddedCardEntry> entries;
+    std::vector<ClozeGap> clozeGaps;
+    std::vector<EmbeddedCardField> fields;
+    entries.reserve(deck.cards.size());
+    const auto append = [&text](std::wstring_view value) {
+        const size_t offset = text.size();
+        text += value;
+        text += L'\0';
+        return offset;
+    };
+    // Field names are stored once each.
+    std::vector<size_t> fieldNames;
+    for (const CardFieldColumn& column : deck.fields.columns) {
+        fieldNames.push_back(append(column.name));
+    }
+    for (size_t i = 0; i < deck.cards.size(); ++i) {
+        const Card& card = deck.cards[i];
+        const size_t id = append(card.id);
+        const size_t question = append(card.question);
+        const size_t answer = append(card.answer);
+        std::vector<ClozeGap> gaps;
+        ParseClozeGaps(card.question, gaps);
+        entries.push_back({id, question, answer, card.reverse,
+                           CardFingerprint(card.question, card.answer), clozeGaps.size(),
+                           gaps.size()});
+        clozeGaps.insert(clozeGaps.end(), gaps.begin(), gaps.end());
+        for (uint32_t field = 0; field < fieldNames.size(); ++field) {
+            const std::wstring_view value = CardFieldValue(deck.fields, field, i);
+            if (!value.empty()) {
+                fields.push_back({i, fieldNames[field], append(value)});
+            }
+        }
+    }
+    const size_t questionTemplate = append(deck.questionTemplate);
+    const size_t answerTemplate = append(deck.answerTemplate);
+
+    std::ostringstream out;
+    out << "// Generated by DeckTool embed. Do not edit.\n"
+        << "#pragma once\n\n"
+        << "#include \"deck.h\"\n\n";
+
+    // Emitted as code units rather than a string literal so that decks of any
+    // size and content stay within compiler literal limits.
+    out << "constexpr wchar_t " << name << "_TEXT[] = {";
+    for (size_t i = 0; i < text.size(); ++i) {
+        out << (i % 12 == 0 ? "\n    " : " ") << "0x" << std::hex << std::setw(4)
+            << std::setfill('0') << static_cast<unsigned long>(text[i]) << ',';
+    }
+    out << std::dec << "\n};\n\n";
+
+    // Empty tables get one unused entry, since C++ has no zero-length arrays.
+    out << "constexpr EmbeddedCardEntry " << name << "_CARDS[] = {\n";
+    for (const EmbeddedCardEntry& entry : entries) {
+        out << "    {" << entry.id << ", " << entry.question << ", " << entry.answer << ", "
+            << (entry.reverse ? "true" : "false") << ", 0x" << std::hex << entry.fingerprint
+            << std::dec << "ULL, " << entry.firstClozeGap << ", " << entry.clozeGapCount
+            << "},\n";
+    }
+    if (entries.empty()) {
+        out << "    {0, 0, 0, false, 0, 0, 0},\n";
+    }
+    out << "};\n\n";
+
+    out << "constexpr ClozeGap " << name << "_CLOZE_GAPS[] = {\n";
+    for (const ClozeGap& gap : clozeGaps) {
+        out << "    {" << gap.begin << ", " << gap.end << ", " << gap.contentBegin << ", "
+            << gap.contentEnd << ", " << gap.hintBegin << ", " << gap.number << "},\n";
+    }
+    if (clozeGaps.empty()) {
+        out << "    {0, 0, 0, 0, 0, 0},\n";
+    }
+    out << "};\n\n";
+
+    out << "constexpr EmbeddedCardField " << name << "_FIELDS[] = {\n";
+    for (const EmbeddedCardField& field : fields) {
+        out << "    {" << field.card << ", " << field.name << ", " << field.value << "},\n";
+    }
+    if (fields.empty()) {
+        out << "    {0, 0, 0},\n";
+    }
+    out << "};\n\n";
+
+    out << "constexpr EmbeddedDeck " << name << "{" << name << "_TEXT, " << name << "_CARDS, "
+        << entries.size() << ", " << name << "_CLOZE_GAPS, " << name << "_FIELDS, "
+        << fields.size() << ", " << questionTemplate << ", " << answerTemplate << "};\n";
+
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << out.str();
+    return static_cast<bool>(file);
+}
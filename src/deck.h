@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "card_fields.h"
+#include "card_generator.h"
+#include "card_template.h"
+#include "cloze.h"
+
+// Where a card's question/answer text can be reloaded from once evicted.
+enum class CardSource { Memory, DeckFile, Embedded, Generated };
+
+struct Card {
+    std::wstring id;
+    std::wstring question;
+    std::wstring answer;
+    CardSource source{CardSource::Memory};
+    std::streamoff sourceOffset{0};
+    bool bodyReferenced{false};
+    // Also review the card answer-first ("reverse: true" in the deck).
+    bool reverse{false};
+    // Cloze markers in question, found at load; they stay resident when the
+    // body is evicted.
+    std::vector<ClozeGap> clozeGaps{};
+    // CardFingerprint of the text, computed at load and kept when the body
+    // is evicted; 0 where it is not known.
+    uint64_t fingerprint{0};
+};
+
+enum class CardDirection : uint8_t { Forward, Reverse };
+
+// One schedulable review of a card. Both directions of a card, and every
+// gap of a cloze card, share its stored text; handle indexes the deck
+// (generated cards follow the literal ones).
+struct ReviewItem {
+    size_t handle;
+    CardDirection direction;
+    // Gap number for cloze cards, 0 otherwise.
+    uint16_t cloze{0};
+};
+
+// Literal cards followed by the cards of each generator, in that order.
+struct Deck {
+    std::vector<Card> cards;
+    std::vector<CardGenerator> generators;
+    // Extra fields of the literal cards, by card index.
+    CardFieldTable fields{};
+    // Display templates from the deck's templates: section; empty shows the
+    // card text verbatim.
+    std::wstring questionTemplate{};
+    std::wstring answerTemplate{};
+};
+
+// Scratch space reused across renders of review items.
+struct CardRenderBuffers {
+    std::wstring front;
+    std::wstring back;
+    std::wstring output;
+};
+
+// A deck compiled into the binary by DeckTool. Every string is a
+// NUL-terminated run inside text; entries hold offsets into it. Fingerprints
+// and cloze gaps are computed by DeckTool, so loading does no parsing.
+struct EmbeddedCardEntry {
+    size_t id;
+    size_t question;
+    size_t answer;
+    bool reverse;
+    uint64_t fingerprint;
+    // The card's run of gaps in EmbeddedDeck::clozeGaps.
+    size_t firstClozeGap;
+    size_t clozeGapCount;
+};
+
+// One extra field of one card, in card order.
+struct EmbeddedCardField {
+    size_t card;
+    size_t name;
+    size_t value;
+};
+
+struct EmbeddedDeck {
+    const wchar_t* text;
+    const EmbeddedCardEntry* cards;
+    size_t cardCount;
+    const ClozeGap* clozeGaps;
+    const EmbeddedCardField* fields;
+    size_t fieldCount;
+    // Empty strings when the deck has no templates.
+    size_t questionTemplate;
+    size_t answerTemplate;
+};
+
+std::wstring ToWide(std::string_view text);
+std::string ToUtf8(const std::wstring& text);
+std::wstring TrimWide(const std::wstring& text);
+std::string_view Trim(std::string_view text);
+
+bool IsCardComplete(const Card& card);
+
+// XXH64 of the question and answer after collapsing whitespace runs to one
+// space, trimming and lower-casing ASCII, so that reflowed or recased text
+// keeps its fingerprint while the id is free to change. Never 0.
+uint64_t CardFingerprint(std::wstring_view question, std::wstring_view answer);
+size_t CardBodyBytes(const Card& card);
+bool IsCardBodyResident(const Card& card);
+void ReleaseCardBody(Card& card);
+
+// Review items for the literal cards: every card forward (one item per gap
+// for cloze cards), then the reverse items so the two sides of a card are
+// not reviewed back to back.
+std::vector<ReviewItem> BuildReviewItems(const std::vector<Card>& cards);
+
+// Text to show for item before and after revealing the answer. Plain cards
+// return their stored text; cloze items are rendered into scratch.
+const std::wstring& PromptText(const Card& card, const ReviewItem& item, std::wstring& scratch);
+const std::wstring& ResponseText(const Card& card, const ReviewItem& item,
+                                 std::wstring& scratch);
+
+// Compiles the deck's display templates; a side without a template is left
+// empty. Names other than the built-in fields resolve to the deck's extra
+// fields. Returns false if either template is malformed.
+bool CompileDeckTemplates(const Deck& deck, CompiledTemplate& question, CompiledTemplate& answer);
+
+// Text for the question (answerSide false) or answer side of item, run
+// through compiled unless it is empty; extra fields are looked up in fields
+// by item.handle. Rendering only writes into buffers.
+const std::wstring& RenderCardSide(const Card& card, const ReviewItem& item,
+                                   const CardFieldTable& fields, const CompiledTemplate& compiled,
+                                   bool answerSide, CardRenderBuffers& buffers);
+
+// "<id>", "<id>@reverse" or "<id>@c<gap>", the key item is logged under.
+std::string ReviewItemKey(const Card& card, const ReviewItem& item);
+
+// Loads the deck, keeping question/answer text only for the leading cards
+// that fit in bodyBudget bytes (0 keeps everything). The remaining cards
+// hold just their id and the offset their entry starts at in text. Card
+// keys other than id/question/cloze/answer/reverse go to deck.fields and
+// stay loaded.
+Deck ParseDeckFromYaml(std::string_view text, size_t bodyBudget);
+Deck LoadDeckFromYaml(const std::filesystem::path& path, size_t bodyBudget);
+
+// Parses a deck in any supported format: packed decks are recognised by
+// their header, JSONL decks by the extension of path, the rest is YAML.
+Deck ParseDeck(std::string_view text, const std::filesystem::path& path, size_t bodyBudget);
+Deck LoadDeckFile(const std::filesystem::path& path, size_t bodyBudget);
+
+// Receives each card of a streamed deck with its extra fields, and the offset
+// in the deck text below which nothing will be read again. The card can be
+// moved from. Returning false stops the stream.
+using DeckCardVisitor = std::function<bool(Card& card, CardFieldList& extras, size_t consumed)>;
+
+// Hands the cards of a deck in any supported format to visit one at a time,
+// in file order, without building a Deck; only a bounded run of cards is
+// held at once. Generators and templates are collected into rest.
+void StreamDeckCards(std::string_view text, const std::filesystem::path& path,
+                     const DeckCardVisitor& visit, Deck& rest);
+
+// Like StreamDeckCards, but also hands over the entries that loaders skip
+// for lacking an id, question or answer, so that they can be reported.
+void StreamDeckEntries(std::string_view text, const std::filesystem::path& path,
+                       const DeckCardVisitor& visit, Deck& rest);
+
+// Re-reads the question/answer of the card ParseDeck placed at offset; for a
+// packed deck that is a record index, otherwise the offset of its entry.
+bool ReadCardBodyAt(std::string_view text, size_t offset, Card& card);
+
+// Creates id-only cards for an embedded deck, copying each id, extra field
+// and the templates out of the tables; bodies are copied from them by
+// ReadEmbeddedCardBody without any parsing when a card is shown.
+Deck LoadEmbeddedDeck(const EmbeddedDeck& deck);
+void ReadEmbeddedCardBody(const EmbeddedDeck& deck, Card& card);
+
+// Serializes the cards, extra fields and templates of deck as a YAML deck
+// that reads back unchanged. Generators are left out; they only exist in
+// compiled form.
+void AppendYamlCard(const Card& card, std::string& out);
+void AppendYamlField(const std::wstring& name, const std::wstring& value, std::string& out);
+void AppendYamlTemplates(const Deck& deck, std::string& out);
+std::string DeckToYaml(const Deck& deck);
+
+// Writes a header declaring `constexpr EmbeddedDeck name` for the cards,
+// extra fields and templates of deck. Generators are left out.
+bool WriteEmbeddedDeckHeader(const Deck& deck, const std::string& name,
+                             const std::filesystem::path& path);
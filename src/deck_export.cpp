@@ -0,0 +1,268 @@
+#include "deck_export.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "deck.h"
+#include "deck_jsonl.h"
+#include "mapped_file.h"
+#include "review_log.h"
+
+namespace {
+// Input pages are released in steps of this many bytes.
+constexpr size_t RELEASE_STRIDE = 16 << 20;
+
+// The caller serializes into Buffer() while a thread writes the previously
+// filled buffer; Flush swaps the two once that write has finished.
+class DoubleBufferedWriter {
+public:
+    DoubleBufferedWriter(std::ofstream& stream, size_t flushBytes)
+        : out(stream), bufferBytes(flushBytes), thread([this]() { Run(); }) {
+        buffers[0].reserve(bufferBytes * 2);
+        buffers[1].reserve(bufferBytes * 2);
+    }
+
+    ~DoubleBufferedWriter() { Finish(); }
+
+    std::string& Buffer() { return buffers[front]; }
+
+    void FlushIfFull() {
+        if (buffers[front].size() >= bufferBytes) {
+            Flush();
+        }
+    }
+
+    void Flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return !writing; });
+        writing = true;
+        front ^= 1;
+        buffers[front].clear();
+        changed.notify_all();
+    }
+
+    // Writes what is left and stops the thread; false if any write failed.
+    bool Finish() {
+        if (!thread.joinable()) {
+            return !failed;
+        }
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        thread.join();
+        return !failed;
+    }
+
+    uint64_t BytesWritten() const { return bytesWritten; }
+
+private:
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [this]() { return writing || stopping; });
+            if (!writing) {
+                return;
+            }
+            const std::string& back = buffers[front ^ 1];
+            lock.unlock();
+            out.write(back.data(), static_cast<std::streamsize>(back.size()));
+            const bool written = static_cast<bool>(out);
+            lock.lock();
+            failed = failed || !written;
+            bytesWritten += back.size();
+            writing = false;
+            changed.notify_all();
+        }
+    }
+
+    std::ofstream& out;
+    size_t bufferBytes;
+    std::string buffers[2]{};
+    size_t front{0};
+    std::mutex mutex{};
+    std::condition_variable changed{};
+    bool writing{false};
+    bool stopping{false};
+    bool failed{false};
+    uint64_t bytesWritten{0};
+    std::thread thread;
+};
+
+bool PassesFilter(const Card& card, const CardFieldList& extras, const ExportFilter& filter) {
+    if (card.id.compare(0, filter.idPrefix.size(), filter.idPrefix) != 0) {
+        return false;
+    }
+    if (filter.restrictToIds && filter.ids.count(card.id) == 0) {
+        return false;
+    }
+    if (filter.requiredField.empty()) {
+        return true;
+    }
+    for (const auto& [name, value] : extras) {
+        if (name == filter.requiredField && !value.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// RFC 4180: fields holding a comma, quote or line break are quoted, with
+// quotes doubled.
+void AppendCsvField(const std::wstring& text, std::string& out) {
+    const std::string utf8 = ToUtf8(text);
+    if (utf8.find_first_of(",\"\r\n") == std::string::npos) {
+        out += utf8;
+        return;
+    }
+    out += '"';
+    for (const char c : utf8) {
+        out += c;
+        if (c == '"') {
+            out += '"';
+        }
+    }
+    out += '"';
+}
+
+void AppendCsvCard(const Card& card, std::string& out) {
+    AppendCsvField(card.id, out);
+    out += ',';
+    AppendCsvField(card.question, out);
+    out += ',';
+    AppendCsvField(card.answer, out);
+    out += card.reverse ? ",true\r\n" : ",false\r\n";
+}
+}
+
+ExportFormat ExportFormatForPath(const std::filesystem::path& path) {
+    if (IsJsonlDeckPath(path)) {
+        return ExportFormat::Jsonl;
+    }
+    return path.extension() == ".csv" ? ExportFormat::Csv : ExportFormat::Yaml;
+}
+
+bool ParseExportFormat(std::string_view text, ExportFormat& format) {
+    if (text == "yaml") {
+        format = ExportFormat::Yaml;
+    } else if (text == "jsonl") {
+        format = ExportFormat::Jsonl;
+    } else if (text == "csv") {
+        format = ExportFormat::Csv;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::unordered_set<std::wstring> LoadCardIdsRated(const std::filesystem::path& logPath,
+                                                  std::string_view rating) {
+    MappedFile file;
+    std::unordered_set<std::wstring> ids;
+    if (!file.Open(logPath, MapOptions{})) {
+        return ids;
+    }
+
+    // Later lines win.
+    const std::string_view text = file.View();
+    std::unordered_map<std::string_view, std::string_view> latest;
+    size_t position = 0;
+    while (position < text.size()) {
+        const size_t end = std::min(text.find('\n', position), text.size());
+        const std::string_view line = Trim(text.substr(position, end - position));
+        position = end + 1;
+
+        ReviewRecord record;
+        if (ParseReviewRecord(line, record)) {
+            latest[record.itemKey] = record.rating;
+        }
+    }
+
+    for (const auto& [key, itemRating] : latest) {
+        if (itemRating == rating) {
+            std::string_view cardId;
+            std::string_view suffix;
+            SplitItemKey(key, cardId, suffix);
+            ids.insert(ToWide(cardId));
+        }
+    }
+    return ids;
+}
+
+bool ExportDeck(const std::filesystem::path& input, const std::filesystem::path& output,
+                const ExportOptions& options, ExportStats& stats, std::string& error) {
+    stats = ExportStats{};
+    MappedFile file;
+    if (!file.Open(input, MapOptions{})) {
+        error = "cannot map " + input.string();
+        return false;
+    }
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = "cannot create " + output.string();
+        return false;
+    }
+
+    DoubleBufferedWriter writer(out, options.bufferBytes);
+    if (options.format == ExportFormat::Yaml) {
+        writer.Buffer() += "cards:\n";
+    } else if (options.format == ExportFormat::Csv) {
+        writer.Buffer() += "id,question,answer,reverse\r\n";
+    }
+
+    size_t released = 0;
+    Deck rest;
+    StreamDeckCards(
+        file.View(), input,
+        [&](Card& card, CardFieldList& extras, size_t consumed) {
+            ++stats.cardsRead;
+            if (PassesFilter(card, extras, options.filter)) {
+                ++stats.cardsWritten;
+                std::string& buffer = writer.Buffer();
+                switch (options.format) {
+                case ExportFormat::Yaml:
+                    AppendYamlCard(card, buffer);
+                    for (const auto& [name, value] : extras) {
+                        AppendYamlField(name, value, buffer);
+                    }
+                    break;
+                case ExportFormat::Jsonl:
+                    AppendJsonlCard(card, extras, buffer);
+                    break;
+                case ExportFormat::Csv:
+                    AppendCsvCard(card, buffer);
+                    if (!extras.empty()) {
+                        ++stats.cardsWithDroppedFields;
+                    }
+                    break;
+                }
+                writer.FlushIfFull();
+            }
+            if (consumed >= released + RELEASE_STRIDE) {
+                file.Release(consumed);
+                released = consumed;
+            }
+            return true;
+        },
+        rest);
+
+    if (options.format == ExportFormat::Yaml) {
+        AppendYamlTemplates(rest, writer.Buffer());
+    } else if (options.format == ExportFormat::Jsonl) {
+        AppendJsonlTemplates(rest, writer.Buffer());
+    }
+    const bool written = writer.Finish() && static_cast<bool>(out.flush());
+    stats.bytesRead = file.View().size();
+    stats.bytesWritten = writer.BytesWritten();
+    if (!written) {
+        error = "cannot write " + output.string();
+        return false;
+    }
+    return true;
+}
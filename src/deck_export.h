@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+// Exports a filtered subset of a deck without loading it: cards are streamed
+// out of the mapped deck, serialized into one of two buffers while a writer
+// thread writes the other, and the pages already read are released. Memory
+// stays bounded by the buffer size however large the deck is.
+
+enum class ExportFormat { Yaml, Jsonl, Csv };
+
+// .jsonl/.ndjson and .csv by extension, YAML otherwise.
+ExportFormat ExportFormatForPath(const std::filesystem::path& path);
+bool ParseExportFormat(std::string_view text, ExportFormat& format);
+
+// A card is exported when it passes every test that is set.
+struct ExportFilter {
+    std::wstring idPrefix{};
+    // Name of an extra field the card must set.
+    std::wstring requiredField{};
+    bool restrictToIds{false};
+    std::unordered_set<std::wstring> ids{};
+};
+
+struct ExportOptions {
+    ExportFormat format{ExportFormat::Yaml};
+    ExportFilter filter{};
+    // Size each of the two output buffers fills to before it is written.
+    size_t bufferBytes{1 << 20};
+};
+
+struct ExportStats {
+    size_t cardsRead{0};
+    size_t cardsWritten{0};
+    // Written cards whose extra fields CSV has no column for.
+    size_t cardsWithDroppedFields{0};
+    uint64_t bytesRead{0};
+    uint64_t bytesWritten{0};
+};
+
+// Ids of the cards whose latest rating in an answer log ("good", "meh" or
+// "bad"), for any of their review items, is rating.
+std::unordered_set<std::wstring> LoadCardIdsRated(const std::filesystem::path& logPath,
+                                                  std::string_view rating);
+
+// Writes the cards of input that pass options.filter to output. YAML and
+// JSONL output is a deck with input's templates; CSV has id, question,
+// answer and reverse columns. Extra fields are kept in YAML and JSONL and
+// counted in stats when CSV drops them.
+bool ExportDeck(const std::filesystem::path& input, const std::filesystem::path& output,
+                const ExportOptions& options, ExportStats& stats, std::string& error);
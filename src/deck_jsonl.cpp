@@ -0,0 +1,628 @@
+#include "deck_jsonl.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QATRAINER_JSONL_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+// Below this a deck parses faster on one thread than it takes to start more.
+constexpr size_t PARALLEL_PARSE_MIN_BYTES = 1 << 20;
+constexpr size_t PARALLEL_PARSE_CHUNK_BYTES = 256 << 10;
+
+#if defined(QATRAINER_JSONL_SSE2)
+unsigned LowestSetBit(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+// Index of the first `first` or `second` byte at or after position, or
+// text.size(). Compares 16 bytes per step where SSE2 exists; the parser
+// uses it to skip string runs and find line ends, and is otherwise scalar.
+size_t FindEither(std::string_view text, size_t position, char first, char second) {
+#if defined(QATRAINER_JSONL_SSE2)
+    const __m128i firstBytes = _mm_set1_epi8(first);
+    const __m128i secondBytes = _mm_set1_epi8(second);
+    while (position + 16 <= text.size()) {
+        const __m128i block =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + position));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, firstBytes),
+                                                        _mm_cmpeq_epi8(block, secondBytes)));
+        if (mask != 0) {
+            return position + LowestSetBit(static_cast<unsigned>(mask));
+        }
+        position += 16;
+    }
+#endif
+    while (position < text.size() && text[position] != first && text[position] != second) {
+        ++position;
+    }
+    return position;
+}
+
+size_t SkipWhitespace(std::string_view line, size_t position) {
+    while (position < line.size() && (line[position] == ' ' || line[position] == '\t' ||
+                                      line[position] == '\r' || line[position] == '\n')) {
+        ++position;
+    }
+    return position;
+}
+
+bool ParseHex4(std::string_view line, size_t position, uint32_t& value) {
+    if (position + 4 > line.size()) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = position; i < position + 4; ++i) {
+        const char digit = line[i];
+        value <<= 4;
+        if (digit >= '0' && digit <= '9') {
+            value |= static_cast<uint32_t>(digit - '0');
+        } else if (digit >= 'a' && digit <= 'f') {
+            value |= static_cast<uint32_t>(digit - 'a' + 10);
+        } else if (digit >= 'A' && digit <= 'F') {
+            value |= static_cast<uint32_t>(digit - 'A' + 10);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AppendCodePoint(uint32_t codePoint, std::wstring& out) {
+    if (codePoint >= 0xD800 && codePoint <= 0xDFFF) {
+        codePoint = 0xFFFD;
+    }
+    if (sizeof(wchar_t) == 2 && codePoint > 0xFFFF) {
+        codePoint -= 0x10000;
+        out += static_cast<wchar_t>(0xD800 + (codePoint >> 10));
+        out += static_cast<wchar_t>(0xDC00 + (codePoint & 0x3FFu));
+    } else {
+        out += static_cast<wchar_t>(codePoint);
+    }
+}
+
+// Decodes one escape sequence after the backslash at position.
+bool DecodeEscape(std::string_view line, size_t& position, std::wstring& out) {
+    if (position + 1 >= line.size()) {
+        return false;
+    }
+    const char escape = line[position + 1];
+    position += 2;
+    switch (escape) {
+    case '"':
+    case '\\':
+    case '/':
+        out += static_cast<wchar_t>(escape);
+        return true;
+    case 'b':
+        out += L'\b';
+        return true;
+    case 'f':
+        out += L'\f';
+        return true;
+    case 'n':
+        out += L'\n';
+        return true;
+    case 'r':
+        out += L'\r';
+        return true;
+    case 't':
+        out += L'\t';
+        return true;
+    case 'u':
+        break;
+    default:
+        return false;
+    }
+
+    uint32_t unit = 0;
+    if (!ParseHex4(line, position, unit)) {
+        return false;
+    }
+    position += 4;
+
+    uint32_t low = 0;
+    if (unit >= 0xD800 && unit <= 0xDBFF && line.substr(position, 2) == "\\u" &&
+        ParseHex4(line, position + 2, low) && low >= 0xDC00 && low <= 0xDFFF) {
+        position += 6;
+        unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+    }
+    AppendCodePoint(unit, out);
+    return true;
+}
+
+// Reads the string whose opening quote is at position and moves position past
+// the closing quote. raw is the undecoded content, which is all keys need;
+// values are decoded into out, and only strings with escapes pay for it.
+bool ParseString(std::string_view line, size_t& position, std::string_view& raw,
+                 std::wstring* out) {
+    const size_t start = position + 1;
+    size_t cursor = FindEither(line, start, '"', '\\');
+    if (cursor < line.size() && line[cursor] == '"') {
+        raw = line.substr(start, cursor - start);
+        if (out != nullptr) {
+            *out = ToWide(raw);
+        }
+        position = cursor + 1;
+        return true;
+    }
+
+    std::wstring decoded;
+    size_t runStart = start;
+    while (cursor < line.size() && line[cursor] == '\\') {
+        if (out == nullptr) {
+            cursor += 2;
+        } else {
+            decoded += ToWide(line.substr(runStart, cursor - runStart));
+            if (!DecodeEscape(line, cursor, decoded)) {
+                return false;
+            }
+        }
+        runStart = cursor;
+        cursor = FindEither(line, cursor, '"', '\\');
+    }
+    if (cursor >= line.size()) {
+        return false;
+    }
+
+    if (out != nullptr) {
+        decoded += ToWide(line.substr(runStart, cursor - runStart));
+        *out = std::move(decoded);
+    }
+    raw = line.substr(start, cursor - start);
+    position = cursor + 1;
+    return true;
+}
+
+bool ReadStringValue(std::string_view line, size_t& position, std::wstring& out) {
+    std::string_view raw;
+    return position < line.size() && line[position] == '"' &&
+           ParseString(line, position, raw, &out);
+}
+
+bool SkipValue(std::string_view line, size_t& position) {
+    if (position >= line.size()) {
+        return false;
+    }
+
+    std::string_view raw;
+    const char first = line[position];
+    if (first == '"') {
+        return ParseString(line, position, raw, nullptr);
+    }
+    if (first == '{' || first == '[') {
+        size_t depth = 0;
+        while (position < line.size()) {
+            const char c = line[position];
+            if (c == '"') {
+                if (!ParseString(line, position, raw, nullptr)) {
+                    return false;
+                }
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                ++depth;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                ++position;
+                return true;
+            }
+            ++position;
+        }
+        return false;
+    }
+
+    // Numbers, true, false and null.
+    const size_t start = position;
+    while (position < line.size() && line[position] != ',' && line[position] != '}' &&
+           line[position] != ']' && line[position] != ' ' && line[position] != '\t' &&
+           line[position] != '\r') {
+        ++position;
+    }
+    return position > start;
+}
+
+// Walks the object at position, calling onField(key, position) with position
+// on each value; onField must consume the value.
+template <typename OnField>
+bool ParseObject(std::string_view line, size_t& position, OnField onField) {
+    position = SkipWhitespace(line, position);
+    if (position >= line.size() || line[position] != '{') {
+        return false;
+    }
+    position = SkipWhitespace(line, position + 1);
+    if (position < line.size() && line[position] == '}') {
+        ++position;
+        return true;
+    }
+
+    while (position < line.size()) {
+        std::string_view key;
+        if (line[position] != '"' || !ParseString(line, position, key, nullptr)) {
+            return false;
+        }
+        position = SkipWhitespace(line, position);
+        if (position >= line.size() || line[position] != ':') {
+            return false;
+        }
+        position = SkipWhitespace(line, position + 1);
+        if (!onField(key, position)) {
+            return false;
+        }
+
+        position = SkipWhitespace(line, position);
+        if (position < line.size() && line[position] == ',') {
+            position = SkipWhitespace(line, position + 1);
+        } else if (position < line.size() && line[position] == '}') {
+            ++position;
+            return true;
+        } else {
+            return false;
+        }
+    }
+    return false;
+}
+
+struct JsonlEntry {
+    Card card{};
+    std::wstring params{};
+    bool generator{false};
+    bool templates{false};
+    std::wstring questionTemplate{};
+    std::wstring answerTemplate{};
+    CardFieldList extras{};
+};
+
+// Other keys with string, number or boolean values are the card's extra
+// fields, as in YAML decks; objects, arrays and null are skipped.
+bool ReadExtraField(std::string_view line, size_t& at, std::string_view key,
+                    CardFieldList& extras) {
+    std::wstring value;
+    if (at < line.size() && line[at] == '"') {
+        if (!ReadStringValue(line, at, value)) {
+            return false;
+        }
+    } else {
+        const size_t start = at;
+        if (!SkipValue(line, at)) {
+            return false;
+        }
+        const std::string_view raw = line.substr(start, at - start);
+        if (raw[0] == '{' || raw[0] == '[' || raw == "null") {
+            return true;
+        }
+        value = ToWide(raw);
+    }
+    if (!value.empty()) {
+        extras.emplace_back(ToWide(key), std::move(value));
+    }
+    return true;
+}
+
+bool ParseEntry(std::string_view line, JsonlEntry& entry) {
+    size_t position = 0;
+    const bool parsed = ParseObject(line, position, [&](std::string_view key, size_t& at) {
+        if (key == "id") {
+            return ReadStringValue(line, at, entry.card.id);
+        }
+        if (key == "question" || key == "cloze") {
+            return ReadStringValue(line, at, entry.card.question);
+        }
+        if (key == "answer") {
+            return ReadStringValue(line, at, entry.card.answer);
+        }
+        if (key == "params") {
+            entry.generator = true;
+            return ReadStringValue(line, at, entry.params);
+        }
+        if (key == "reverse") {
+            entry.card.reverse = line.substr(at, 4) == "true";
+            return SkipValue(line, at);
+        }
+        if (key == "templates") {
+            entry.templates = true;
+            return ParseObject(line, at, [&](std::string_view side, size_t& sideAt) {
+                if (side == "question") {
+                    return ReadStringValue(line, sideAt, entry.questionTemplate);
+                }
+                if (side == "answer") {
+                    return ReadStringValue(line, sideAt, entry.answerTemplate);
+                }
+                return SkipValue(line, sideAt);
+            });
+        }
+        return ReadExtraField(line, at, key, entry.extras);
+    });
+    return parsed && SkipWhitespace(line, position) == line.size();
+}
+
+// What one thread parsed from its run of lines; merged in file order.
+struct ParsedChunk {
+    std::vector<Card> cards;
+    // Extra fields of each card, by index into cards.
+    std::vector<CardFieldList> extras;
+    std::vector<CardGenerator> generators;
+    bool hasTemplates{false};
+    std::wstring questionTemplate;
+    std::wstring answerTemplate;
+};
+
+// Incomplete cards are skipped unless keepIncomplete is set.
+void ParseChunk(std::string_view text, size_t begin, size_t end, bool keepIncomplete,
+                ParsedChunk& chunk) {
+    // Newline count first: an exact reserve beats regrowing a vector of cards.
+    size_t lineCount = 0;
+    for (size_t at = FindEither(text, begin, '\n', '\n'); at < end;
+         at = FindEither(text, at + 1, '\n', '\n')) {
+        ++lineCount;
+    }
+    chunk.cards.reserve(lineCount + 1);
+    chunk.extras.reserve(lineCount + 1);
+
+    size_t position = begin;
+    while (position < end) {
+        const size_t lineOffset = position;
+        const size_t lineEnd = FindEither(text, position, '\n', '\n');
+        const std::string_view line = text.substr(position, lineEnd - position);
+        position = lineEnd + 1;
+
+        JsonlEntry entry;
+        if (Trim(line).empty() || !ParseEntry(line, entry)) {
+            continue;
+        }
+
+        if (entry.templates) {
+            chunk.hasTemplates = true;
+            chunk.questionTemplate = std::move(entry.questionTemplate);
+            chunk.answerTemplate = std::move(entry.answerTemplate);
+            continue;
+        }
+
+        Card& card = entry.card;
+        if (entry.generator) {
+            CardGenerator generator;
+            if (CompileGenerator(card.id, entry.params, card.question, card.answer, generator)) {
+                generator.reverse = card.reverse;
+                chunk.generators.push_back(std::move(generator));
+            }
+            continue;
+        }
+
+        ParseClozeGaps(card.question, card.clozeGaps);
+        if (!keepIncomplete && !IsCardComplete(card)) {
+            continue;
+        }
+        card.source = CardSource::DeckFile;
+        card.sourceOffset = static_cast<std::streamoff>(lineOffset);
+        card.fingerprint = CardFingerprint(card.question, card.answer);
+        chunk.cards.push_back(std::move(card));
+        chunk.extras.push_back(std::move(entry.extras));
+    }
+}
+
+void AppendJsonString(const std::wstring& text, std::string& out) {
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    const std::string utf8 = ToUtf8(text);
+    out += '"';
+    // Runs of bytes that need no escape are appended whole.
+    size_t run = 0;
+    for (size_t i = 0; i < utf8.size(); ++i) {
+        const char c = utf8[i];
+        if (c != '"' && c != '\\' && static_cast<unsigned char>(c) >= 0x20) {
+            continue;
+        }
+        out.append(utf8, run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            out += "\\u00";
+            out += HEX_DIGITS[(c >> 4) & 0xF];
+            out += HEX_DIGITS[c & 0xF];
+            break;
+        }
+    }
+    out.append(utf8, run, std::string::npos);
+    out += '"';
+}
+}
+
+bool IsJsonlDeckPath(const std::filesystem::path& path) {
+    const std::filesystem::path extension = path.extension();
+    return extension == ".jsonl" || extension == ".ndjson";
+}
+
+Deck ParseDeckFromJsonl(std::string_view text, size_t bodyBudget) {
+    const size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t threadCount =
+        text.size() < PARALLEL_PARSE_MIN_BYTES
+            ? 1
+            : std::min(hardwareThreads, text.size() / PARALLEL_PARSE_CHUNK_BYTES);
+    // Without a budget the text is split evenly between the threads. With
+    // one it is parsed a wave of one chunk per thread at a time, and cards
+    // past the budget lose their bodies as each wave is appended, so no
+    // more than a wave's bodies are held beyond the budget.
+    const size_t chunkBytes =
+        bodyBudget == 0 ? text.size() / threadCount + 1 : PARALLEL_PARSE_CHUNK_BYTES;
+
+    Deck deck;
+    size_t residentBytes = 0;
+    std::vector<ParsedChunk> chunks;
+    size_t begin = 0;
+    while (begin < text.size()) {
+        // Chunks end just after a newline so that no line is split between threads.
+        std::vector<size_t> bounds{begin};
+        while (bounds.size() <= threadCount && bounds.back() < text.size()) {
+            const size_t split = std::min(bounds.back() + chunkBytes, text.size());
+            bounds.push_back(std::min(FindEither(text, split, '\n', '\n') + 1, text.size()));
+        }
+        begin = bounds.back();
+
+        chunks.assign(bounds.size() - 1, ParsedChunk{});
+        std::vector<std::thread> workers;
+        workers.reserve(chunks.size() - 1);
+        for (size_t i = 1; i < chunks.size(); ++i) {
+            workers.emplace_back(ParseChunk, text, bounds[i], bounds[i + 1], false,
+                                 std::ref(chunks[i]));
+        }
+        ParseChunk(text, bounds[0], bounds[1], false, chunks[0]);
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        size_t cardCount = deck.cards.size();
+        for (const ParsedChunk& chunk : chunks) {
+            cardCount += chunk.cards.size();
+        }
+        if (bodyBudget == 0) {
+            deck.cards.reserve(cardCount);
+        }
+        for (ParsedChunk& chunk : chunks) {
+            for (size_t i = 0; i < chunk.cards.size(); ++i) {
+                Card& card = chunk.cards[i];
+                residentBytes += CardBodyBytes(card);
+                if (bodyBudget != 0 && residentBytes > bodyBudget) {
+                    ReleaseCardBody(card);
+                }
+                for (auto& [name, value] : chunk.extras[i]) {
+                    AppendCardField(deck.fields, name, deck.cards.size(), std::move(value));
+                }
+                deck.cards.push_back(std::move(card));
+            }
+            std::move(chunk.generators.begin(), chunk.generators.end(),
+                      std::back_inserter(deck.generators));
+            if (chunk.hasTemplates) {
+                deck.questionTemplate = std::move(chunk.questionTemplate);
+                deck.answerTemplate = std::move(chunk.answerTemplate);
+            }
+        }
+    }
+    return deck;
+}
+
+void StreamDeckFromJsonl(std::string_view text, bool keepIncomplete, const DeckCardVisitor& visit,
+                         Deck& rest) {
+    size_t begin = 0;
+    while (begin < text.size()) {
+        const size_t split = std::min(begin + PARALLEL_PARSE_CHUNK_BYTES, text.size());
+        const size_t end = std::min(FindEither(text, split, '\n', '\n') + 1, text.size());
+        ParsedChunk chunk;
+        ParseChunk(text, begin, end, keepIncomplete, chunk);
+        begin = end;
+
+        std::move(chunk.generators.begin(), chunk.generators.end(),
+                  std::back_inserter(rest.generators));
+        if (chunk.hasTemplates) {
+            rest.questionTemplate = std::move(chunk.questionTemplate);
+            rest.answerTemplate = std::move(chunk.answerTemplate);
+        }
+        for (size_t i = 0; i < chunk.cards.size(); ++i) {
+            if (!visit(chunk.cards[i], chunk.extras[i], end)) {
+                return;
+            }
+        }
+    }
+}
+
+bool ReadJsonlCardBodyAt(std::string_view text, size_t offset, Card& card) {
+    if (offset >= text.size()) {
+        return false;
+    }
+
+    const size_t lineEnd = FindEither(text, offset, '\n', '\n');
+    JsonlEntry entry;
+    if (!ParseEntry(text.substr(offset, lineEnd - offset), entry) || entry.generator ||
+        entry.templates) {
+        return false;
+    }
+
+    Card& parsed = entry.card;
+    ParseClozeGaps(parsed.question, parsed.clozeGaps);
+    if (parsed.id != card.id || !IsCardComplete(parsed)) {
+        return false;
+    }
+
+    card.question = std::move(parsed.question);
+    card.answer = std::move(parsed.answer);
+    return true;
+}
+
+void AppendJsonlCard(const Card& card, const CardFieldList& extras, std::string& out) {
+    out += "{\"id\":";
+    AppendJsonString(card.id, out);
+    out += card.clozeGaps.empty() ? ",\"question\":" : ",\"cloze\":";
+    AppendJsonString(card.question, out);
+    if (!card.answer.empty()) {
+        out += ",\"answer\":";
+        AppendJsonString(card.answer, out);
+    }
+    if (card.reverse) {
+        out += ",\"reverse\":true";
+    }
+    for (const auto& [name, value] : extras) {
+        out += ',';
+        AppendJsonString(name, out);
+        out += ':';
+        AppendJsonString(value, out);
+    }
+    out += "}\n";
+}
+
+void AppendJsonlTemplates(const Deck& deck, std::string& out) {
+    if (deck.questionTemplate.empty() && deck.answerTemplate.empty()) {
+        return;
+    }
+    out += "{\"templates\":{\"question\":";
+    AppendJsonString(deck.questionTemplate, out);
+    out += ",\"answer\":";
+    AppendJsonString(deck.answerTemplate, out);
+    out += "}}\n";
+}
+
+std::string DeckToJsonl(const Deck& deck) {
+    std::string out;
+    const std::vector<CardFieldColumn>& columns = deck.fields.columns;
+    CardFieldList extras;
+    for (size_t i = 0; i < deck.cards.size(); ++i) {
+        extras.clear();
+        for (uint32_t field = 0; field < columns.size(); ++field) {
+            const std::wstring_view value = CardFieldValue(deck.fields, field, i);
+            if (!value.empty()) {
+                extras.emplace_back(columns[field].name, std::wstring(value));
+            }
+        }
+        AppendJsonlCard(deck.cards[i], extras, out);
+    }
+    AppendJsonlTemplates(deck, out);
+    return out;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "deck.h"
+
+// JSON Lines decks hold one object per line:
+//   {"id": "...", "question": "...", "answer": "...", "reverse": true}
+//   {"id": "...", "cloze": "..."}
+//   {"id": "...", "params": "a=1..12", "question": "{a} x 2?", "answer": "{a*2}"}
+//   {"templates": {"question": "...", "answer": "..."}}
+// Lines carrying "params" are generators. Other keys with scalar values are
+// extra card fields ({"id": "...", ..., "hint": "..."}), and lines that are
+// not objects or lack required fields are skipped, as in YAML decks.
+
+// True for paths ending in .jsonl or .ndjson.
+bool IsJsonlDeckPath(const std::filesystem::path& path);
+
+// Same result and body budget handling as ParseDeckFromYaml. Large inputs
+// are split at line boundaries and parsed on several threads.
+Deck ParseDeckFromJsonl(std::string_view text, size_t bodyBudget);
+
+// Parses one chunk of lines at a time and hands its cards to visit; see
+// StreamDeckCards and StreamDeckEntries for keepIncomplete.
+void StreamDeckFromJsonl(std::string_view text, bool keepIncomplete, const DeckCardVisitor& visit,
+                         Deck& rest);
+
+// Re-reads the question/answer of the object on the line starting at offset.
+bool ReadJsonlCardBodyAt(std::string_view text, size_t offset, Card& card);
+
+// Appends card and its extra fields as one JSONL line, including its newline.
+void AppendJsonlCard(const Card& card, const CardFieldList& extras, std::string& out);
+
+// Appends the templates line, if deck has templates.
+void AppendJsonlTemplates(const Deck& deck, std::string& out);
+
+// The cards, extra fields and templates of deck as JSONL text; the counterpart of
+// DeckToYaml.
+std::string DeckToJsonl(const Deck& deck);
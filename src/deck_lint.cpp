@@ -0,0 +1,363 @@
+#include "deck_lint.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include "binary_deck.h"
+#include "checksum.h"
+#include "deck.h"
+#include "mapped_file.h"
+
+namespace {
+constexpr size_t LINT_BATCH_CARDS = 16384;
+// Batches parsed ahead of the checking threads, per thread.
+constexpr size_t LINT_QUEUE_DEPTH = 2;
+constexpr size_t ID_PARTITION_BITS = 4;
+constexpr size_t ID_PARTITIONS = size_t{1} << ID_PARTITION_BITS;
+// Input pages are released in steps of this many bytes.
+constexpr size_t RELEASE_STRIDE = 16 << 20;
+
+// A diagnostic located by byte offset (card index in packed decks).
+struct Finding {
+    LintRule rule;
+    uint64_t offset;
+    std::string cardId;
+    std::string message;
+    // Offset of the first card with the same id, for DuplicateId.
+    uint64_t firstOffset{0};
+};
+
+struct IdKey {
+    uint64_t hash;
+    uint64_t ordinal;
+};
+
+// A run of cards and what checking them left behind. The cards are dropped
+// once checked; the ids stay for the duplicate pass.
+struct LintBatch {
+    size_t firstOrdinal{0};
+    std::vector<Card> cards{};
+    std::vector<Finding> findings{};
+    std::string ids{};
+    std::vector<uint32_t> idEnds{};
+    std::vector<uint64_t> offsets{};
+    std::vector<IdKey> keys[ID_PARTITIONS]{};
+
+    std::string_view Id(size_t local) const {
+        const size_t begin = local == 0 ? 0 : idEnds[local - 1];
+        return std::string_view(ids).substr(begin, idEnds[local] - begin);
+    }
+};
+
+void CheckText(const Card& card, const std::string& id, uint64_t offset,
+               const LintOptions& options, std::vector<Finding>& findings) {
+    if (card.question.empty()) {
+        findings.push_back({LintRule::EmptyQuestion, offset, id, "card has no question"});
+    } else if (card.answer.empty() && card.clozeGaps.empty()) {
+        findings.push_back({LintRule::EmptyAnswer, offset, id, "card has no answer"});
+    }
+
+    // Every "{{c" in the question should open one of the parsed gaps.
+    size_t gap = 0;
+    for (size_t at = card.question.find(L"{{c"); at != std::wstring::npos;
+         at = card.question.find(L"{{c", at + 1)) {
+        while (gap < card.clozeGaps.size() && card.clozeGaps[gap].begin < at) {
+            ++gap;
+        }
+        if (gap == card.clozeGaps.size() || card.clozeGaps[gap].begin != at) {
+            findings.push_back({LintRule::MalformedCloze, offset, id,
+                                "cloze marker at character " + std::to_string(at + 1) +
+                                    " is not closed as {{cN::text}}"});
+            break;
+        }
+    }
+    if (card.answer.find(L"{{c") != std::wstring::npos) {
+        findings.push_back({LintRule::MalformedCloze, offset, id,
+                            "cloze markers in the answer are shown literally"});
+    }
+
+    const std::pair<const char*, size_t> sides[] = {{"question", card.question.size()},
+                                                    {"answer", card.answer.size()}};
+    for (const auto& [side, length] : sides) {
+        if (length > options.maxTextLength) {
+            findings.push_back({LintRule::OverlongText, offset, id,
+                                std::string(side) + " is " + std::to_string(length) +
+                                    " characters long, over the limit of " +
+                                    std::to_string(options.maxTextLength)});
+        }
+    }
+}
+
+void CheckBatch(LintBatch& batch, const LintOptions& options) {
+    batch.idEnds.reserve(batch.cards.size());
+    batch.offsets.reserve(batch.cards.size());
+    for (size_t i = 0; i < batch.cards.size(); ++i) {
+        const Card& card = batch.cards[i];
+        const uint64_t offset = static_cast<uint64_t>(card.sourceOffset);
+        const std::string id = ToUtf8(card.id);
+        if (id.empty()) {
+            batch.findings.push_back({LintRule::MissingId, offset, id, "card has no id"});
+        } else {
+            const uint64_t hash = Xxh64(id, 0);
+            batch.keys[hash >> (64 - ID_PARTITION_BITS)].push_back(
+                {hash, batch.firstOrdinal + i});
+        }
+        batch.ids += id;
+        batch.idEnds.push_back(static_cast<uint32_t>(batch.ids.size()));
+        batch.offsets.push_back(offset);
+        CheckText(card, id, offset, options, batch.findings);
+    }
+    std::vector<Card>().swap(batch.cards);
+}
+
+// Checks batches on worker threads as the caller parses them; at most
+// LINT_QUEUE_DEPTH batches per thread wait, so memory stays bounded.
+class BatchChecker {
+public:
+    BatchChecker(const LintOptions& lintOptions, size_t threadCount) : options(lintOptions) {
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this]() { Run(); });
+        }
+    }
+
+    ~BatchChecker() { Finish(); }
+
+    void Submit(LintBatch* batch) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock,
+                     [this]() { return pending.size() < LINT_QUEUE_DEPTH * workers.size(); });
+        pending.push_back(batch);
+        changed.notify_all();
+    }
+
+    void Finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        for (std::thread& worker : workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+private:
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [this]() { return !pending.empty() || stopping; });
+            if (pending.empty()) {
+                return;
+            }
+            LintBatch* batch = pending.front();
+            pending.pop_front();
+            changed.notify_all();
+            lock.unlock();
+            CheckBatch(*batch, options);
+            lock.lock();
+        }
+    }
+
+    const LintOptions& options;
+    std::mutex mutex{};
+    std::condition_variable changed{};
+    std::deque<LintBatch*> pending{};
+    bool stopping{false};
+    std::vector<std::thread> workers{};
+};
+
+// Sorts one hash partition and reports every card whose id an earlier card
+// already has. Equal hashes are confirmed on the ids themselves.
+void FindDuplicateIds(const std::vector<std::unique_ptr<LintBatch>>& batches, size_t partition,
+                      std::vector<Finding>& findings) {
+    std::vector<IdKey> keys;
+    for (const auto& batch : batches) {
+        keys.insert(keys.end(), batch->keys[partition].begin(), batch->keys[partition].end());
+    }
+    std::sort(keys.begin(), keys.end(), [](const IdKey& left, const IdKey& right) {
+        return left.hash != right.hash ? left.hash < right.hash : left.ordinal < right.ordinal;
+    });
+
+    const auto locate = [&](uint64_t ordinal) {
+        return std::make_pair(batches[ordinal / LINT_BATCH_CARDS].get(),
+                              static_cast<size_t>(ordinal % LINT_BATCH_CARDS));
+    };
+    for (size_t begin = 0, end = 0; begin < keys.size(); begin = end) {
+        for (end = begin + 1; end < keys.size() && keys[end].hash == keys[begin].hash; ++end) {
+        }
+        for (size_t i = begin + 1; i < end; ++i) {
+            const auto [batch, local] = locate(keys[i].ordinal);
+            const std::string_view id = batch->Id(local);
+            for (size_t first = begin; first < i; ++first) {
+                const auto [firstBatch, firstLocal] = locate(keys[first].ordinal);
+                if (firstBatch->Id(firstLocal) == id) {
+                    findings.push_back({LintRule::DuplicateId, batch->offsets[local],
+                                        std::string(id), {}, firstBatch->offsets[firstLocal]});
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Runs task(0), task(1), ... task(count - 1) on up to threadCount threads.
+template <typename Task>
+void RunInParallel(size_t count, size_t threadCount, const Task& task) {
+    std::atomic<size_t> next{0};
+    const auto run = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            task(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(threadCount, count); ++i) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+}
+
+LintSeverity LintRuleSeverity(LintRule rule) {
+    switch (rule) {
+    case LintRule::MalformedCloze:
+    case LintRule::OverlongText:
+        return LintSeverity::Warning;
+    default:
+        return LintSeverity::Error;
+    }
+}
+
+const char* LintRuleName(LintRule rule) {
+    switch (rule) {
+    case LintRule::MissingId:
+        return "missing-id";
+    case LintRule::DuplicateId:
+        return "duplicate-id";
+    case LintRule::EmptyQuestion:
+        return "empty-question";
+    case LintRule::EmptyAnswer:
+        return "empty-answer";
+    case LintRule::MalformedCloze:
+        return "malformed-cloze";
+    case LintRule::OverlongText:
+        return "overlong-text";
+    }
+    return "unknown";
+}
+
+bool LintDeckFile(const std::filesystem::path& path, const LintOptions& options,
+                  LintReport& report, std::string& error) {
+    report = LintReport{};
+    MappedFile file;
+    if (!file.Open(path, MapOptions{})) {
+        error = "cannot map " + path.string();
+        return false;
+    }
+    const std::string_view text = file.View();
+    report.hasLines = !IsBinaryDeck(text);
+
+    const size_t threadCount =
+        options.threads != 0 ? options.threads
+                             : std::max<size_t>(1, std::thread::hardware_concurrency());
+    std::vector<std::unique_ptr<LintBatch>> batches;
+    {
+        BatchChecker checker(options, threadCount);
+        auto batch = std::make_unique<LintBatch>();
+        size_t released = 0;
+        Deck rest;
+        StreamDeckEntries(
+            text, path,
+            [&](Card& card, CardFieldList&, size_t consumed) {
+                batch->cards.push_back(std::move(card));
+                if (batch->cards.size() == LINT_BATCH_CARDS) {
+                    checker.Submit(batch.get());
+                    batches.push_back(std::move(batch));
+                    batch = std::make_unique<LintBatch>();
+                    batch->firstOrdinal = batches.size() * LINT_BATCH_CARDS;
+                }
+                if (consumed >= released + RELEASE_STRIDE) {
+                    file.Release(consumed);
+                    released = consumed;
+                }
+                return true;
+            },
+            rest);
+        if (!batch->cards.empty()) {
+            checker.Submit(batch.get());
+            batches.push_back(std::move(batch));
+        }
+        checker.Finish();
+    }
+
+    std::vector<Finding> findings;
+    for (const auto& batch : batches) {
+        report.cardsChecked += batch->offsets.size();
+        std::move(batch->findings.begin(), batch->findings.end(), std::back_inserter(findings));
+    }
+    std::vector<std::vector<Finding>> duplicates(ID_PARTITIONS);
+    RunInParallel(ID_PARTITIONS, threadCount, [&](size_t partition) {
+        FindDuplicateIds(batches, partition, duplicates[partition]);
+    });
+    batches.clear();
+    for (std::vector<Finding>& partition : duplicates) {
+        std::move(partition.begin(), partition.end(), std::back_inserter(findings));
+    }
+    std::stable_sort(findings.begin(), findings.end(),
+                     [](const Finding& left, const Finding& right) {
+                         return left.offset < right.offset;
+                     });
+
+    // Line numbers for every offset that is reported, counted in one pass.
+    std::vector<uint64_t> offsets;
+    for (const Finding& finding : findings) {
+        offsets.push_back(finding.offset);
+        offsets.push_back(finding.firstOffset);
+    }
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    std::vector<size_t> lines(offsets.size());
+    size_t line = 1;
+    size_t counted = 0;
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        if (report.hasLines) {
+            const size_t offset = std::min<size_t>(offsets[i], text.size());
+            line += static_cast<size_t>(std::count(text.begin() + counted, text.begin() + offset,
+                                                   '\n'));
+            counted = offset;
+            lines[i] = line;
+        } else {
+            lines[i] = static_cast<size_t>(offsets[i]) + 1;
+        }
+    }
+    const auto lineOf = [&](uint64_t offset) {
+        return lines[std::lower_bound(offsets.begin(), offsets.end(), offset) - offsets.begin()];
+    };
+
+    report.diagnostics.reserve(findings.size());
+    for (Finding& finding : findings) {
+        LintDiagnostic diagnostic;
+        diagnostic.rule = finding.rule;
+        diagnostic.line = lineOf(finding.offset);
+        diagnostic.cardId = std::move(finding.cardId);
+        diagnostic.message = std::move(finding.message);
+        if (finding.rule == LintRule::DuplicateId) {
+            diagnostic.message = std::string("id is already used by the card ") +
+                                 (report.hasLines ? "at line " : "number ") +
+                                 std::to_string(lineOf(finding.firstOffset));
+        }
+        report.diagnostics.push_back(std::move(diagnostic));
+    }
+    return true;
+}
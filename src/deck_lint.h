@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Checks every card entry of a deck for the problems that otherwise only
+// show up during review, or not at all because loaders skip the card. The
+// deck is streamed in batches that worker threads check while the next
+// batch is parsed; duplicate ids are then found per hash partition, also in
+// parallel. Entries are located by their byte offset while parsing and
+// converted to line numbers in one pass at the end.
+
+enum class LintSeverity { Error, Warning };
+
+enum class LintRule {
+    MissingId,       // skipped by loaders
+    DuplicateId,     // history, patches and exports cannot tell the cards apart
+    EmptyQuestion,   // skipped by loaders
+    EmptyAnswer,     // skipped by loaders; cloze cards need no answer
+    MalformedCloze,  // "{{c" that does not form a gap is shown literally
+    OverlongText,    // question or answer longer than LintOptions allow
+};
+
+struct LintOptions {
+    // Longest question or answer, in characters, before OverlongText.
+    size_t maxTextLength{2000};
+    // Checking threads; 0 uses one per hardware thread.
+    size_t threads{0};
+};
+
+struct LintDiagnostic {
+    LintRule rule{LintRule::MissingId};
+    // 1-based line the card's entry starts on; its 1-based card number in
+    // packed decks, which have no lines.
+    size_t line{0};
+    std::string cardId{};
+    std::string message{};
+};
+
+struct LintReport {
+    size_t cardsChecked{0};
+    bool hasLines{true};
+    // In deck order.
+    std::vector<LintDiagnostic> diagnostics{};
+};
+
+LintSeverity LintRuleSeverity(LintRule rule);
+
+// Short name such as "duplicate-id", printed with each diagnostic.
+const char* LintRuleName(LintRule rule);
+
+bool LintDeckFile(const std::filesystem::path& path, const LintOptions& options,
+                  LintReport& report, std::string& error);
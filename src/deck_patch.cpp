@@ -0,0 +1,280 @@
+#include "deck_patch.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "checksum.h"
+
+static_assert(sizeof(DeckPatchHeader) == 40, "header layout is part of the file format");
+static_assert(sizeof(DeckPatchEntry) == 16, "entry layout is part of the file format");
+
+namespace {
+std::unordered_map<std::wstring, size_t> IndexById(const std::vector<Card>& cards) {
+    std::unordered_map<std::wstring, size_t> index;
+    index.reserve(cards.size());
+    for (size_t i = 0; i < cards.size(); ++i) {
+        index.emplace(cards[i].id, i);
+    }
+    return index;
+}
+
+template <typename Value>
+void AppendBytes(const Value& value, std::string& out) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+}
+
+uint64_t CardContentHash(const Card& card) {
+    std::string bytes = ToUtf8(card.id);
+    bytes += '\0';
+    bytes += ToUtf8(card.question);
+    bytes += '\0';
+    bytes += ToUtf8(card.answer);
+    bytes += '\0';
+    bytes += card.reverse ? '1' : '0';
+    return Xxh64(bytes, 0);
+}
+
+uint64_t DeckContentHash(const std::vector<Card>& cards) {
+    uint64_t hash = 0;
+    for (const Card& card : cards) {
+        hash += CardContentHash(card);
+    }
+    return hash;
+}
+
+void ApplyPatchFields(const PatchOperation& operation, Card& card) {
+    if ((operation.fields & PATCH_FIELD_QUESTION) != 0) {
+        card.question = operation.question;
+        ParseClozeGaps(card.question, card.clozeGaps);
+    }
+    if ((operation.fields & PATCH_FIELD_ANSWER) != 0) {
+        card.answer = operation.answer;
+    }
+    if ((operation.fields & PATCH_FIELD_REVERSE) != 0) {
+        card.reverse = operation.reverse;
+    }
+    card.fingerprint = CardFingerprint(card.question, card.answer);
+}
+
+DeckPatch DiffDecks(const Deck& base, const Deck& target) {
+    DeckPatch patch;
+    patch.baseHash = DeckContentHash(base.cards);
+    patch.resultHash = DeckContentHash(target.cards);
+
+    const auto baseIndex = IndexById(base.cards);
+    const auto targetIndex = IndexById(target.cards);
+    for (const Card& card : base.cards) {
+        const auto found = targetIndex.find(card.id);
+        if (found == targetIndex.end()) {
+            PatchOperation operation;
+            operation.kind = PatchKind::Delete;
+            operation.id = card.id;
+            patch.operations.push_back(std::move(operation));
+            continue;
+        }
+
+        const Card& updated = target.cards[found->second];
+        PatchOperation operation;
+        operation.kind = PatchKind::Replace;
+        operation.id = card.id;
+        if (updated.question != card.question) {
+            operation.fields |= PATCH_FIELD_QUESTION;
+            operation.question = updated.question;
+        }
+        if (updated.answer != card.answer) {
+            operation.fields |= PATCH_FIELD_ANSWER;
+            operation.answer = updated.answer;
+        }
+        if (updated.reverse != card.reverse) {
+            operation.fields |= PATCH_FIELD_REVERSE;
+            operation.reverse = updated.reverse;
+        }
+        if (operation.fields != 0) {
+            patch.operations.push_back(std::move(operation));
+        }
+    }
+
+    for (const Card& card : target.cards) {
+        if (baseIndex.count(card.id) == 0) {
+            PatchOperation operation;
+            operation.kind = PatchKind::Insert;
+            operation.fields = PATCH_FIELD_QUESTION | PATCH_FIELD_ANSWER | PATCH_FIELD_REVERSE;
+            operation.reverse = card.reverse;
+            operation.id = card.id;
+            operation.question = card.question;
+            operation.answer = card.answer;
+            patch.operations.push_back(std::move(operation));
+        }
+    }
+    return patch;
+}
+
+bool WriteDeckPatch(const DeckPatch& patch, const std::filesystem::path& path) {
+    std::string payload;
+    for (const PatchOperation& operation : patch.operations) {
+        const std::string id = ToUtf8(operation.id);
+        const std::string question = ToUtf8(operation.question);
+        const std::string answer = ToUtf8(operation.answer);
+        const DeckPatchEntry entry{operation.kind,
+                                   operation.fields,
+                                   static_cast<uint8_t>(operation.reverse ? 1 : 0),
+                                   0,
+                                   static_cast<uint32_t>(id.size()),
+                                   static_cast<uint32_t>(question.size()),
+                                   static_cast<uint32_t>(answer.size())};
+        AppendBytes(entry, payload);
+        payload += id;
+        payload += question;
+        payload += answer;
+    }
+
+    DeckPatchHeader header{};
+    std::memcpy(header.magic, DECK_PATCH_MAGIC, sizeof(header.magic));
+    header.version = DECK_PATCH_VERSION;
+    header.headerSize = sizeof(DeckPatchHeader);
+    header.operationCount = static_cast<uint32_t>(patch.operations.size());
+    header.baseHash = patch.baseHash;
+    header.resultHash = patch.resultHash;
+    header.payloadCrc = Crc32c(payload, 0);
+    header.headerCrc = Crc32c(std::string_view(reinterpret_cast<const char*>(&header),
+                                               offsetof(DeckPatchHeader, headerCrc)),
+                              0);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    return static_cast<bool>(out.flush());
+}
+
+bool ReadDeckPatch(std::string_view data, DeckPatch& patch, std::string& error) {
+    DeckPatchHeader header{};
+    if (data.size() < sizeof(header) ||
+        data.substr(0, sizeof(DECK_PATCH_MAGIC)) !=
+            std::string_view(DECK_PATCH_MAGIC, sizeof(DECK_PATCH_MAGIC))) {
+        error = "not a deck patch";
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.version != DECK_PATCH_VERSION) {
+        error = "unsupported patch version " + std::to_string(header.version);
+        return false;
+    }
+    if (header.headerSize < sizeof(header) || header.headerSize > data.size() ||
+        Crc32c(data.substr(0, offsetof(DeckPatchHeader, headerCrc)), 0) != header.headerCrc) {
+        error = "patch header checksum mismatch";
+        return false;
+    }
+    std::string_view payload = data.substr(header.headerSize);
+    if (Crc32c(payload, 0) != header.payloadCrc) {
+        error = "patch checksum mismatch";
+        return false;
+    }
+
+    patch = DeckPatch{};
+    patch.baseHash = header.baseHash;
+    patch.resultHash = header.resultHash;
+    patch.operations.reserve(header.operationCount);
+    for (uint32_t i = 0; i < header.operationCount; ++i) {
+        DeckPatchEntry entry{};
+        if (payload.size() < sizeof(entry)) {
+            error = "truncated patch";
+            return false;
+        }
+        std::memcpy(&entry, payload.data(), sizeof(entry));
+        payload.remove_prefix(sizeof(entry));
+        const uint64_t textSize =
+            uint64_t{entry.idLength} + entry.questionLength + entry.answerLength;
+        if (textSize > payload.size() ||
+            (entry.kind != PatchKind::Insert && entry.kind != PatchKind::Delete &&
+             entry.kind != PatchKind::Replace)) {
+            error = "malformed patch operation " + std::to_string(i);
+            return false;
+        }
+
+        PatchOperation operation;
+        operation.kind = entry.kind;
+        operation.fields = entry.fields;
+        operation.reverse = entry.reverse != 0;
+        operation.id = ToWide(payload.substr(0, entry.idLength));
+        operation.question = ToWide(payload.substr(entry.idLength, entry.questionLength));
+        operation.answer = ToWide(
+            payload.substr(entry.idLength + entry.questionLength, entry.answerLength));
+        payload.remove_prefix(static_cast<size_t>(textSize));
+        patch.operations.push_back(std::move(operation));
+    }
+    return true;
+}
+
+bool ApplyDeckPatch(Deck& deck, const DeckPatch& patch, std::string& error) {
+    uint64_t hash = DeckContentHash(deck.cards);
+    if (hash != patch.baseHash) {
+        error = "patch does not apply to this version of the deck";
+        return false;
+    }
+
+    // Check every operation and the resulting hash before changing anything.
+    const auto index = IndexById(deck.cards);
+    std::unordered_set<std::wstring> touched;
+    for (const PatchOperation& operation : patch.operations) {
+        const auto found = index.find(operation.id);
+        const bool exists = found != index.end();
+        if (exists != (operation.kind != PatchKind::Insert) ||
+            !touched.insert(operation.id).second) {
+            error = "patch does not match card " + ToUtf8(operation.id);
+            return false;
+        }
+
+        if (operation.kind == PatchKind::Insert) {
+            Card inserted{};
+            inserted.id = operation.id;
+            ApplyPatchFields(operation, inserted);
+            hash += CardContentHash(inserted);
+            continue;
+        }
+        const Card& card = deck.cards[found->second];
+        hash -= CardContentHash(card);
+        if (operation.kind == PatchKind::Replace) {
+            Card updated = card;
+            ApplyPatchFields(operation, updated);
+            hash += CardContentHash(updated);
+        }
+    }
+    if (hash != patch.resultHash) {
+        error = "patched deck does not match the patch's content hash";
+        return false;
+    }
+
+    std::vector<bool> deleted(deck.cards.size(), false);
+    for (const PatchOperation& operation : patch.operations) {
+        if (operation.kind == PatchKind::Insert) {
+            Card inserted{};
+            inserted.id = operation.id;
+            ApplyPatchFields(operation, inserted);
+            deck.cards.push_back(std::move(inserted));
+        } else if (operation.kind == PatchKind::Replace) {
+            ApplyPatchFields(operation, deck.cards[index.at(operation.id)]);
+        } else {
+            deleted[index.at(operation.id)] = true;
+        }
+    }
+
+    std::vector<size_t> kept;
+    kept.reserve(deck.cards.size());
+    for (size_t i = 0; i < deck.cards.size(); ++i) {
+        if (i >= deleted.size() || !deleted[i]) {
+            if (kept.size() != i) {
+                deck.cards[kept.size()] = std::move(deck.cards[i]);
+            }
+            kept.push_back(i);
+        }
+    }
+    if (kept.size() != deck.cards.size()) {
+        deck.cards.resize(kept.size());
+        deck.fields = SelectCardFields(deck.fields, kept);
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "deck.h"
+
+// A patch turns one version of a deck into another by card id. It names the
+// content hash of the deck it applies to and of the deck it produces, so a
+// patch for the wrong version is rejected before anything is changed.
+// Display templates are not part of a patch.
+//
+// A .qapatch file is a DeckPatchHeader followed by operationCount entries
+// of a DeckPatchEntry and its UTF-8 id, question and answer bytes.
+
+constexpr char DECK_PATCH_MAGIC[8] = {'Q', 'A', 'P', 'A', 'T', 'C', 'H', '\n'};
+constexpr uint16_t DECK_PATCH_VERSION = 1;
+
+enum class PatchKind : uint8_t { Insert = 1, Delete = 2, Replace = 3 };
+
+// Fields a Replace changes; an Insert sets all of them.
+constexpr uint8_t PATCH_FIELD_QUESTION = 1u << 0;
+constexpr uint8_t PATCH_FIELD_ANSWER = 1u << 1;
+constexpr uint8_t PATCH_FIELD_REVERSE = 1u << 2;
+
+struct PatchOperation {
+    PatchKind kind{PatchKind::Insert};
+    uint8_t fields{0};
+    bool reverse{false};
+    std::wstring id{};
+    std::wstring question{};
+    std::wstring answer{};
+};
+
+struct DeckPatch {
+    uint64_t baseHash{0};
+    uint64_t resultHash{0};
+    std::vector<PatchOperation> operations{};
+};
+
+struct DeckPatchHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t operationCount;
+    uint64_t baseHash;
+    uint64_t resultHash;
+    // CRC32C of everything after the header, and of the header bytes before
+    // headerCrc.
+    uint32_t payloadCrc;
+    uint32_t headerCrc;
+};
+
+struct DeckPatchEntry {
+    PatchKind kind;
+    uint8_t fields;
+    uint8_t reverse;
+    uint8_t reserved;
+    uint32_t idLength;
+    uint32_t questionLength;
+    uint32_t answerLength;
+};
+
+// XXH64 of a card's id, question, answer and direction flag.
+uint64_t CardContentHash(const Card& card);
+
+// Wrapping sum of the card hashes: independent of card order, so applying a
+// patch updates it from the changed cards alone.
+uint64_t DeckContentHash(const std::vector<Card>& cards);
+
+// Applies the fields a Replace (or Insert) operation sets to card and
+// refreshes its fingerprint.
+void ApplyPatchFields(const PatchOperation& operation, Card& card);
+
+// Operations turning base into target: deletions and replacements in base
+// order, then insertions in target order. Both decks need their bodies.
+DeckPatch DiffDecks(const Deck& base, const Deck& target);
+
+bool WriteDeckPatch(const DeckPatch& patch, const std::filesystem::path& path);
+bool ReadDeckPatch(std::string_view data, DeckPatch& patch, std::string& error);
+
+// Applies patch to the cards of a fully loaded deck; deleted cards are
+// removed along with their extra fields and inserted ones appended. Leaves
+// deck unchanged on failure.
+bool ApplyDeckPatch(Deck& deck, const DeckPatch& patch, std::string& error);
@@ -0,0 +1,2020 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "binary_deck.h"
+#include "card_clusters.h"
+#include "checksum.h"
+#include "deck.h"
+#include "deck_export.h"
+#include "deck_jsonl.h"
+#include "deck_lint.h"
+#include "deck_patch.h"
+#include "mapped_file.h"
+#include "recall_model.h"
+#include "retention_curves.h"
+#include "review_cohort.h"
+#include "review_log.h"
+#include "review_rollups.h"
+#include "review_sketches.h"
+#include "review_stats.h"
+#include "session_fatigue.h"
+
+namespace {
+void PrintUsage() {
+    std::cerr << "Usage:\n"
+              << "  DeckTool embed <deck> <output.h>\n"
+              << "  DeckTool pack <deck> <output.qadeck> [--compress]\n"
+              << "  DeckTool unpack <deck.qadeck> <output.yaml>\n"
+              << "  DeckTool verify <deck.qadeck>\n"
+              << "  DeckTool lint <deck> [--max-length <chars>] [--threads <n>]\n"
+              << "  DeckTool diff <old deck> <new deck> <output.qapatch>\n"
+              << "  DeckTool patch <deck> <patch.qapatch>\n"
+              << "  DeckTool migrate <deck> <answers.log> [output | --replace]\n"
+              << "  DeckTool stats <deck> <answers.log> [output.csv]\n"
+              << "  DeckTool latency <deck> <answers.log>... [--csv <output.csv>]\n"
+              << "  DeckTool activity <answers.log> [--by day|week|month] [--from <date>]\n"
+              << "                    [--to <date>] [--snapshot <answers.rollup>]\n"
+              << "  DeckTool hardest <answers.log>... [--top <k>] [--daily]\n"
+              << "  DeckTool cluster <deck> <answers.log> <output.yaml> [--k <tiers>]\n"
+              << "                   [--field <name>] [--overwrite] [--min-reviews <n>]\n"
+              << "                   [--threads <n>]\n"
+              << "  DeckTool range <answers.log> <from> <to> [--count]\n"
+              << "  DeckTool cohort <deck> <answers.log>... [--from <date>] [--to <date>]\n"
+              << "                  [--top <n>] [--min-reviews <n>] [--threads <n>] [--csv <out>]\n"
+              << "  DeckTool retention <deck> <answers.log>... [--by <field>] [--threads <n>]\n"
+              << "                     [--csv <output.csv>]\n"
+              << "  DeckTool recall-model <deck> <answers.log> [--holdout <share>] [--epochs <n>]\n"
+              << "                        [--batch <n>] [--threads <n>]\n"
+              << "  DeckTool fatigue <answers.log> [--gap <minutes>] [--warmup <n>]\n"
+              << "                   [--threshold <h>]\n"
+              << "  DeckTool export <deck> <output> [--format yaml|jsonl|csv] [--id-prefix <p>]\n"
+              << "                  [--field <name>] [--rated good|meh|bad] [--log <answers.log>]\n"
+              << "  DeckTool bench-map <deck.yaml>\n"
+              << "  DeckTool bench-cloze [card count]\n"
+              << "  DeckTool bench-template [card count] [template]\n"
+              << "  DeckTool bench-jsonl <deck.yaml> [runs]\n"
+              << "  DeckTool bench-stats [review count] [card count]\n"
+              << "  DeckTool bench-cluster [card count] [tiers]\n"
+              << "  DeckTool selfcheck-patch <scratch.qadeck> [card count]\n";
+}
+
+using Clock = std::chrono::steady_clock;
+
+double ElapsedMilliseconds(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Parses a flag's value as a whole decimal count that fits in T.
+template <typename T>
+bool ParseFlagCount(const std::string& value, T& count) {
+    uint64_t parsed = 0;
+    const char* end = value.data() + value.size();
+    const auto [stop, error] = std::from_chars(value.data(), end, parsed);
+    if (error != std::errc{} || stop != end || parsed > std::numeric_limits<T>::max()) {
+        return false;
+    }
+    count = static_cast<T>(parsed);
+    return true;
+}
+
+// Parses a flag's value as a whole, finite decimal number.
+bool ParseFlagNumber(const std::string& value, double& number) {
+    char* end = nullptr;
+    const double parsed = std::strtod(value.c_str(), &end);
+    if (value.empty() || end != value.c_str() + value.size() || !std::isfinite(parsed)) {
+        return false;
+    }
+    number = parsed;
+    return true;
+}
+
+// Best effort: without it every run after the first reads from a warm page cache.
+bool DropFromPageCache(const std::string& path) {
+#if defined(POSIX_FADV_DONTNEED)
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool dropped = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return dropped;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+int RunEmbed(const std::vector<std::string>& args) {
+    if (args.size() != 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    const Deck deck = LoadDeckFile(args[0], 0);
+    if (deck.cards.empty()) {
+        std::cerr << "DeckTool: no cards loaded from " << args[0] << "\n";
+        return 1;
+    }
+    if (!deck.generators.empty()) {
+        std::cerr << "DeckTool: warning: generators in " << args[0]
+                  << " are not embedded; load the deck at runtime to use them\n";
+    }
+
+    if (!WriteEmbeddedDeckHeader(deck, "EMBEDDED_DECK", args[1])) {
+        std::cerr << "DeckTool: cannot write " << args[1] << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int RunPack(const std::vector<std::string>& args) {
+    if (args.size() < 2 || args.size() > 3 || (args.size() == 3 && args[2] != "--compress")) {
+        PrintUsage();
+        return 1;
+    }
+
+    const Deck deck = LoadDeckFile(args[0], 0);
+    if (deck.cards.empty()) {
+        std::cerr << "DeckTool: no cards loaded from " << args[0] << "\n";
+        return 1;
+    }
+    if (!deck.generators.empty()) {
+        std::cerr << "DeckTool: warning: generators in " << args[0]
+                  << " are not packed; load the deck at runtime to use them\n";
+    }
+    if (!deck.fields.columns.empty()) {
+        std::cerr << "DeckTool: warning: extra card fields in " << args[0]
+                  << " are not packed; keep the YAML or JSONL deck to retain them\n";
+    }
+
+    BinaryDeckOptions options;
+    options.compress = args.size() == 3;
+    if (!WriteBinaryDeck(deck, options, args[1])) {
+        std::cerr << "DeckTool: cannot write " << args[1] << "\n";
+        return 1;
+    }
+    std::cout << deck.cards.size() << " cards, " << std::filesystem::file_size(args[1])
+              << " bytes\n";
+    return 0;
+}
+
+int RunUnpack(const std::vector<std::string>& args) {
+    if (args.size() != 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    MappedFile file;
+    if (!file.Open(args[0], MapOptions{}) || !IsBinaryDeck(file.View())) {
+        std::cerr << "DeckTool: " << args[0] << " is not a packed deck\n";
+        return 1;
+    }
+    const Deck deck = ParseBinaryDeck(file.View(), 0);
+
+    std::ofstream out(args[1], std::ios::binary | std::ios::trunc);
+    const std::string yaml = DeckToYaml(deck);
+    if (!out.write(yaml.data(), static_cast<std::streamsize>(yaml.size()))) {
+        std::cerr << "DeckTool: cannot write " << args[1] << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Checks every checksum of a packed deck and reports the rate they were
+// checked at, which is bounded by memory bandwidth once the file is cached.
+int RunVerify(const std::vector<std::string>& args) {
+    if (args.size() != 1) {
+        PrintUsage();
+        return 1;
+    }
+
+    MappedFile file;
+    if (!file.Open(args[0], MapOptions{false, PrefaultMode::Populate})) {
+        std::cerr << "DeckTool: cannot map " << args[0] << "\n";
+        return 1;
+    }
+
+    std::vector<BinaryDeckSectionCheck> sections;
+    std::string error;
+    const auto start = Clock::now();
+    const bool valid = VerifyBinaryDeck(file.View(), sections, error);
+    const double ms = ElapsedMilliseconds(start);
+
+    for (const BinaryDeckSectionCheck& section : sections) {
+        std::cout << std::left << std::setw(14) << BinaryDeckSectionName(section.type)
+                  << std::right << std::setw(14) << section.size << "  "
+                  << (section.valid ? "ok" : "CORRUPT") << "\n";
+    }
+    const double gigabytes = static_cast<double>(file.View().size()) / 1e9;
+    std::cout << std::fixed << std::setprecision(3) << ms << " ms, "
+              << (ms > 0 ? gigabytes * 1000.0 / ms : 0.0) << " GB/s, CRC32C "
+              << (HasHardwareCrc32c() ? "hardware" : "software") << "\n";
+    if (!valid) {
+        std::cerr << "DeckTool: " << args[0] << ": " << error << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Reports problems in every card entry, compiler style; fails if any is an
+// error.
+int RunLint(const std::vector<std::string>& args) {
+    if (args.empty() || args.size() % 2 != 1) {
+        PrintUsage();
+        return 1;
+    }
+
+    LintOptions options;
+    for (size_t i = 1; i < args.size(); i += 2) {
+        const std::string& flag = args[i];
+        const std::string& value = args[i + 1];
+        bool parsed = false;
+        if (flag == "--max-length") {
+            parsed = ParseFlagCount(value, options.maxTextLength);
+        } else if (flag == "--threads") {
+            parsed = ParseFlagCount(value, options.threads);
+        }
+        if (!parsed) {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    LintReport report;
+    std::string error;
+    const auto start = Clock::now();
+    if (!LintDeckFile(args[0], options, report, error)) {
+        std::cerr << "DeckTool: " << error << "\n";
+        return 1;
+    }
+    const double ms = ElapsedMilliseconds(start);
+
+    size_t errors = 0;
+    for (const LintDiagnostic& diagnostic : report.diagnostics) {
+        const bool isError = LintRuleSeverity(diagnostic.rule) == LintSeverity::Error;
+        errors += isError ? 1 : 0;
+        std::cout << args[0] << (report.hasLines ? ":" : ": card ") << diagnostic.line << ": "
+                  << (isError ? "error: " : "warning: ")
+                  << (diagnostic.cardId.empty() ? "" : diagnostic.cardId + ": ")
+                  << diagnostic.message << " [" << LintRuleName(diagnostic.rule) << "]\n";
+    }
+    std::cout << report.cardsChecked << " cards checked, " << errors << " errors, "
+              << report.diagnostics.size() - errors << " warnings in " << std::fixed
+              << std::setprecision(1) << ms << " ms\n";
+    return errors == 0 ? 0 : 1;
+}
+
+int RunDiff(const std::vector<std::string>& args) {
+    if (args.size() != 3) {
+        PrintUsage();
+        return 1;
+    }
+
+    const Deck base = LoadDeckFile(args[0], 0);
+    const Deck target = LoadDeckFile(args[1], 0);
+    const DeckPatch patch = DiffDecks(base, target);
+    if (!WriteDeckPatch(patch, args[2])) {
+        std::cerr << "DeckTool: cannot write " << args[2] << "\n";
+        return 1;
+    }
+
+    size_t counts[4] = {};
+    for (const PatchOperation& operation : patch.operations) {
+        ++counts[static_cast<size_t>(operation.kind)];
+    }
+    std::cout << counts[static_cast<size_t>(PatchKind::Insert)] << " inserted, "
+              << counts[static_cast<size_t>(PatchKind::Delete)] << " deleted, "
+              << counts[static_cast<size_t>(PatchKind::Replace)] << " replaced, "
+              << std::filesystem::file_size(args[2]) << " bytes\n";
+    return 0;
+}
+
+// Packed decks are patched in place; text decks are loaded, patched and
+// written back in the same format.
+int RunPatch(const std::vector<std::string>& args) {
+    if (args.size() != 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    DeckPatch patch;
+    std::string error;
+    {
+        MappedFile patchFile;
+        if (!patchFile.Open(args[1], MapOptions{}) ||
+            !ReadDeckPatch(patchFile.View(), patch, error)) {
+            std::cerr << "DeckTool: " << args[1] << ": " << (error.empty() ? "cannot map" : error)
+                      << "\n";
+            return 1;
+        }
+    }
+
+    bool binary = false;
+    {
+        MappedFile deckFile;
+        if (!deckFile.Open(args[0], MapOptions{})) {
+            std::cerr << "DeckTool: cannot map " << args[0] << "\n";
+            return 1;
+        }
+        binary = IsBinaryDeck(deckFile.View());
+    }
+
+    const auto start = Clock::now();
+    if (binary) {
+        if (!ApplyBinaryDeckPatch(args[0], patch, error)) {
+            std::cerr << "DeckTool: " << args[0] << ": " << error << "\n";
+            return 1;
+        }
+    } else {
+        Deck deck = LoadDeckFile(args[0], 0);
+        if (!deck.generators.empty()) {
+            std::cerr << "DeckTool: " << args[0]
+                      << " has generators, which would be lost by rewriting it\n";
+            return 1;
+        }
+        if (!ApplyDeckPatch(deck, patch, error)) {
+            std::cerr << "DeckTool: " << args[0] << ": " << error << "\n";
+            return 1;
+        }
+
+        const std::string text = IsJsonlDeckPath(args[0]) ? DeckToJsonl(deck) : DeckToYaml(deck);
+        const std::string temporary = args[0] + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out.write(text.data(), static_cast<std::streamsize>(text.size()))) {
+                std::cerr << "DeckTool: cannot write " << temporary << "\n";
+                return 1;
+            }
+        }
+        std::error_code renameError;
+        std::filesystem::rename(temporary, args[0], renameError);
+        if (renameError) {
+            std::cerr << "DeckTool: cannot replace " << args[0] << ": " << renameError.message()
+                      << "\n";
+            return 1;
+        }
+    }
+    std::cout << patch.operations.size() << " operations applied in " << std::fixed
+              << std::setprecision(3) << ElapsedMilliseconds(start) << " ms\n";
+    return 0;
+}
+
+// Rewrites an answer log for the current deck: records follow cards whose
+// id changed; all others are kept as they are. The result goes to output,
+// or <answers.log>.migrated, and replaces the log only with --replace.
+int RunMigrate(const std::vector<std::string>& args) {
+    const bool replace = args.size() == 3 && args[2] == "--replace";
+    if ((args.size() != 2 && args.size() != 3) ||
+        (args.size() == 3 && !replace && args[2].rfind("--", 0) == 0)) {
+        PrintUsage();
+        return 1;
+    }
+
+    const Deck deck = LoadDeckFile(args[0], 0);
+    if (deck.cards.empty() && deck.generators.empty()) {
+        std::cerr << "DeckTool: no cards loaded from " << args[0] << "\n";
+        return 1;
+    }
+    std::string migrated;
+    MigrationStats stats;
+    const auto start = Clock::now();
+    {
+        MappedFile log;
+        if (!log.Open(args[1], MapOptions{})) {
+            std::cerr << "DeckTool: cannot map " << args[1] << "\n";
+            return 1;
+        }
+        migrated = MigrateReviewLog(log.View(), deck.cards, deck.generators, stats);
+    }
+    const double ms = ElapsedMilliseconds(start);
+
+    const std::string output =
+        replace ? args[1] : args.size() == 3 ? args[2] : args[1] + ".migrated";
+    const std::string temporary = output + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out.write(migrated.data(), static_cast<std::streamsize>(migrated.size()))) {
+            std::cerr << "DeckTool: cannot write " << temporary << "\n";
+            return 1;
+        }
+    }
+    std::error_code renameError;
+    std::filesystem::rename(temporary, output, renameError);
+    if (renameError) {
+        std::cerr << "DeckTool: cannot replace " << output << ": " << renameError.message()
+                  << "\n";
+        return 1;
+    }
+    std::cout << stats.kept << " kept, " << stats.renamed << " renamed, " << stats.unverified
+              << " unverified, " << stats.stale << " stale, " << stats.orphaned << " orphaned in "
+              << std::fixed << std::setprecision(3) << ms << " ms\n";
+    return 0;
+}
+
+// Writes per-card review statistics as CSV, to stdout unless an output is
+// given.
+int RunStats(const std::vector<std::string>& args) {
+    if (args.size() != 2 && args.size() != 3) {
+        PrintUsage();
+        return 1;
+    }
+
+    const Deck deck = LoadDeckFile(args[0], 0);
+    if (deck.cards.empty()) {
+        std::cerr << "DeckTool: no cards loaded from " << args[0] << "\n";
+        return 1;
+    }
+    ReviewHistory history;
+    size_t skipped = 0;
+    {
+        MappedFile log;
+        if (!log.Open(args[1], MapOptions{})) {
+            std::cerr << "DeckTool: cannot map " << args[1] << "\n";
+            return 1;
+        }
+        skipped = LoadReviewHistory(log.View(), deck.cards, history);
+    }
+    const auto start = Clock::now();
+    const std::vector<CardStats> stats = ComputeCardStats(history, deck.cards.size(), 0);
+    const double ms = ElapsedMilliseconds(start);
+
+    std::ostringstream csv;
+    csv << std::fixed << "id,reviews,good,meh,bad,retention,lapses,average_interval_days\n";
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const CardStats& card = stats[i];
+        csv << ToUtf8(deck.cards[i].id) << ',' << ReviewCount(card) << ','
+            << card.counts[static_cast<size_t>(ReviewRating::Good)] << ','
+            << card.counts[static_cast<size_t>(ReviewRating::Meh)] << ','
+            << card.counts[static_cast<size_t>(ReviewRating::Bad)] << ',' << std::setprecision(3)
+            << RetentionRate(card) << ',' << card.lapses << ',' << std::setprecision(2)
+            << AverageIntervalDays(card) << "\n";
+    }
+    if (args.size() == 3) {
+        std::ofstream out(args[2], std::ios::binary | std::ios::trunc);
+        if (!(out << csv.str())) {
+            std::cerr << "DeckTool: cannot write " << args[2] << "\n";
+            return 1;
+        }
+    } else {
+        std::cout << csv.str();
+    }
+    std::cerr << history.cards.size() << " reviews of " << stats.size() << " cards ("
+              << skipped << " records skipped) aggregated in " << std::fixed
+              << std::setprecision(3) << ms << " ms\n";
+    return 0;
+}
+
+// Think and rate time percentiles for each learner's answer log and for all
+// of them together; per-card percentiles over all logs go to a CSV file.
+int RunLatency(const std::vector<std::string>& args) {
+    std::vector<std::string> logs;
+    std::string csvPath;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "--csv" && i + 1 < args.size()) {
+            csvPath = args[++i];
+        } else {
+            logs.push_back(args[i]);
+        }
+    }
+    if (logs.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    const Deck deck = LoadDeckFile(args[0], 0);
+    if (deck.cards.empty()) {
+        std::cerr << "DeckTool: no cards loaded from " << args[0] << "\n";
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(24) << "log" << std::right << std::setw(10) << "timed"
+              << std::setw(12) << "think p50" << std::setw(8) << "p90" << std::setw(8) << "p99"
+              << std::setw(12) << "rate p50" << std::setw(8) << "p90" << std::setw(8) << "p99"
+              << "  (seconds)\n";
+    const auto report = [](const std::string& name, const CardResponseTimes& times) {
+        std::cout << std::left << std::setw(24) << name << std::right << std::setw(10)
+                  << times.think.count << std::fixed << std::setprecision(2);
+        for (const QuantileSketch* sketch : {&times.think, &times.rate}) {
+            std::cout << std::setw(12) << SketchQuantile(*sketch, 0.5) / 1000.0 << std::setw(8)
+                      << SketchQuantile(*sketch, 0.9) / 1000.0 << std::setw(8)
+                      << SketchQuantile(*sketch, 0.99) / 1000.0;
+        }
+        std::cout << "\n";
+    };
+
+    std::vector<CardResponseTimes> cards(deck.cards.size());
+    CardResponseTimes everyone;
+    for (const std::string& logPath : logs) {
+        MappedFile log;
+        if (!log.Open(logPath, MapOptions{})) {
+            std::cerr << "DeckTool: cannot map " << logPath << "\n";
+            return 1;
+        }
+        ReviewHistory history;
+        LoadReviewHistory(log.View(), deck.cards, history);
+        const std::vector<CardResponseTimes> times =
+            ComputeResponseTimes(history, deck.cards.size());
+
+        CardResponseTimes learner;
+        for (size_t i = 0; i < times.size(); ++i) {
+            MergeSketch(learner.think, times[i].think);
+            MergeSketch(learner.rate, times[i].rate);
+            MergeSketch(cards[i].think, times[i].think);
+            MergeSketch(cards[i].rate, times[i].rate);
+        }
+        report(logPath, learner);
+        MergeSketch(everyone.think, learner.think);
+        MergeSketch(everyone.rate, learner.rate);
+    }
+    if (logs.size() > 1) {
+        report("all", everyone);
+    }
+
+    if (!csvPath.empty()) {
+        std::ofstream csv(csvPath, std::ios::binary | std::ios::trunc);
+        csv << "id,timed,think_p50_ms,think_p90_ms,think_p99_ms,rate_p50_ms,rate_p90_ms,"
+               "rate_p99_ms\n"
+            << std::fixed << std::setprecision(0);
+        for (size_t i = 0; i < cards.size(); ++i) {
+            csv << ToUtf8(deck.cards[i].id) << ',' << cards[i].think.count;
+            for (const QuantileSketch* sketch : {&cards[i].think, &cards[i].rate}) {
+                csv << ',' << SketchQuantile(*sketch, 0.5) << ','
+                    << SketchQuantile(*sketch, 0.9) << ',' << SketchQuantile(*sketch, 0.99);
+            }
+            csv << "\n";
+        }
+        if (!csv.flush()) {
+            std::cerr << "DeckTool: cannot write " << csvPath << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// "YYYY-MM-DD" of a ParseReviewTime time.
+std::string FormatReviewDate(uint32_t time) {
+    const uint32_t month = PeriodOf(time, RollupPeriod::Month);
+    const uint32_t day = (time - PeriodStart(month, RollupPeriod::Month)) / 86400 + 1;
+    std::ostringstream text;
+    text << 1970 + month / 12 << '-' << std::setfill('0') << std::setw(2) << month % 12 + 1 << '-'
+         << std::setw(2) << day;
+    return text.str();
+}
+
+// Reviews per day, week or month of an answer log. With --snapshot the
+// rollups are loaded from the snapshot, brought up to date with the lines
+// logged since and saved back.
+int RunActivity(const std::vector<std::string>& args) {
+    if (args.empty() || args.size() % 2 != 1) {
+        PrintUsage();
+        return 1;
+    }
+    RollupPeriod period = RollupPeriod::Day;
+    uint32_t from = 0;
+    uint32_t to = UINT32_MAX;
+    std::string snapshotPath;
+    for (size_t i = 1; i + 1 < args.size(); i += 2) {
+        const std::string& flag = args[i];
+        const std::string& value = args[i + 1];
+        uint32_t date = 0;
+        if (flag == "--by" && (value == "day" || value == "week" || value == "month")) {
+            period = value == "day"    ? RollupPeriod::Day
+                     : value == "week" ? RollupPeriod::Week
+                                       : RollupPeriod::Month;
+        } else if ((flag == "--from" || flag == "--to") &&
+                   ParseReviewTime(value + " 00:00:00", date)) {
+            (flag == "--from" ? from : to) = date;
+        } else if (flag == "--snapshot") {
+            snapshotPath = value;
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    MappedFile log;
+    if (!log.Open(args[0], MapOptions{})) {
+        std::cerr << "DeckTool: cannot map " << args[0] << "\n";
+        return 1;
+    }
+    ActivityRollups rollups;
+    bool reused = false;
+    if (!snapshotPath.empty()) {
+        MappedFile snapshot;
+        reused = snapshot.Open(snapshotPath, MapOptions{}) &&
+                 ParseRollups(snapshot.View(), log.View(), rollups);
+    }
+    const uint64_t snapshotOffset = rollups.logOffset;
+    const auto start = Clock::now();
+    CatchUpRollups(rollups, log.View(), 0);
+    const double ms = ElapsedMilliseconds(start);
+    if (!snapshotPath.empty()) {
+        std::ofstream out(snapshotPath, std::ios::binary | std::ios::trunc);
+        if (!(out << SerializeRollups(rollups, log.View()))) {
+            std::cerr << "DeckTool: cannot write " << snapshotPath << "\n";
+            return 1;
+        }
+    }
+
+    const RollupSeries& series = rollups.series[static_cast<size_t>(period)];
+    const uint32_t first = std::max(series.firstPeriod, PeriodOf(from, period));
+    const uint32_t last =
+        std::min(series.firstPeriod + static_cast<uint32_t>(series.totals.size() / 3),
+                 PeriodOf(to, period) + 1);
+    std::cout << std::left << std::setw(12) << "from" << std::right << std::setw(10) << "reviews"
+              << std::setw(10) << "good" << std::setw(10) << "meh" << std::setw(10) << "bad"
+              << "\n";
+    const auto report = [](const std::string& label, const ActivityCounts& counts) {
+        const auto count = [&](ReviewRating rating) {
+            return counts.counts[static_cast<size_t>(rating)];
+        };
+        std::cout << std::left << std::setw(12) << label << std::right << std::setw(10)
+                  << count(ReviewRating::Good) + count(ReviewRating::Meh) +
+                         count(ReviewRating::Bad)
+                  << std::setw(10) << count(ReviewRating::Good) << std::setw(10)
+                  << count(ReviewRating::Meh) << std::setw(10) << count(ReviewRating::Bad)
+                  << "\n";
+    };
+    for (uint32_t number = first; number < last; ++number) {
+        report(FormatReviewDate(PeriodStart(number, period)),
+               RollupRange(rollups, period, number, number));
+    }
+    if (first < last) {
+        report("total", RollupRange(rollups, period, first, last - 1));
+    }
+    std::cerr << (rollups.logOffset - snapshotOffset) << " log bytes folded in " << std::fixed
+              << std::setprecision(3) << ms << " ms"
+              << (reused ? " on top of the snapshot\n" : "\n");
+    return 0;
+}
+
+// Most failed cards and distinct cards reviewed, per log and over all of
+// them, from sketches rather than exact counts.
+int RunHardest(const std::vector<std::string>& args) {
+    std::vector<std::string> logs;
+    size_t topK = 20;
+    bool daily = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--top" && i + 1 < args.size() && ParseFlagCount(args[i + 1], topK) &&
+            topK != 0) {
+            ++i;
+        } else if (args[i] == "--daily") {
+            daily = true;
+        } else if (args[i].rfind("--", 0) != 0) {
+            logs.push_back(args[i]);
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (logs.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    ReviewLogSketches all;
+    all.failures.capacity = topK;
+    std::cout << std::left << std::setw(24) << "log" << std::right << std::setw(12) << "reviews"
+              << std::setw(16) << "distinct cards" << "\n";
+    const auto start = Clock::now();
+    for (const std::string& logPath : logs) {
+        MappedFile log;
+        if (!log.Open(logPath, MapOptions{})) {
+            std::cerr << "DeckTool: cannot map " << logPath << "\n";
+            return 1;
+        }
+        const ReviewLogSketches sketches = SketchReviewLog(log.View(), topK, 0);
+        std::cout << std::left << std::setw(24) << logPath << std::right << std::setw(12)
+                  << sketches.reviews << std::setw(16)
+                  << std::llround(EstimateDistinct(sketches.cards)) << "\n";
+        MergeReviewLogSketches(all, sketches);
+    }
+    const double ms = ElapsedMilliseconds(start);
+    if (logs.size() > 1) {
+        std::cout << std::left << std::setw(24) << "all" << std::right << std::setw(12)
+                  << all.reviews << std::setw(16) << std::llround(EstimateDistinct(all.cards))
+                  << "\n";
+    }
+
+    std::cout << "\nMost failed cards (estimated bad ratings):\n";
+    for (const HeavyHitter& hitter : TopKeys(all.failures)) {
+        std::cout << std::setw(10) << hitter.count << "  " << hitter.key << "\n";
+    }
+    if (daily) {
+        std::cout << "\n" << std::left << std::setw(12) << "day" << std::right << std::setw(16)
+                  << "distinct cards" << "\n";
+        for (const auto& [day, cards] : all.cardsByDay) {
+            std::cout << std::left << std::setw(12)
+                      << FormatReviewDate(PeriodStart(day, RollupPeriod::Day)) << std::right
+                      << std::setw(16) << std::llround(EstimateDistinct(cards)) << "\n";
+        }
+    }
+    std::cerr << all.reviews << " reviews sketched in " << std::fixed << std::setprecision(3)
+              << ms << " ms\n";
+    return 0;
+}
+
+// Groups the reviewed cards of a deck into difficulty tiers and writes the
+// deck as YAML with each such card's tier, 1 for the easiest, in an extra
+// field. A field the deck already has is replaced only with --overwrite.
+int RunCluster(const std::vector<std::string>& args) {
+    if (args.size() < 3) {
+        PrintUsage();
+        return 1;
+    }
+    ClusterOptions options;
+    std::wstring fieldName = L"tier";
+    uint32_t minReviews = 3;
+    bool overwrite = false;
+    for (size_t i = 3; i < args.size(); ++i) {
+        const std::string& flag = args[i];
+        if (flag == "--overwrite") {
+            overwrite = true;
+        } else if (i + 1 == args.size()) {
+            PrintUsage();
+            return 1;
+        } else if (flag == "--k" && ParseFlagCount(args[i + 1], options.clusters) &&
+                   options.clusters != 0) {
+            ++i;
+        } else if (flag == "--field" && !args[i + 1].empty()) {
+            fieldName = ToWide(args[++i]);
+        } else if (flag == "--min-reviews" && ParseFlagCount(args[i + 1], minReviews)) {
+            ++i;
+        } else if (flag == "--threads" && ParseFlagCount(args[i + 1], options.threads)) {
+            ++i;
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    Deck deck = LoadDeckFile(args[0], 0);
+    if (deck.cards.empty()) {
+        std::cerr << "DeckTool: no cards loaded from " << args[0] << "\n";
+        return 1;
+    }
+    if (!deck.generators.empty()) {
+        std::cerr << "DeckTool: " << args[0]
+                  << " has generators, which would be lost by rewriting it\n";
+        return 1;
+    }
+    if (!overwrite && FindCardField(deck.fields, fieldName) != MISSING_CARD_FIELD) {
+        std::cerr << "DeckTool: " << args[0] << " already has a " << ToUtf8(fieldName)
+                  << " field; pass --overwrite to replace it\n";
+        return 1;
+    }
+    ReviewHistory history;
+    {
+        MappedFile log;
+        if (!log.Open(args[1], MapOptions{})) {
+            std::cerr << "DeckTool: cannot map " << args[1] << "\n";
+            return 1;
+        }
+        LoadReviewHistory(log.View(), deck.cards, history);
+    }
+    const CardFeatures features =
+        BuildCardFeatures(ComputeCardStats(history, deck.cards.size(), options.threads),
+                          ComputeResponseTimes(history, deck.cards.size()), minReviews);
+    const auto start = Clock::now();
+    const ClusterResult result = ClusterCards(features, options);
+    const double ms = ElapsedMilliseconds(start);
+    const std::vector<uint32_t> tiers = RankClustersByDifficulty(result);
+
+    std::vector<size_t> tierSizes(tiers.size());
+    RemoveCardField(deck.fields, fieldName);
+    for (size_t i = 0; i < features.cards.size(); ++i) {
+        const uint32_t tier = tiers[result.assignments[i]];
+        ++tierSizes[tier];
+        AppendCardField(deck.fields, fieldName, features.cards[i], std::to_wstring(tier + 1));
+    }
+    std::ofstream out(args[2], std::ios::binary | std::ios::trunc);
+    if (!(out << DeckToYaml(deck))) {
+        std::cerr << "DeckTool: cannot write " << args[2] << "\n";
+        return 1;
+    }
+
+    for (size_t tier = 0; tier < tierSizes.size(); ++tier) {
+        std::cout << "tier " << tier + 1 << ": " << tierSizes[tier] << " cards\n";
+    }
+    std::cerr << features.cards.size() << " of " << deck.cards.size() << " cards clustered in "
+              << result.iterations << " iterations, " << std::fixed << std::setprecision(3) << ms
+              << " ms\n";
+    return 0;
+}
+
+// A "YYYY-MM-DD[ HH:MM[:SS]]" range end; the missing part is the start of
+// the day or minute for from and its end for to.
+bool ParseRangeTime(const std::string& text, bool end, uint32_t& time) {
+    if (text.size() == 10) {
+        return ParseReviewTime(text + (end ? " 23:59:59" : " 00:00:00"), time);
+    }
+    if (text.size() == 16) {
+        return ParseReviewTime(text + (end ? ":59" : ":00"), time);
+    }
+    return ParseReviewTime(text, time);
+}
+
+// Prints or counts the records of an answer log in a time range, found by
+// bisection so only the matching part of the log is read.
+int RunRange(const std::vector<std::string>& args) {
+    uint32_t from = 0;
+    uint32_t to = 0;
+    if (args.size() < 3 || args.size() > 4 || (args.size() == 4 && args[3] != "--count") ||
+        !ParseRangeTime(args[1], false, from) || !ParseRangeTime(args[2], true, to)) {
+        PrintUsage();
+        return 1;
+    }
+    const bool countOnly = args.size() == 4;
+    MappedFile log;
+    if (!log.Open(args[0], MapOptions{})) {
+        std::cerr << "DeckTool: cannot map " << args[0] << "\n";
+        return 1;
+    }
+    const auto start = Clock::now();
+    const std::string_view range = FindReviewTimeRange(log.View(), from, to);
+    const double searchMs = ElapsedMilliseconds(start);
+
+    uint64_t counts[3]{};
+    for (size_t begin = 0; begin < range.size();) {
+        const size_t end = std::min(range.find('\n', begin), range.size());
+        const std::string_view line = Trim(range.substr(begin, end - begin));
+        begin = end + 1;
+        ReviewRecord record;
+        ReviewRating rating{};
+        if (!ParseReviewRecord(line, record) || !ParseReviewRating(record.rating, rating)) {
+            continue;
+        }
+        ++counts[static_cast<size_t>(rating)];
+        if (!countOnly) {
+            std::cout << line << "\n";
+        }
+    }
+    if (countOnly) {
+        std::cout << counts[0] + counts[1] + counts[2] << " reviews: "
+                  << counts[static_cast<size_t>(ReviewRating::Good)] << " good, "
+                  << counts[static_cast<size_t>(ReviewRating::Meh)] << " meh, "
+                  << counts[static_cast<size_t>(ReviewRating::Bad)] << " bad\n";
+    }
+    std::cerr << range.size() << " of " << log.View().size() << " log bytes found in "
+              << std::fixed << std::setprecision(3) << searchMs << " ms\n";
+    return 0;
+}
+
+// Per-card review counts over the answer logs of many learners, merged in
+// time order and restricted to a date range, with the cards the cohort
+// fails most.
+int RunCohort(const std::vector<std::string>& args) {
+    std::vector<std::filesystem::path> logs;
+    CohortOptions options;
+    size_t top = 20;
+    uint32_t minReviews = 10;
+    std::string csvPath;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& flag = args[i];
+        uint32_t date = 0;
+        if (flag.rfind("--", 0) != 0) {
+            logs.push_back(flag);
+        } else if (i + 1 == args.size()) {
+            PrintUsage();
+            return 1;
+        } else if ((flag == "--from" || flag == "--to") &&
+                   ParseReviewTime(args[i + 1] + " 00:00:00", date)) {
+            // --to names the last day counted.
+            (flag == "--from" ? options.from : options.to) = flag == "--from" ? date : date + 86399;
+            ++i;
+        } else if ((flag == "--top" && ParseFlagCount(args[i + 1], top)) ||
+                   (flag == "--min-reviews" && ParseFlagCount(args[i + 1], minReviews)) ||
+                   (flag == "--threads" && ParseFlagCount(args[i + 1], options.threads))) {
+            ++i;
+        } else if (flag == "--csv") {
+            csvPath = args[++i];
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (logs.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    const Deck deck = LoadDeckFile(args[0], 0);
+    if (deck.cards.empty()) {
+        std::cerr << "DeckTool: no cards loaded from " << args[0] << "\n";
+        return 1;
+    }
+    CohortReport report;
+    std::string error;
+    const auto start = Clock::now();
+    if (!RunCohortQuery(logs, deck.cards, options, report, error)) {
+        std::cerr << "DeckTool: " << error << "\n";
+        return 1;
+    }
+    const double ms = ElapsedMilliseconds(start);
+
+    const auto reviews = [](const CohortCardStats& card) {
+        return card.counts[0] + card.counts[1] + card.counts[2];
+    };
+    std::vector<uint32_t> ranked;
+    for (uint32_t i = 0; i < report.cards.size(); ++i) {
+        if (reviews(report.cards[i]) != 0 && reviews(report.cards[i]) >= minReviews) {
+            ranked.push_back(i);
+        }
+    }
+    const auto failureRate = [&](uint32_t card) {
+        const CohortCardStats& stats = report.cards[card];
+        return double(stats.counts[static_cast<size_t>(ReviewRating::Bad)]) / reviews(stats);
+    };
+    std::stable_sort(ranked.begin(), ranked.end(), [&](uint32_t left, uint32_t right) {
+        return failureRate(left) > failureRate(right);
+    });
+    ranked.resize(std::min(ranked.size(), top));
+
+    std::cout << logs.size() << " learners, " << report.reviews << " reviews, " << report.skipped
+              << " records skipped\n\n"
+              << std::right << std::setw(10) << "reviews" << std::setw(10) << "bad" << std::setw(10)
+              << "failed" << std::setw(12) << "first" << std::setw(12) << "last" << "  id\n";
+    for (const uint32_t card : ranked) {
+        const CohortCardStats& stats = report.cards[card];
+        std::cout << std::setw(10) << reviews(stats) << std::setw(10)
+                  << stats.counts[static_cast<size_t>(ReviewRating::Bad)] << std::setw(9)
+                  << std::fixed << std::setprecision(1) << failureRate(card) * 100.0 << '%'
+                  << std::setw(12) << FormatReviewDate(stats.firstTime) << std::setw(12)
+                  << FormatReviewDate(stats.lastTime) << "  " << ToUtf8(deck.cards[card].id)
+                  << "\n";
+    }
+
+    if (!csvPath.empty()) {
+        std::ofstream csv(csvPath, std::ios::binary | std::ios::trunc);
+        csv << "id,reviews,good,meh,bad,first,last\n";
+        for (size_t i = 0; i < report.cards.size(); ++i) {
+            const CohortCardStats& stats = report.cards[i];
+            if (reviews(stats) == 0) {
+                continue;
+            }
+            csv << ToUtf8(deck.cards[i].id) << ',' << reviews(stats) << ','
+                << stats.counts[static_cast<size_t>(ReviewRating::Good)] << ','
+                << stats.counts[static_cast<size_t>(ReviewRating::Meh)] << ','
+                << stats.counts[static_cast<size_t>(ReviewRating::Bad)] << ','
+                << FormatReviewDate(stats.firstTime) << ',' << FormatReviewDate(stats.lastTime)
+                << "\n";
+        }
+        if (!csv.flush()) {
+            std::cerr << "DeckTool: cannot write " << csvPath << "\n";
+            return 1;
+        }
+    }
+    std::cerr << report.reviews + report.skipped << " records merged in " << std::fixed
+              << std::setprecision(3) << ms << " ms\n";
+    return 0;
+}
+
+// "45s", "2.8m", "6h", "12.5d": a bin start short enough for a table column,
+// in the largest unit that fits. The decimal keeps neighbouring half-octave
+// bins apart.
+std::string FormatElapsed(uint32_t seconds) {
+    const uint32_t units[] = {86400, 3600, 60, 1};
+    const char* names[] = {"d", "h", "m", "s"};
+    size_t unit = 0;
+    while (seconds < units[unit] && unit < 3) {
+        ++unit;
+    }
+    const uint32_t tenths =
+        static_cast<uint32_t>((uint64_t{seconds} * 10 + units[unit] / 2) / units[unit]);
+    std::string text = std::to_string(tenths / 10);
+    if (tenths % 10 != 0) {
+        text += '.';
+        text += static_cast<char>('0' + tenths % 10);
+    }
+    return text + names[unit];
+}
+
+// Forgetting curves of a deck over one or more learners' answer logs,
+// for the whole deck or per value of a card field such as the tiers that
+// cluster writes, with exponential and power-law fits.
+int RunRetention(const std::vector<std::string>& args) {
+    std::vector<std::string> logs;
+    std::string groupField;
+    std::string csvPath;
+    size_t threads = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& flag = args[i];
+        if (flag.rfind("--", 0) != 0) {
+            logs.push_back(flag);
+        } else if (i + 1 == args.size()) {
+            PrintUsage();
+            return 1;
+        } else if (flag == "--by" && !args[i + 1].empty()) {
+            groupField = args[++i];
+        } else if (flag == "--threads" && ParseFlagCount(args[i + 1], threads)) {
+            ++i;
+        } else if (flag == "--csv") {
+            csvPath = args[++i];
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (logs.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    const Deck deck = LoadDeckFile(args[0], 0);
+    if (deck.cards.empty()) {
+        std::cerr << "DeckTool: no cards loaded from " << args[0] << "\n";
+        return 1;
+    }
+    std::vector<std::string> groupNames{"deck"};
+    std::vector<uint32_t> groupOfCard(deck.cards.size(), 0);
+    if (!groupField.empty()) {
+        const uint32_t field = FindCardField(deck.fields, ToWide(groupField));
+        std::map<std::wstring_view, uint32_t> groups;
+        for (size_t card = 0; card < deck.cards.size(); ++card) {
+            const std::wstring_view value = CardFieldValue(deck.fields, field, card);
+            if (!value.empty()) {
+                groups.emplace(value, 0);
+            }
+        }
+        groupNames.clear();
+        for (auto& [value, group] : groups) {
+            group = static_cast<uint32_t>(groupNames.size());
+            groupNames.push_back(groupField + "=" + ToUtf8(std::wstring(value)));
+        }
+        for (size_t card = 0; card < deck.cards.size(); ++card) {
+            const std::wstring_view value = CardFieldValue(deck.fields, field, card);
+            groupOfCard[card] = value.empty() ? NO_RETENTION_GROUP : groups[value];
+        }
+        if (groupNames.empty()) {
+            std::cerr << "DeckTool: no card of " << args[0] << " sets " << groupField << "\n";
+            return 1;
+        }
+    }
+
+    RetentionCurves curves = MakeRetentionCurves(groupNames.size());
+    double ms = 0.0;
+    for (const std::string& logPath : logs) {
+        MappedFile log;
+        if (!log.Open(logPath, MapOptions{})) {
+            std::cerr << "DeckTool: cannot map " << logPath << "\n";
+            return 1;
+        }
+        ReviewHistory history;
+        LoadReviewHistory(log.View(), deck.cards, history);
+        const auto start = Clock::now();
+        MergeRetentionCurves(curves, ComputeRetentionCurves(history, deck.cards.size(),
+                                                            groupOfCard, groupNames.size(),
+                                                            threads));
+        ms += ElapsedMilliseconds(start);
+    }
+    const std::vector<GroupRetention> fits = FitRetentionCurves(curves);
+
+    std::cout << std::left << std::setw(20) << "group" << std::right << std::setw(10) << "trials"
+              << std::setw(22) << "exponential" << std::setw(22) << "power law" << "\n"
+              << std::setw(52) << "half-life  error" << std::setw(22) << "half-life  error"
+              << "\n";
+    for (size_t group = 0; group < fits.size(); ++group) {
+        std::cout << std::left << std::setw(20) << groupNames[group] << std::right
+                  << std::setw(10) << fits[group].trials << std::fixed;
+        for (const RetentionFit* fit : {&fits[group].exponential, &fits[group].powerLaw}) {
+            if (fit->points == 0) {
+                std::cout << std::setw(22) << "-";
+            } else {
+                const double halfLife = RetentionHalfLifeDays(*fit);
+                std::ostringstream days;
+                days << std::fixed << std::setprecision(1) << halfLife << "d";
+                std::cout << std::setw(14) << (std::isinf(halfLife) ? "never" : days.str())
+                          << std::setw(8) << std::setprecision(3) << fit->error;
+            }
+        }
+        std::cout << "\n";
+    }
+
+    std::cout << "\nRecalled after" << std::setprecision(1);
+    for (const std::string& name : groupNames) {
+        std::cout << std::setw(std::max<int>(10, static_cast<int>(name.size()) + 2)) << name;
+    }
+    std::cout << "\n";
+    for (size_t bin = 0; bin < RETENTION_BIN_COUNT; ++bin) {
+        bool any = false;
+        for (size_t group = 0; group < fits.size(); ++group) {
+            any = any || curves.trials[group * RETENTION_BIN_COUNT + bin] != 0;
+        }
+        if (!any) {
+            continue;
+        }
+        std::cout << std::setw(14) << FormatElapsed(RetentionBinStart(bin));
+        for (size_t group = 0; group < fits.size(); ++group) {
+            const size_t cell = group * RETENTION_BIN_COUNT + bin;
+            const int width = std::max<int>(10, static_cast<int>(groupNames[group].size()) + 2);
+            if (curves.trials[cell] == 0) {
+                std::cout << std::setw(width) << "-";
+            } else {
+                std::cout << std::setw(width - 1)
+                          << 100.0 * curves.recalled[cell] / curves.trials[cell] << '%';
+            }
+        }
+        std::cout << "\n";
+    }
+
+    if (!csvPath.empty()) {
+        std::ofstream csv(csvPath, std::ios::binary | std::ios::trunc);
+        csv << "group,bin_start_s,trials,recalled,mean_days,exponential,power_law\n"
+            << std::setprecision(6);
+        for (size_t group = 0; group < fits.size(); ++group) {
+            for (size_t bin = 0; bin < RETENTION_BIN_COUNT; ++bin) {
+                const size_t cell = group * RETENTION_BIN_COUNT + bin;
+                if (curves.trials[cell] == 0) {
+                    continue;
+                }
+                const double days = curves.elapsedSeconds[cell] / 86400.0 / curves.trials[cell];
+                csv << groupNames[group] << ',' << RetentionBinStart(bin) << ','
+                    << curves.trials[cell] << ',' << curves.recalled[cell] << ',' << days << ','
+                    << PredictRetention(fits[group].exponential, days) << ','
+                    << PredictRetention(fits[group].powerLaw, days) << "\n";
+            }
+        }
+        if (!csv.flush()) {
+            std::cerr << "DeckTool: cannot write " << csvPath << "\n";
+            return 1;
+        }
+    }
+    std::cerr << "curves binned in " << std::fixed << std::setprecision(3) << ms << " ms\n";
+    return 0;
+}
+
+// Trains the recall model on the earlier reviews of an answer log, scores
+// it on the later ones and times predicting every card of the deck.
+int RunRecallModel(const std::vector<std::string>& args) {
+    if (args.size() < 2 || args.size() % 2 != 0) {
+        PrintUsage();
+        return 1;
+    }
+    RecallTrainingOptions options;
+    double holdout = 0.2;
+    for (size_t i = 2; i + 1 < args.size(); i += 2) {
+        const std::string& flag = args[i];
+        const std::string& value = args[i + 1];
+        bool parsed = false;
+        if (flag == "--holdout") {
+            parsed = ParseFlagNumber(value, holdout) && holdout >= 0.0 && holdout <= 1.0;
+        } else if (flag == "--epochs") {
+            parsed = ParseFlagCount(value, options.epochs);
+        } else if (flag == "--batch") {
+            parsed = ParseFlagCount(value, options.batchSize) && options.batchSize != 0;
+        } else if (flag == "--threads") {
+            parsed = ParseFlagCount(value, options.threads);
+        }
+        if (!parsed) {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    const Deck deck = LoadDeckFile(args[0], 0);
+    if (deck.cards.empty()) {
+        std::cerr << "DeckTool: no cards loaded from " << args[0] << "\n";
+        return 1;
+    }
+    ReviewHistory history;
+    {
+        MappedFile log;
+        if (!log.Open(args[1], MapOptions{})) {
+            std::cerr << "DeckTool: cannot map " << args[1] << "\n";
+            return 1;
+        }
+        LoadReviewHistory(log.View(), deck.cards, history);
+    }
+    auto start = Clock::now();
+    const RecallExamples examples = BuildRecallExamples(history, deck.cards.size());
+    const double featureMs = ElapsedMilliseconds(start);
+    const size_t count = examples.recalled.size();
+    const size_t split = count - static_cast<size_t>(static_cast<double>(count) * holdout);
+    start = Clock::now();
+    const RecallModel model = TrainRecallModel(examples, 0, split, options);
+    const double trainMs = ElapsedMilliseconds(start);
+
+    const char* names[RECALL_FEATURE_COUNT] = {"bias",         "log days since review",
+                                               "recall share", "lapses per review",
+                                               "log reviews",  "last rated bad",
+                                               "log think s",  "learner recall"};
+    std::cout << "weights (standardized features):\n" << std::fixed << std::setprecision(4);
+    for (size_t f = 0; f < RECALL_FEATURE_COUNT; ++f) {
+        std::cout << "  " << std::left << std::setw(24) << names[f] << std::right
+                  << std::setw(10) << model.weights[f] << "\n";
+    }
+    std::cout << "\n" << std::left << std::setw(12) << "examples" << std::right << std::setw(10)
+              << "count" << std::setw(10) << "AUC" << std::setw(10) << "log loss"
+              << std::setw(10) << "baseline" << "\n";
+    const auto report = [&](const char* name, size_t begin, size_t end) {
+        const RecallEvaluation evaluation = EvaluateRecallModel(model, examples, begin, end);
+        std::cout << std::left << std::setw(12) << name << std::right << std::setw(10)
+                  << evaluation.examples << std::setw(10) << evaluation.auc << std::setw(10)
+                  << evaluation.logLoss << std::setw(10) << evaluation.baselineLogLoss << "\n";
+    };
+    report("training", 0, split);
+    if (split < count) {
+        report("held out", split, count);
+    }
+
+    // Score every card as if it came up now, after the whole log.
+    RecallState state;
+    for (size_t i = 0; i < history.cards.size(); ++i) {
+        AddRecallObservation(state, history.cards[i], history.times[i], history.ratings[i],
+                             history.thinkMs[i]);
+    }
+    const uint32_t now = history.times.empty() ? 0 : history.times.back();
+    start = Clock::now();
+    size_t scored = 0;
+    double recallSum = 0.0;
+    for (uint32_t card = 0; card < deck.cards.size(); ++card) {
+        RecallFeatures features;
+        if (BuildRecallFeatures(state, card, now, features)) {
+            recallSum += PredictRecall(model, features);
+            ++scored;
+        }
+    }
+    const double predictMs = ElapsedMilliseconds(start);
+    std::cout << "\n" << scored << " cards scored, mean predicted recall " << std::setprecision(3)
+              << (scored == 0 ? 0.0 : recallSum / scored) << ", "
+              << (scored == 0 ? 0.0 : predictMs * 1000.0 / scored) << " us per card\n";
+    std::cerr << count << " examples built in " << std::setprecision(3) << featureMs
+              << " ms, trained in " << trainMs << " ms\n";
+    return 0;
+}
+
+// Replays an answer log through the fatigue detector as the trainer runs
+// it live, listing each session and the events it would have raised.
+int RunFatigue(const std::vector<std::string>& args) {
+    if (args.empty() || args.size() % 2 != 1) {
+        PrintUsage();
+        return 1;
+    }
+    FatigueDetector detector;
+    for (size_t i = 1; i + 1 < args.size(); i += 2) {
+        const std::string& flag = args[i];
+        const std::string& value = args[i + 1];
+        uint32_t minutes = 0;
+        double threshold = 0.0;
+        bool parsed = false;
+        if (flag == "--gap") {
+            // In seconds the gap must still fit in 32 bits.
+            parsed = ParseFlagCount(value, minutes) && minutes != 0 && minutes <= UINT32_MAX / 60;
+            detector.options.sessionGap = minutes * 60;
+        } else if (flag == "--warmup") {
+            parsed = ParseFlagCount(value, detector.options.warmupReviews);
+        } else if (flag == "--threshold") {
+            parsed = ParseFlagNumber(value, threshold) && threshold > 0.0 &&
+                     threshold <= std::numeric_limits<float>::max();
+            detector.options.threshold = static_cast<float>(threshold);
+        }
+        if (!parsed) {
+            PrintUsage();
+            return 1;
+        }
+    }
+    MappedFile log;
+    if (!log.Open(args[0], MapOptions{})) {
+        std::cerr << "DeckTool: cannot map " << args[0] << "\n";
+        return 1;
+    }
+
+    size_t sessions = 0;
+    size_t events = 0;
+    std::string_view sessionStart;
+    uint32_t sessionReviews = 0;
+    uint32_t sessionEvents = 0;
+    uint32_t sessionSeconds = 0;
+    // A session's events are held until it ends, so they print under its summary.
+    std::ostringstream sessionLines;
+    const auto endSession = [&]() {
+        if (sessionReviews != 0) {
+            std::cout << sessionStart << "  " << sessionReviews << " reviews in "
+                      << (sessionSeconds + 30) / 60 << " min, " << sessionEvents << " events\n"
+                      << sessionLines.str();
+        }
+        sessionLines.str({});
+    };
+    const auto start = Clock::now();
+    const std::string_view text = log.View();
+    for (size_t begin = 0; begin < text.size();) {
+        const size_t end = std::min(text.find('\n', begin), text.size());
+        const std::string_view line = Trim(text.substr(begin, end - begin));
+        begin = end + 1;
+        ReviewRecord record;
+        ReviewRating rating{};
+        uint32_t time = 0;
+        if (!ParseReviewRecord(line, record) || !ParseReviewRating(record.rating, rating) ||
+            !ParseReviewTime(record.time, time)) {
+            continue;
+        }
+        FatigueEvent event;
+        const bool raised = AddFatigueRating(detector, time, rating, record.thinkMs, event);
+        if (detector.reviews == 1) {
+            endSession();
+            ++sessions;
+            sessionStart = record.time;
+            sessionEvents = 0;
+        }
+        sessionReviews = detector.reviews;
+        sessionSeconds = detector.lastTime - detector.sessionStart;
+        if (raised) {
+            ++sessionEvents;
+            ++events;
+            sessionLines << "  " << record.time << "  after " << event.sessionReviews
+                         << " reviews, " << (event.sessionSeconds + 30) / 60 << " min: "
+                         << (event.signal == FatigueSignal::MoreFailures ? "more failures"
+                                                                         : "slower answers")
+                         << std::fixed << std::setprecision(0) << " (recall "
+                         << event.baselineRecall * 100.0f << "% -> "
+                         << event.recentRecall * 100.0f << "%, think " << event.baselineThinkMs
+                         << " -> " << event.recentThinkMs << " ms)\n";
+        }
+    }
+    endSession();
+    std::cerr << sessions << " sessions, " << events << " events in " << std::fixed
+              << std::setprecision(3) << ElapsedMilliseconds(start) << " ms\n";
+    return 0;
+}
+
+// Streams the matching cards of a deck to another file and reports the
+// throughput, which should be close to the disk's.
+int RunExport(const std::vector<std::string>& args) {
+    if (args.size() < 2 || args.size() % 2 != 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    ExportOptions options;
+    options.format = ExportFormatForPath(args[1]);
+    std::string rating;
+    std::string logPath = "answers.log";
+    for (size_t i = 2; i < args.size(); i += 2) {
+        const std::string& flag = args[i];
+        const std::string& value = args[i + 1];
+        if (flag == "--format" && ParseExportFormat(value, options.format)) {
+            continue;
+        }
+        if (flag == "--id-prefix") {
+            options.filter.idPrefix = ToWide(value);
+        } else if (flag == "--field") {
+            options.filter.requiredField = ToWide(value);
+        } else if (flag == "--rated" && (value == "good" || value == "meh" || value == "bad")) {
+            rating = value;
+        } else if (flag == "--log") {
+            logPath = value;
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (!rating.empty()) {
+        options.filter.restrictToIds = true;
+        options.filter.ids = LoadCardIdsRated(logPath, rating);
+    }
+
+    ExportStats stats;
+    std::string error;
+    const auto start = Clock::now();
+    if (!ExportDeck(args[0], args[1], options, stats, error)) {
+        std::cerr << "DeckTool: " << error << "\n";
+        return 1;
+    }
+    const double ms = ElapsedMilliseconds(start);
+    const double megabytes = static_cast<double>(stats.bytesRead) / 1e6;
+    std::cout << stats.cardsWritten << " of " << stats.cardsRead << " cards, "
+              << stats.bytesWritten << " bytes written\n"
+              << std::fixed << std::setprecision(1) << ms << " ms, "
+              << (ms > 0 ? megabytes * 1000.0 / ms : 0.0) << " MB/s read\n";
+    if (stats.cardsWithDroppedFields != 0) {
+        std::cerr << "DeckTool: warning: extra fields of " << stats.cardsWithDroppedFields
+                  << " cards are not written to CSV\n";
+    }
+    return 0;
+}
+
+size_t EndOfFirstEntry(std::string_view text) {
+    size_t entries = 0;
+    size_t position = 0;
+    while (position < text.size()) {
+        const size_t end = std::min(text.find('\n', position), text.size());
+        if (Trim(text.substr(position, end - position)).substr(0, 2) == "- " && ++entries == 2) {
+            return position;
+        }
+        position = end + 1;
+    }
+    return text.size();
+}
+
+// Compares mapping options on one deck: first-query latency is the time to
+// map the file and parse its first card, full scan is a complete load.
+int RunBenchMap(const std::vector<std::string>& args) {
+    if (args.size() != 1) {
+        PrintUsage();
+        return 1;
+    }
+
+    struct Setting {
+        const char* name;
+        MapOptions options;
+    };
+    const Setting settings[] = {
+        {"lazy", {false, PrefaultMode::None}},
+        {"populate", {false, PrefaultMode::Populate}},
+        {"background", {false, PrefaultMode::Background}},
+        {"huge-pages", {true, PrefaultMode::None}},
+        {"huge-pages+populate", {true, PrefaultMode::Populate}},
+        {"huge-pages+background", {true, PrefaultMode::Background}},
+    };
+
+    std::cout << std::left << std::setw(24) << "setting" << std::right << std::setw(14)
+              << "first (ms)" << std::setw(14) << "scan (ms)" << std::setw(12) << "MB/s"
+              << std::setw(8) << "cards" << "\n";
+    for (const Setting& setting : settings) {
+        const bool cold = DropFromPageCache(args[0]);
+
+        MappedFile file;
+        const auto start = Clock::now();
+        if (!file.Open(args[0], setting.options)) {
+            std::cerr << "DeckTool: cannot map " << args[0] << "\n";
+            return 1;
+        }
+        const std::string_view text = file.View();
+        ParseDeckFromYaml(text.substr(0, EndOfFirstEntry(text)), 0);
+        const double firstMs = ElapsedMilliseconds(start);
+
+        const auto scanStart = Clock::now();
+        const size_t cardCount = ParseDeckFromYaml(text, 0).cards.size();
+        const double scanMs = ElapsedMilliseconds(scanStart);
+        const double megabytes = static_cast<double>(text.size()) / (1024.0 * 1024.0);
+
+        std::cout << std::left << std::setw(24)
+                  << (std::string(setting.name) + (cold ? "" : " (warm)")) << std::right
+                  << std::fixed << std::setprecision(3) << std::setw(14) << firstMs
+                  << std::setw(14) << scanMs << std::setprecision(1) << std::setw(12)
+                  << (scanMs > 0 ? megabytes * 1000.0 / scanMs : 0.0) << std::setw(8)
+                  << cardCount << "\n";
+    }
+    return 0;
+}
+
+// Times parsing gap spans at load and rendering question plus answer for
+// every gap on synthetic three-gap notes.
+int RunBenchCloze(const std::vector<std::string>& args) {
+    size_t count = 1000000;
+    if (args.size() == 1) {
+        count = std::stoul(args[0]);
+    } else if (!args.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<Card> cards(count);
+    for (size_t i = 0; i < count; ++i) {
+        cards[i].id = L"note-" + std::to_wstring(i);
+        cards[i].question = L"In " + std::to_wstring(1800 + i % 200) +
+                            L" the capital of {{c1::France::country}} was {{c2::Paris}}, "
+                            L"on the river {{c3::Seine}}.";
+    }
+
+    const auto parseStart = Clock::now();
+    for (Card& card : cards) {
+        ParseClozeGaps(card.question, card.clozeGaps);
+    }
+    const double parseMs = ElapsedMilliseconds(parseStart);
+
+    const std::vector<ReviewItem> items = BuildReviewItems(cards);
+    std::wstring scratch;
+    size_t renderedChars = 0;
+    const auto renderStart = Clock::now();
+    for (const ReviewItem& item : items) {
+        const Card& card = cards[item.handle];
+        renderedChars += PromptText(card, item, scratch).size();
+        renderedChars += ResponseText(card, item, scratch).size();
+    }
+    const double renderMs = ElapsedMilliseconds(renderStart);
+
+    std::cout << std::fixed << std::setprecision(1) << count << " notes, " << items.size()
+              << " cloze items\n"
+              << "parse:  " << parseMs * 1e6 / static_cast<double>(count) << " ns/note\n"
+              << "render: " << renderMs * 1e6 / static_cast<double>(items.size())
+              << " ns/item (question + answer, " << renderedChars << " chars)\n";
+    return 0;
+}
+
+// Renders the question side of synthetic cards through a compiled template
+// and counts how often the output buffer had to grow. Every eighth card has
+// a "hint" extra field.
+int RunBenchTemplate(const std::vector<std::string>& args) {
+    if (args.size() > 2) {
+        PrintUsage();
+        return 1;
+    }
+    const size_t count = args.empty() ? 1000000 : std::stoul(args[0]);
+    const std::wstring source =
+        args.size() == 2
+            ? ToWide(args[1])
+            : L"{{front}}{{#back}} ({{back}}){{/back}} [{{id}}]{{#hint}} {{hint}}{{/hint}}";
+
+    Deck deck;
+    deck.questionTemplate = source;
+    deck.cards.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        deck.cards[i].id = L"card-" + std::to_wstring(i);
+        deck.cards[i].question = L"What is " + std::to_wstring(i) + L" squared?";
+        deck.cards[i].answer = std::to_wstring(i * i);
+        if (i % 8 == 0) {
+            AppendCardField(deck.fields, L"hint", i, L"ends in " + std::to_wstring(i * i % 10));
+        }
+    }
+    const std::vector<Card>& cards = deck.cards;
+
+    CompiledTemplate question;
+    CompiledTemplate answer;
+    if (!CompileDeckTemplates(deck, question, answer)) {
+        std::cerr << "DeckTool: malformed template\n";
+        return 1;
+    }
+
+    CardRenderBuffers buffers;
+    size_t growths = 0;
+    size_t renderedChars = 0;
+    const auto start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        const size_t capacity = buffers.output.capacity();
+        const ReviewItem item{i, CardDirection::Forward};
+        renderedChars +=
+            RenderCardSide(cards[i], item, deck.fields, question, false, buffers).size();
+        growths += buffers.output.capacity() != capacity ? 1 : 0;
+    }
+    const double ms = ElapsedMilliseconds(start);
+
+    std::cout << std::fixed << std::setprecision(1) << count << " renders of \""
+              << ToUtf8(source) << "\" (" << question.ops.size() << " ops)\n"
+              << ms << " ms, " << ms * 1e6 / static_cast<double>(count) << " ns/render, "
+              << static_cast<double>(count) / (ms * 1000.0) << " M renders/s\n"
+              << "output buffer grew " << growths << " times, " << renderedChars << " chars\n";
+    return 0;
+}
+
+bool SameCards(const std::vector<Card>& left, const std::vector<Card>& right) {
+    if (left.size() != right.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < left.size(); ++i) {
+        if (left[i].id != right[i].id || left[i].question != right[i].question ||
+            left[i].answer != right[i].answer || left[i].reverse != right[i].reverse ||
+            left[i].clozeGaps.size() != right[i].clozeGaps.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Loads a YAML deck, converts its cards to JSONL in memory and reports the
+// best-of-runs throughput of both loaders on the same cards.
+int RunBenchJsonl(const std::vector<std::string>& args) {
+    if (args.empty() || args.size() > 2) {
+        PrintUsage();
+        return 1;
+    }
+    const size_t runs = args.size() == 2 ? std::max<size_t>(1, std::stoul(args[1])) : 5;
+
+    MappedFile file;
+    if (!file.Open(args[0], MapOptions{})) {
+        std::cerr << "DeckTool: cannot map " << args[0] << "\n";
+        return 1;
+    }
+    const std::string_view yaml = file.View();
+    const Deck yamlDeck = ParseDeckFromYaml(yaml, 0);
+
+    const std::string jsonl = DeckToJsonl(yamlDeck);
+    if (!SameCards(yamlDeck.cards, ParseDeckFromJsonl(jsonl, 0).cards)) {
+        std::cerr << "DeckTool: JSONL and YAML loaders disagree on " << args[0] << "\n";
+        return 1;
+    }
+
+    const auto bestOf = [&](auto parse) {
+        double best = 0;
+        for (size_t run = 0; run < runs; ++run) {
+            const auto start = Clock::now();
+            parse();
+            const double ms = ElapsedMilliseconds(start);
+            best = run == 0 ? ms : std::min(best, ms);
+        }
+        return best;
+    };
+    const double yamlMs = bestOf([&] { return ParseDeckFromYaml(yaml, 0); });
+    const double jsonlMs = bestOf([&] { return ParseDeckFromJsonl(jsonl, 0); });
+
+    std::cout << std::left << std::setw(8) << "format" << std::right << std::setw(12) << "MB"
+              << std::setw(12) << "best (ms)" << std::setw(10) << "GB/s" << "\n";
+    const auto report = [](const char* format, size_t bytes, double ms) {
+        const double megabytes = static_cast<double>(bytes) / 1e6;
+        std::cout << std::left << std::setw(8) << format << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(12) << megabytes << std::setprecision(3)
+                  << std::setw(12) << ms << std::setw(10)
+                  << (ms > 0 ? megabytes / ms : 0.0) << "\n";
+    };
+    report("yaml", yaml.size(), yamlMs);
+    report("jsonl", jsonl.size(), jsonlMs);
+    std::cout << yamlDeck.cards.size() << " cards, best of " << runs << " runs\n";
+    return 0;
+}
+
+// Times a full recompute of per-card statistics over a synthetic history,
+// on one thread and on all of them, and folding in reviews one at a time.
+int RunBenchStats(const std::vector<std::string>& args) {
+    if (args.size() > 2) {
+        PrintUsage();
+        return 1;
+    }
+    const size_t reviewCount = args.empty() ? 100000000 : std::stoul(args[0]);
+    const size_t cardCount = args.size() < 2 ? 100000 : std::stoul(args[1]);
+    if (cardCount == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    ReviewHistory history;
+    history.cards.reserve(reviewCount);
+    history.times.reserve(reviewCount);
+    history.ratings.reserve(reviewCount);
+    history.thinkMs.reserve(reviewCount);
+    history.rateMs.reserve(reviewCount);
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+    uint32_t time = 1700000000;
+    for (size_t i = 0; i < reviewCount; ++i) {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        time += static_cast<uint32_t>(random >> 58);
+        const uint32_t roll = static_cast<uint32_t>(random >> 32) % 10;
+        const ReviewRating rating = roll < 2   ? ReviewRating::Bad
+                                    : roll < 4 ? ReviewRating::Meh
+                                               : ReviewRating::Good;
+        AppendReview(history, static_cast<uint32_t>(random % cardCount), time, rating,
+                     NO_RESPONSE_TIME, NO_RESPONSE_TIME);
+    }
+
+    const auto recompute = [&](size_t threads, std::vector<CardStats>& stats) {
+        const auto start = Clock::now();
+        stats = ComputeCardStats(history, cardCount, threads);
+        return ElapsedMilliseconds(start);
+    };
+    std::vector<CardStats> single;
+    std::vector<CardStats> parallel;
+    const double singleMs = recompute(1, single);
+    const double parallelMs = recompute(0, parallel);
+    const auto sameStats = [](const CardStats& left, const CardStats& right) {
+        return std::equal(std::begin(left.counts), std::end(left.counts), right.counts) &&
+               left.lapses == right.lapses && left.firstTime == right.firstTime &&
+               left.lastTime == right.lastTime && left.firstRating == right.firstRating &&
+               left.lastRating == right.lastRating;
+    };
+
+    std::vector<CardStats> incremental;
+    const auto incrementalStart = Clock::now();
+    for (size_t i = 0; i < reviewCount; ++i) {
+        AddReview(incremental, history.cards[i], history.times[i], history.ratings[i]);
+    }
+    const double incrementalMs = ElapsedMilliseconds(incrementalStart);
+    const bool same = std::equal(single.begin(), single.end(), parallel.begin(), sameStats) &&
+                      incremental.size() <= cardCount &&
+                      std::equal(incremental.begin(), incremental.end(), single.begin(),
+                                 sameStats);
+
+    const auto report = [&](const char* name, double ms) {
+        std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(10) << ms << " ms" << std::setw(10)
+                  << (ms > 0 ? static_cast<double>(reviewCount) / ms / 1000.0 : 0.0)
+                  << " M reviews/s\n";
+    };
+    std::cout << reviewCount << " reviews of " << cardCount << " cards\n";
+    report("one thread", singleMs);
+    report("all threads", parallelMs);
+    report("incremental", incrementalMs);
+    std::cout << (same ? "results match\n" : "RESULTS DIFFER\n");
+    return same ? 0 : 1;
+}
+
+int RunBenchCluster(const std::vector<std::string>& args) {
+    if (args.size() > 2) {
+        PrintUsage();
+        return 1;
+    }
+    const size_t cardCount = args.empty() ? 10000000 : std::stoul(args[0]);
+    const size_t tierCount = args.size() < 2 ? 4 : std::stoul(args[1]);
+
+    // Cards from tierCount difficulties, each with a few to a few dozen
+    // reviews rated according to it.
+    std::vector<CardStats> stats(cardCount);
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+    const auto next = [&random]() {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        return random;
+    };
+    for (CardStats& card : stats) {
+        const uint64_t roll = next();
+        const uint32_t difficulty = static_cast<uint32_t>(roll % tierCount);
+        const uint32_t reviews = 3 + static_cast<uint32_t>((roll >> 16) % 30);
+        for (uint32_t review = 0; review < reviews; ++review) {
+            const uint32_t outcome = static_cast<uint32_t>(next() >> 32) % (4 * tierCount);
+            const ReviewRating rating = outcome < difficulty + 1      ? ReviewRating::Bad
+                                        : outcome < 2 * difficulty + 2 ? ReviewRating::Meh
+                                                                      : ReviewRating::Good;
+            card.lapses += rating == ReviewRating::Bad && review != 0 &&
+                           card.lastRating != ReviewRating::Bad;
+            ++card.counts[static_cast<size_t>(rating)];
+            card.lastRating = rating;
+        }
+    }
+
+    auto start = Clock::now();
+    const CardFeatures features = BuildCardFeatures(stats, {}, 1);
+    const double featureMs = ElapsedMilliseconds(start);
+    stats = {};
+    std::cout << cardCount << " cards, " << tierCount << " tiers\n"
+              << "features      " << std::fixed << std::setprecision(1) << std::setw(10)
+              << featureMs << " ms\n";
+
+    for (const size_t threads : {size_t{1}, size_t{0}}) {
+        ClusterOptions options;
+        options.clusters = tierCount;
+        options.threads = threads;
+        start = Clock::now();
+        const ClusterResult result = ClusterCards(features, options);
+        const double ms = ElapsedMilliseconds(start);
+        std::cout << std::left << std::setw(14) << (threads == 1 ? "one thread" : "all threads")
+                  << std::right << std::setw(10) << ms << " ms" << std::setw(6)
+                  << result.iterations << " iterations, inertia " << std::setprecision(4)
+                  << result.inertia / static_cast<double>(cardCount) << " per card\n"
+                  << std::setprecision(1);
+    }
+    return 0;
+}
+
+// Diffs generated edits of a synthetic deck, applies them in place to a
+// packed copy at the scratch path and checks that the result verifies and
+// loads as the same cards ApplyDeckPatch gives. The last round inserts
+// enough cards to force a repack. Crc32cReplace, which the in-place path
+// relies on, is checked against full checksums first.
+int RunSelfcheckPatch(const std::vector<std::string>& args) {
+    size_t cardCount = 2000;
+    if (args.empty() || args.size() > 2 ||
+        (args.size() == 2 && (!ParseFlagCount(args[1], cardCount) || cardCount == 0))) {
+        PrintUsage();
+        return 1;
+    }
+    const std::filesystem::path deckPath = args[0];
+    const std::filesystem::path patchPath = args[0] + ".qapatch";
+
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+    const auto next = [&random]() {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        return random;
+    };
+
+    constexpr size_t CRC_CHECKS = 10000;
+    std::string buffer(1 << 16, '\0');
+    for (char& byte : buffer) {
+        byte = static_cast<char>(next());
+    }
+    for (size_t check = 0; check < CRC_CHECKS; ++check) {
+        const size_t size = 1 + next() % buffer.size();
+        const size_t offset = next() % size;
+        const size_t length = 1 + next() % std::min<size_t>(size - offset, 64);
+        const std::string_view whole(buffer.data(), size);
+        const uint32_t crc = Crc32c(whole, 0);
+        const std::string before = buffer.substr(offset, length);
+        for (size_t i = 0; i < length; ++i) {
+            buffer[offset + i] = static_cast<char>(next());
+        }
+        if (Crc32cReplace(crc, size, offset, before, whole.substr(offset, length)) !=
+            Crc32c(whole, 0)) {
+            std::cerr << "DeckTool: Crc32cReplace mismatch for " << length << " bytes at "
+                      << offset << " of " << size << "\n";
+            return 1;
+        }
+    }
+
+    const auto makeCard = [](size_t number, uint64_t roll) {
+        Card card;
+        card.id = L"card-" + std::to_wstring(number);
+        if (roll % 5 == 0) {
+            card.question = L"Card {{c1::" + std::to_wstring(roll % 1000) + L"}} of the deck";
+        } else {
+            card.question = L"Question " + std::to_wstring(roll % 100000) + L"?";
+            card.answer = std::wstring(1 + roll % 40, L'a' + static_cast<wchar_t>(roll % 26));
+        }
+        card.reverse = roll % 7 == 0;
+        ParseClozeGaps(card.question, card.clozeGaps);
+        card.fingerprint = CardFingerprint(card.question, card.answer);
+        return card;
+    };
+    const auto byId = [](std::vector<Card> cards) {
+        std::sort(cards.begin(), cards.end(),
+                  [](const Card& left, const Card& right) { return left.id < right.id; });
+        return cards;
+    };
+
+    constexpr size_t ROUNDS = 4;
+    size_t operations = 0;
+    for (const bool compress : {false, true}) {
+        Deck deck;
+        for (size_t i = 0; i < cardCount; ++i) {
+            deck.cards.push_back(makeCard(i, next()));
+        }
+        BinaryDeckOptions options;
+        options.compress = compress;
+        if (!WriteBinaryDeck(deck, options, deckPath)) {
+            std::cerr << "DeckTool: cannot write " << deckPath.string() << "\n";
+            return 1;
+        }
+
+        size_t nextNumber = cardCount;
+        for (size_t round = 0; round < ROUNDS; ++round) {
+            // Delete, replace and flip about a tenth each; then insert a
+            // twentieth, or as many cards again in the last round.
+            Deck target;
+            for (const Card& card : deck.cards) {
+                const uint64_t roll = next();
+                if (roll % 10 == 0) {
+                    continue;
+                }
+                Card edited = roll % 10 == 1 ? makeCard(0, next()) : card;
+                edited.id = card.id;
+                edited.reverse = roll % 10 == 2 ? !card.reverse : edited.reverse;
+                target.cards.push_back(std::move(edited));
+            }
+            const size_t inserts = round + 1 == ROUNDS ? deck.cards.size() : cardCount / 20 + 1;
+            for (size_t i = 0; i < inserts; ++i) {
+                target.cards.push_back(makeCard(nextNumber++, next()));
+            }
+
+            DeckPatch patch;
+            std::string error;
+            if (!WriteDeckPatch(DiffDecks(deck, target), patchPath)) {
+                std::cerr << "DeckTool: cannot write " << patchPath.string() << "\n";
+                return 1;
+            }
+            {
+                MappedFile patchFile;
+                if (!patchFile.Open(patchPath, MapOptions{}) ||
+                    !ReadDeckPatch(patchFile.View(), patch, error)) {
+                    std::cerr << "DeckTool: round " << round << ": cannot read back the patch: "
+                              << error << "\n";
+                    return 1;
+                }
+            }
+            if (!ApplyDeckPatch(deck, patch, error) ||
+                !ApplyBinaryDeckPatch(deckPath, patch, error)) {
+                std::cerr << "DeckTool: round " << round << ": " << error << "\n";
+                return 1;
+            }
+            operations += patch.operations.size();
+
+            MappedFile deckFile;
+            std::vector<BinaryDeckSectionCheck> sections;
+            if (!deckFile.Open(deckPath, MapOptions{}) ||
+                !VerifyBinaryDeck(deckFile.View(), sections, error)) {
+                std::cerr << "DeckTool: round " << round << ": patched deck does not verify: "
+                          << error << "\n";
+                return 1;
+            }
+            const Deck loaded = ParseBinaryDeck(deckFile.View(), 0);
+            bool fingerprints = loaded.cards.size() == deck.cards.size();
+            for (size_t i = 0; fingerprints && i < loaded.cards.size(); ++i) {
+                fingerprints = loaded.cards[i].fingerprint == deck.cards[i].fingerprint;
+            }
+            if (!SameCards(loaded.cards, deck.cards) || !fingerprints ||
+                !SameCards(byId(deck.cards), byId(target.cards))) {
+                std::cerr << "DeckTool: round " << round << " of the "
+                          << (compress ? "compressed" : "uncompressed")
+                          << " deck: patched cards differ from the expected ones\n";
+                return 1;
+            }
+        }
+    }
+
+    // Kept on failure for inspection.
+    std::error_code removeError;
+    std::filesystem::remove(patchPath, removeError);
+    std::filesystem::remove(deckPath, removeError);
+    std::cout << CRC_CHECKS << " Crc32cReplace checks, " << 2 * ROUNDS << " patch rounds, "
+              << operations << " operations: ok\n";
+    return 0;
+}
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    const std::string command = argv[1];
+    const std::vector<std::string> args(argv + 2, argv + argc);
+    if (command == "embed") {
+        return RunEmbed(args);
+    }
+    if (command == "pack") {
+        return RunPack(args);
+    }
+    if (command == "unpack") {
+        return RunUnpack(args);
+    }
+    if (command == "verify") {
+        return RunVerify(args);
+    }
+    if (command == "lint") {
+        return RunLint(args);
+    }
+    if (command == "diff") {
+        return RunDiff(args);
+    }
+    if (command == "patch") {
+        return RunPatch(args);
+    }
+    if (command == "migrate") {
+        return RunMigrate(args);
+    }
+    if (command == "stats") {
+        return RunStats(args);
+    }
+    if (command == "latency") {
+        return RunLatency(args);
+    }
+    if (command == "activity") {
+        return RunActivity(args);
+    }
+    if (command == "hardest") {
+        return RunHardest(args);
+    }
+    if (command == "cluster") {
+        return RunCluster(args);
+    }
+    if (command == "range") {
+        return RunRange(args);
+    }
+    if (command == "cohort") {
+        return RunCohort(args);
+    }
+    if (command == "retention") {
+        return RunRetention(args);
+    }
+    if (command == "recall-model") {
+        return RunRecallModel(args);
+    }
+    if (command == "fatigue") {
+        return RunFatigue(args);
+    }
+    if (command == "export") {
+        return RunExport(args);
+    }
+    if (command == "bench-map") {
+        return RunBenchMap(args);
+    }
+    if (command == "bench-cloze") {
+        return RunBenchCloze(args);
+    }
+    if (command == "bench-template") {
+        return RunBenchTemplate(args);
+    }
+    if (command == "bench-jsonl") {
+        return RunBenchJsonl(args);
+    }
+    if (command == "bench-stats") {
+        return RunBenchStats(args);
+    }
+    if (command == "bench-cluster") {
+        return RunBenchCluster(args);
+    }
+    if (command == "selfcheck-patch") {
+        return RunSelfcheckPatch(args);
+    }
+
+    PrintUsage();
+    return 1;
+}
@@ -1,22 +1,31 @@
 #include <windows.h>
+#include <shellapi.h>
 #include <chrono>
 #include <algorithm>
-#include <codecvt>
+#include <cstdint>
 #include <cwctype>
 #include <ctime>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
-#include <locale>
+#include <limits>
+#include <sstream>
 #include <string>
 #include <vector>
 
-struct Card {
-    std::wstring id;
-    std::wstring question;
-    std::wstring answer;
-};
+#include "deck.h"
+#include "mapped_file.h"
+#include "retention_curves.h"
+#include "review_log.h"
+#include "review_rollups.h"
+#include "review_stats.h"
+#include "session_fatigue.h"
+
+#if defined(QATRAINER_EMBEDDED_DECK)
+#include "embedded_deck.h"
+#endif
 
-enum class Rating { Bad, Meh, Good };
+using Rating = ReviewRating;
 
 struct RatedCard {
     Card card;
@@ -33,11 +42,60 @@ struct AppControls {
     HWND hBtnBad{};
 };
 
+struct AppOptions {
+    // Upper bound on question/answer text kept in memory; 0 means unlimited.
+    size_t cardMemoryBudget{0};
+    // Set by --deck=; bypasses an embedded deck in favour of runtime loading.
+    std::filesystem::path deckPath{"cards.yaml"};
+    bool deckPathGiven{false};
+    MapOptions deckMapping{};
+};
+
+struct CardBodyCache {
+    // Kept mapped only while a budget is set, so evicted text can be reparsed.
+    MappedFile deckFile{};
+    std::vector<size_t> clock{};
+    size_t hand{0};
+    size_t residentBytes{0};
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t evictions{0};
+    std::chrono::nanoseconds totalReloadTime{0};
+    std::chrono::nanoseconds maxReloadTime{0};
+};
+
 struct AppState {
-    std::vector<Card> cards{};
-    size_t currentCardIndex{0};
+    AppOptions options{};
+    Deck deck{};
+    // Holds the generated card currently on screen; generated cards are never stored.
+    Card generatedCard{};
+    // Deck display templates; an empty template shows the card text as is.
+    CompiledTemplate questionTemplate{};
+    CompiledTemplate answerTemplate{};
+    CardRenderBuffers renderBuffers{};
+    // Card text with "\r\n" line breaks for the multiline edit controls.
+    std::wstring editText{};
+    CardBodyCache bodyCache{};
+    // Review items of the literal cards; generated items are computed on demand.
+    std::vector<ReviewItem> reviewItems{};
+    size_t currentItemIndex{0};
     bool answerVisible{false};
+    // When the current item's question and answer were shown, for the think
+    // and rate times logged with its rating.
+    std::chrono::steady_clock::time_point questionShownAt{};
+    std::chrono::steady_clock::time_point answerShownAt{};
     std::ofstream answerLog{};
+    // Review statistics of the literal cards, by deck index; ratings are
+    // folded in as they are given.
+    std::vector<CardStats> cardStats{};
+    std::vector<CardResponseTimes> responseTimes{};
+    // The deck's forgetting curve, one group; fitted when shown.
+    RetentionCurves retention{};
+    // Watches this run's ratings for a tiring learner.
+    FatigueDetector fatigue{};
+    // Reviews per day, week and month of the whole answer log; saved to
+    // answers.rollup at exit.
+    ActivityRollups activity{};
     HFONT hFont{nullptr};
     AppControls controls{};
     HWND hMainWnd{nullptr};
@@ -51,6 +109,8 @@ constexpr int ID_BTN_GOOD = 1004;
 constexpr int ID_BTN_MEH = 1005;
 constexpr int ID_BTN_BAD = 1006;
 constexpr int ID_MENU_FILE_NEW_CARD = 2001;
+constexpr int ID_MENU_VIEW_CARD_MEMORY = 2101;
+constexpr int ID_MENU_VIEW_CARD_STATISTICS = 2102;
 constexpr int ID_NEW_CARD_QUESTION = 3001;
 constexpr int ID_NEW_CARD_ANSWER = 3002;
 constexpr int ID_NEW_CARD_SAVE = 3003;
@@ -66,26 +126,6 @@ constexpr wchar_t MAIN_WINDOW_CLASS_NAME[] = L"QATrainerMainWindow";
 constexpr wchar_t NEW_CARD_WINDOW_CLASS_NAME[] = L"QATrainerNewCardWindow";
 }
 
-std::wstring ToWide(const std::string& text) {
-    static std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-    return converter.from_bytes(text);
-}
-
-std::string ToUtf8(const std::wstring& text) {
-    static std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-    return converter.to_bytes(text);
-}
-
-std::wstring TrimWide(const std::wstring& text) {
-    const auto first = text.find_first_not_of(L" \t\r\n");
-    if (first == std::wstring::npos) {
-        return L"";
-    }
-
-    const auto last = text.find_last_not_of(L" \t\r\n");
-    return text.substr(first, last - first + 1);
-}
-
 std::string RatingToText(Rating rating) {
     switch (rating) {
     case Rating::Good:
@@ -99,23 +139,36 @@ std::string RatingToText(Rating rating) {
     }
 }
 
-bool IsCardComplete(const Card& card) {
-    return !card.id.empty() && !card.question.empty() && !card.answer.empty();
-}
-
-void AppendRatingToLog(const Card& card, Rating rating) {
-    if (!g_state.answerLog.is_open() || card.id.empty()) {
-        return;
-    }
-
+// The current local time as the answer log writes it.
+std::string CurrentLogTime() {
     const auto now = std::chrono::system_clock::now();
     const auto time = std::chrono::system_clock::to_time_t(now);
     std::tm localTime{};
     localtime_s(&localTime, &time);
 
-    g_state.answerLog << std::put_time(&localTime, "%Y-%m-%d %H:%M:%S")
-                      << '|' << ToUtf8(card.id) << '|' << RatingToText(rating) << "\n";
+    std::ostringstream text;
+    text << std::put_time(&localTime, "%Y-%m-%d %H:%M:%S");
+    return text.str();
+}
+
+// Returns the number of bytes logged, 0 when nothing was.
+size_t AppendRatingToLog(const Card& card, const ReviewItem& item, Rating rating,
+                         const std::string& time, uint32_t thinkMs, uint32_t rateMs) {
+    if (!g_state.answerLog.is_open() || card.id.empty()) {
+        return 0;
+    }
+
+    const uint64_t fingerprint = card.fingerprint != 0
+                                     ? card.fingerprint
+                                     : CardFingerprint(card.question, card.answer);
+    std::ostringstream line;
+    line << time << '|' << ReviewItemKey(card, item) << '|' << RatingToText(rating)
+         << "|fp=" << FingerprintToHex(fingerprint) << "|think=" << thinkMs << "|rate=" << rateMs
+         << "\n";
+    const std::string text = line.str();
+    g_state.answerLog << text;
     g_state.answerLog.flush();
+    return g_state.answerLog ? text.size() : 0;
 }
 
 std::vector<Card> LoadDefaultCards() {
@@ -126,92 +179,160 @@ std::vector<Card> LoadDefaultCards() {
     };
 }
 
-std::string Trim(const std::string& text) {
-    const auto first = text.find_first_not_of(" \t\r\n");
-    if (first == std::string::npos) {
-        return "";
+Deck LoadDeck() {
+#if defined(QATRAINER_EMBEDDED_DECK)
+    // DeckTool embed refuses empty decks, so the table always has cards.
+    if (!g_state.options.deckPathGiven) {
+        return LoadEmbeddedDeck(EMBEDDED_DECK);
     }
+#endif
 
-    const auto last = text.find_last_not_of(" \t\r\n");
-    return text.substr(first, last - first + 1);
-}
+    MappedFile& deckFile = g_state.bodyCache.deckFile;
+    Deck loadedDeck;
+    if (deckFile.Open(g_state.options.deckPath, g_state.options.deckMapping)) {
+        loadedDeck = ParseDeck(deckFile.View(), g_state.options.deckPath,
+                               g_state.options.cardMemoryBudget);
+    }
+    if (g_state.options.cardMemoryBudget == 0 || loadedDeck.cards.empty()) {
+        deckFile.Close();
+    }
 
-std::wstring ExtractValue(const std::string& line, const std::string& key) {
-    const auto prefix = key + ":";
-    if (line.rfind(prefix, 0) != 0) {
-        return L"";
+    if (!loadedDeck.cards.empty() || !loadedDeck.generators.empty()) {
+        return loadedDeck;
     }
 
-    const auto value = Trim(line.substr(prefix.size()));
-    return ToWide(value);
+    return {LoadDefaultCards(), {}};
 }
 
-std::vector<Card> LoadCardsFromYaml(const std::string& path) {
-    std::ifstream file(path);
-    if (!file.is_open()) {
-        return {};
+size_t ReviewItemCount() {
+    size_t count = g_state.reviewItems.size();
+    for (const CardGenerator& generator : g_state.deck.generators) {
+        count += GeneratorItemCount(generator);
     }
+    return count;
+}
 
-    std::vector<Card> cards;
-    Card currentCard{};
-    bool inCard = false;
-    std::string line;
-    while (std::getline(file, line)) {
-        const std::string trimmed = Trim(line);
-        if (trimmed.empty() || trimmed[0] == '#') {
-            continue;
-        }
+// Generated items follow the literal ones: per generator, every card
+// forward and then, if enabled, every card reversed.
+ReviewItem ReviewItemAt(size_t index) {
+    if (index < g_state.reviewItems.size()) {
+        return g_state.reviewItems[index];
+    }
 
-        if (trimmed == "cards:") {
-            continue;
+    size_t ordinal = index - g_state.reviewItems.size();
+    size_t firstHandle = g_state.deck.cards.size();
+    for (const CardGenerator& generator : g_state.deck.generators) {
+        if (ordinal < GeneratorItemCount(generator)) {
+            if (ordinal < generator.cardCount) {
+                return {firstHandle + ordinal, CardDirection::Forward};
+            }
+            return {firstHandle + ordinal - generator.cardCount, CardDirection::Reverse};
         }
+        ordinal -= GeneratorItemCount(generator);
+        firstHandle += generator.cardCount;
+    }
+    return {0, CardDirection::Forward};
+}
 
-        if (trimmed.rfind("- ", 0) == 0) {
-            if (inCard && IsCardComplete(currentCard)) {
-                cards.push_back(currentCard);
+void InitializeCardBodyCache() {
+    CardBodyCache& cache = g_state.bodyCache;
+    cache.clock.clear();
+    cache.residentBytes = 0;
+    const bool budgeted = g_state.options.cardMemoryBudget != 0;
+    for (size_t i = 0; i < g_state.deck.cards.size(); ++i) {
+        const Card& card = g_state.deck.cards[i];
+        if (card.source != CardSource::Memory && IsCardBodyResident(card)) {
+            if (budgeted) {
+                cache.clock.push_back(i);
             }
+            cache.residentBytes += CardBodyBytes(card);
+        }
+    }
+}
 
-            currentCard = Card{};
-            inCard = true;
-
-            const std::string entry = Trim(trimmed.substr(2));
-            if (entry.rfind("id:", 0) == 0) {
-                currentCard.id = ExtractValue(entry, "id");
-            } else if (entry.rfind("question:", 0) == 0) {
-                currentCard.question = ExtractValue(entry, "question");
-            } else if (entry.rfind("answer:", 0) == 0) {
-                currentCard.answer = ExtractValue(entry, "answer");
-            }
-            continue;
+// CLOCK sweep over the resident reloadable cards: a referenced card gets a
+// second chance, the first unreferenced one loses its text.
+bool EvictOneCardBody(size_t pinnedIndex) {
+    CardBodyCache& cache = g_state.bodyCache;
+    for (size_t scanned = 0; scanned < 2 * cache.clock.size(); ++scanned) {
+        if (cache.hand >= cache.clock.size()) {
+            cache.hand = 0;
         }
 
-        if (!inCard) {
-            continue;
+        const size_t index = cache.clock[cache.hand];
+        Card& card = g_state.deck.cards[index];
+        if (index != pinnedIndex) {
+            if (!card.bodyReferenced) {
+                cache.residentBytes -= CardBodyBytes(card);
+                ReleaseCardBody(card);
+                cache.clock[cache.hand] = cache.clock.back();
+                cache.clock.pop_back();
+                ++cache.evictions;
+                return true;
+            }
+            card.bodyReferenced = false;
         }
+        ++cache.hand;
+    }
+    return false;
+}
 
-        if (trimmed.rfind("id:", 0) == 0) {
-            currentCard.id = ExtractValue(trimmed, "id");
-        } else if (trimmed.rfind("question:", 0) == 0) {
-            currentCard.question = ExtractValue(trimmed, "question");
-        } else if (trimmed.rfind("answer:", 0) == 0) {
-            currentCard.answer = ExtractValue(trimmed, "answer");
+// shown marks the access that puts the card on screen; only that one counts
+// as a cache hit, so re-reading the card for its answer or the log does not
+// inflate the hit rate. Every reload counts as a miss.
+const Card& AccessCard(size_t index, bool shown) {
+    if (index >= g_state.deck.cards.size()) {
+        size_t ordinal = index - g_state.deck.cards.size();
+        for (const CardGenerator& generator : g_state.deck.generators) {
+            if (ordinal < generator.cardCount) {
+                GenerateCard(generator, ordinal, g_state.generatedCard);
+                break;
+            }
+            ordinal -= generator.cardCount;
         }
+        return g_state.generatedCard;
     }
 
-    if (inCard && IsCardComplete(currentCard)) {
-        cards.push_back(currentCard);
+    Card& card = g_state.deck.cards[index];
+    if (card.source == CardSource::Memory) {
+        return card;
     }
 
-    return cards;
-}
+    CardBodyCache& cache = g_state.bodyCache;
+    card.bodyReferenced = true;
+    if (IsCardBodyResident(card)) {
+        cache.hits += shown ? 1 : 0;
+        return card;
+    }
 
-std::vector<Card> LoadCards() {
-    const std::vector<Card> loadedCards = LoadCardsFromYaml("cards.yaml");
-    if (!loadedCards.empty()) {
-        return loadedCards;
+    ++cache.misses;
+    const auto start = std::chrono::steady_clock::now();
+    if (card.source == CardSource::Embedded) {
+#if defined(QATRAINER_EMBEDDED_DECK)
+        ReadEmbeddedCardBody(EMBEDDED_DECK, card);
+#endif
+    } else if (!ReadCardBodyAt(cache.deckFile.View(), static_cast<size_t>(card.sourceOffset),
+                               card)) {
+        card.question =
+            L"This card could not be reloaded from " + g_state.options.deckPath.wstring() + L".";
+        card.answer = L"The deck file changed after it was loaded.";
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    cache.totalReloadTime += elapsed;
+    cache.maxReloadTime = std::max<std::chrono::nanoseconds>(cache.maxReloadTime, elapsed);
+
+    const size_t budget = g_state.options.cardMemoryBudget;
+    cache.residentBytes += CardBodyBytes(card);
+    if (budget != 0) {
+        cache.clock.push_back(index);
+        while (cache.residentBytes > budget && EvictOneCardBody(index)) {
+        }
     }
+    return card;
+}
 
-    return LoadDefaultCards();
+ReviewItem CurrentReviewItem() {
+    return ReviewItemAt(g_state.currentItemIndex % ReviewItemCount());
 }
 
 HFONT CreateDefaultFont(HWND hwnd) {
@@ -235,16 +356,38 @@ void ApplyFontToControls() {
     }
 }
 
+// Deck text breaks lines with "\n", but edit controls only honour "\r\n".
+void SetEditText(HWND edit, const std::wstring& text) {
+    if (text.find(L'\n') == std::wstring::npos) {
+        SetWindowTextW(edit, text.c_str());
+        return;
+    }
+
+    std::wstring& converted = g_state.editText;
+    converted.clear();
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == L'\n' && (i == 0 || text[i - 1] != L'\r')) {
+            converted += L'\r';
+        }
+        converted += text[i];
+    }
+    SetWindowTextW(edit, converted.c_str());
+}
+
 void LoadCurrentCard(HWND hwnd) {
-    if (g_state.cards.empty()) {
+    if (ReviewItemCount() == 0) {
         SetWindowTextW(g_state.controls.hTopEdit, L"No cards available.");
         return;
     }
 
-    const Card& card = g_state.cards[g_state.currentCardIndex % g_state.cards.size()];
-    SetWindowTextW(g_state.controls.hTopEdit, card.question.c_str());
+    const ReviewItem item = CurrentReviewItem();
+    const Card& card = AccessCard(item.handle, true);
+    SetEditText(g_state.controls.hTopEdit,
+                RenderCardSide(card, item, g_state.deck.fields, g_state.questionTemplate, false,
+                               g_state.renderBuffers));
     SetWindowTextW(g_state.controls.hBottomEdit, L"");
     g_state.answerVisible = false;
+    g_state.questionShownAt = std::chrono::steady_clock::now();
 
     EnableWindow(g_state.controls.hBtnGood, FALSE);
     EnableWindow(g_state.controls.hBtnMeh, FALSE);
@@ -253,13 +396,17 @@ void LoadCurrentCard(HWND hwnd) {
 }
 
 void ShowAnswer() {
-    if (g_state.cards.empty() || g_state.answerVisible) {
+    if (ReviewItemCount() == 0 || g_state.answerVisible) {
         return;
     }
 
-    const Card& card = g_state.cards[g_state.currentCardIndex % g_state.cards.size()];
-    SetWindowTextW(g_state.controls.hBottomEdit, card.answer.c_str());
+    const ReviewItem item = CurrentReviewItem();
+    const Card& card = AccessCard(item.handle, false);
+    SetEditText(g_state.controls.hBottomEdit,
+                RenderCardSide(card, item, g_state.deck.fields, g_state.answerTemplate, true,
+                               g_state.renderBuffers));
     g_state.answerVisible = true;
+    g_state.answerShownAt = std::chrono::steady_clock::now();
 
     EnableWindow(g_state.controls.hBtnGood, TRUE);
     EnableWindow(g_state.controls.hBtnMeh, TRUE);
@@ -268,28 +415,218 @@ void ShowAnswer() {
 }
 
 void AdvanceToNextCard(HWND hwnd) {
-    if (g_state.cards.empty()) {
+    const size_t itemCount = ReviewItemCount();
+    if (itemCount == 0) {
         return;
     }
 
-    g_state.currentCardIndex = (g_state.currentCardIndex + 1) % g_state.cards.size();
-    if (g_state.currentCardIndex == 0) {
+    g_state.currentItemIndex = (g_state.currentItemIndex + 1) % itemCount;
+    if (g_state.currentItemIndex == 0) {
         MessageBoxW(hwnd, L"Reached the end of the deck. Restarting from the beginning.",
                     L"Q/A Trainer", MB_OK | MB_ICONINFORMATION);
     }
     LoadCurrentCard(hwnd);
 }
 
+// Shown before the next card, so the time spent reading it is not counted
+// as thinking about that card.
+void SuggestBreak(HWND hwnd, const FatigueEvent& event) {
+    std::wostringstream message;
+    message << std::fixed << std::setprecision(0) << L"You have reviewed " << event.sessionReviews
+            << L" cards in " << (event.sessionSeconds + 30) / 60 << L" minutes, and ";
+    if (event.signal == FatigueSignal::MoreFailures) {
+        message << L"you are recalling " << event.recentRecall * 100.0f << L"% of them, down from "
+                << event.baselineRecall * 100.0f << L"%.";
+    } else {
+        message << std::setprecision(1) << L"your answers now take "
+                << event.recentThinkMs / 1000.0f << L" s, up from "
+                << event.baselineThinkMs / 1000.0f << L" s.";
+    }
+    message << L"\n\nA short break may help before you carry on.";
+    MessageBoxW(hwnd, message.str().c_str(), L"Time for a Break?", MB_OK | MB_ICONINFORMATION);
+}
+
 void HandleRating(HWND hwnd, Rating rating) {
     if (!g_state.answerVisible) {
         return;
     }
 
-    const Card& card = g_state.cards[g_state.currentCardIndex % g_state.cards.size()];
-    AppendRatingToLog(card, rating);
+    const auto milliseconds = [](std::chrono::steady_clock::duration elapsed) {
+        const auto count = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+        return static_cast<uint32_t>(std::min<long long>(count, NO_RESPONSE_TIME - 1));
+    };
+    const uint32_t thinkMs = milliseconds(g_state.answerShownAt - g_state.questionShownAt);
+    const uint32_t rateMs = milliseconds(std::chrono::steady_clock::now() - g_state.answerShownAt);
+
+    const ReviewItem item = CurrentReviewItem();
+    const std::string time = CurrentLogTime();
+    uint32_t seconds = 0;
+    const bool timed = ParseReviewTime(time, seconds);
+    const size_t logged =
+        AppendRatingToLog(AccessCard(item.handle, false), item, rating, time, thinkMs, rateMs);
+    if (logged != 0 && timed) {
+        AddToRollups(g_state.activity, seconds, rating);
+        g_state.activity.logOffset += logged;
+    }
+    if (item.handle < g_state.deck.cards.size() && timed) {
+        const uint32_t card = static_cast<uint32_t>(item.handle);
+        if (card < g_state.cardStats.size() && ReviewCount(g_state.cardStats[card]) != 0 &&
+            seconds >= g_state.cardStats[card].lastTime) {
+            AddRetentionTrial(g_state.retention, 0, seconds - g_state.cardStats[card].lastTime,
+                              rating);
+        }
+        AddReview(g_state.cardStats, card, seconds, rating);
+        AddResponseTimes(g_state.responseTimes, card, thinkMs, rateMs);
+    }
+    FatigueEvent fatigue;
+    if (timed && AddFatigueRating(g_state.fatigue, seconds, rating, thinkMs, fatigue)) {
+        SuggestBreak(hwnd, fatigue);
+    }
     AdvanceToNextCard(hwnd);
 }
 
+// Reads the answer log written so far into g_state.cardStats.
+void LoadCardStats() {
+    ReviewHistory history;
+    MappedFile log;
+    if (log.Open("answers.log", MapOptions{})) {
+        LoadReviewHistory(log.View(), g_state.deck.cards, history);
+    }
+    g_state.cardStats = ComputeCardStats(history, g_state.deck.cards.size(), 0);
+    g_state.responseTimes = ComputeResponseTimes(history, g_state.deck.cards.size());
+    g_state.retention = ComputeRetentionCurves(
+        history, g_state.deck.cards.size(),
+        std::vector<uint32_t>(g_state.deck.cards.size(), 0), 1, 0);
+}
+
+// Loads answers.rollup and folds in what was logged after it was saved, or
+// rebuilds the rollups from the whole log if it no longer matches.
+void LoadActivityRollups() {
+    MappedFile log;
+    if (!log.Open("answers.log", MapOptions{})) {
+        g_state.activity = ActivityRollups{};
+        return;
+    }
+    MappedFile snapshot;
+    if (!snapshot.Open("answers.rollup", MapOptions{}) ||
+        !ParseRollups(snapshot.View(), log.View(), g_state.activity)) {
+        g_state.activity = ActivityRollups{};
+    }
+    CatchUpRollups(g_state.activity, log.View(), 0);
+}
+
+void SaveActivityRollups() {
+    g_state.answerLog.close();
+    MappedFile log;
+    if (!log.Open("answers.log", MapOptions{})) {
+        return;
+    }
+    std::ofstream snapshot("answers.rollup", std::ios::binary | std::ios::trunc);
+    snapshot << SerializeRollups(g_state.activity, log.View());
+}
+
+void ShowCardStatistics(HWND hwnd) {
+    CardStats deckTotal{};
+    CardResponseTimes deckTimes{};
+    size_t reviewedCards = 0;
+    for (const CardStats& card : g_state.cardStats) {
+        reviewedCards += ReviewCount(card) != 0 ? 1 : 0;
+        for (size_t rating = 0; rating < 3; ++rating) {
+            deckTotal.counts[rating] += card.counts[rating];
+        }
+        deckTotal.lapses += card.lapses;
+    }
+    for (const CardResponseTimes& times : g_state.responseTimes) {
+        MergeSketch(deckTimes.think, times.think);
+        MergeSketch(deckTimes.rate, times.rate);
+    }
+
+    const ReviewItem item = CurrentReviewItem();
+    const CardStats current = item.handle < g_state.cardStats.size()
+                                  ? g_state.cardStats[item.handle]
+                                  : CardStats{};
+    const CardResponseTimes currentTimes = item.handle < g_state.responseTimes.size()
+                                               ? g_state.responseTimes[item.handle]
+                                               : CardResponseTimes{};
+    const auto seconds = [](const QuantileSketch& sketch, double q) {
+        return SketchQuantile(sketch, q) / 1000.0;
+    };
+    uint32_t now = 0;
+    ParseReviewTime(CurrentLogTime(), now);
+    const auto reviewsIn = [now](RollupPeriod period, uint32_t periods) {
+        const uint32_t last = PeriodOf(now, period);
+        const ActivityCounts counts =
+            RollupRange(g_state.activity, period, last - std::min(last, periods - 1), last);
+        return counts.counts[0] + counts.counts[1] + counts.counts[2];
+    };
+    const auto share = [](const CardStats& stats, Rating rating) {
+        const uint32_t reviews = ReviewCount(stats);
+        return reviews == 0 ? 0.0
+                            : 100.0 * stats.counts[static_cast<size_t>(rating)] / reviews;
+    };
+
+    const GroupRetention forgetting = FitRetentionCurves(g_state.retention)[0];
+
+    std::wostringstream report;
+    report << std::fixed << std::setprecision(1);
+    report << L"This card: " << ReviewCount(current) << L" reviews, "
+           << 100.0 * RetentionRate(current) << L"% retained, " << current.lapses
+           << L" lapses\n"
+           << L"Good/Meh/Bad: " << share(current, Rating::Good) << L"% / "
+           << share(current, Rating::Meh) << L"% / " << share(current, Rating::Bad) << L"%\n"
+           << L"Average interval: " << AverageIntervalDays(current) << L" days\n"
+           << L"Think time: " << seconds(currentTimes.think, 0.5) << L" s median, "
+           << seconds(currentTimes.think, 0.9) << L" s 90th percentile\n\n"
+           << L"Deck: " << ReviewCount(deckTotal) << L" reviews of " << reviewedCards << L" of "
+           << g_state.deck.cards.size() << L" cards, " << 100.0 * RetentionRate(deckTotal)
+           << L"% retained, " << deckTotal.lapses << L" lapses\n"
+           << L"Think time: " << seconds(deckTimes.think, 0.5) << L" s median, "
+           << seconds(deckTimes.think, 0.9) << L" s 90th percentile\n"
+           << L"Rate time: " << seconds(deckTimes.rate, 0.5) << L" s median, "
+           << seconds(deckTimes.rate, 0.9) << L" s 90th percentile\n";
+    if (forgetting.exponential.points != 0 && forgetting.powerLaw.points != 0) {
+        report << L"Recall half-life: " << RetentionHalfLifeDays(forgetting.exponential)
+               << L" days (exponential fit), " << RetentionHalfLifeDays(forgetting.powerLaw)
+               << L" days (power-law fit)\n";
+    }
+    report << L"\n"
+           << L"Reviews today: " << reviewsIn(RollupPeriod::Day, 1) << L", last 7 days: "
+           << reviewsIn(RollupPeriod::Day, 7) << L", this week: "
+           << reviewsIn(RollupPeriod::Week, 1) << L", this month: "
+           << reviewsIn(RollupPeriod::Month, 1);
+
+    MessageBoxW(hwnd, report.str().c_str(), L"Card Statistics", MB_OK | MB_ICONINFORMATION);
+}
+
+void ShowCardMemoryReport(HWND hwnd) {
+    const CardBodyCache& cache = g_state.bodyCache;
+    const uint64_t lookups = cache.hits + cache.misses;
+    const double hitRate = lookups == 0 ? 100.0 : 100.0 * cache.hits / lookups;
+    const auto averageReload =
+        cache.misses == 0
+            ? std::chrono::nanoseconds{0}
+            : cache.totalReloadTime / static_cast<std::chrono::nanoseconds::rep>(cache.misses);
+
+    std::wostringstream report;
+    report << std::fixed << std::setprecision(1);
+    report << L"Budget: ";
+    if (g_state.options.cardMemoryBudget == 0) {
+        report << L"unlimited\n";
+    } else {
+        report << g_state.options.cardMemoryBudget / 1024.0 << L" KiB\n";
+    }
+    report << L"Resident card text: " << cache.residentBytes / 1024.0 << L" KiB\n"
+           << L"Hit rate: " << hitRate << L"% (" << cache.hits << L" hits, " << cache.misses
+           << L" reloads)\n"
+           << L"Evictions: " << cache.evictions << L"\n"
+           << L"Reload latency: "
+           << std::chrono::duration<double, std::micro>(averageReload).count() << L" us average, "
+           << std::chrono::duration<double, std::micro>(cache.maxReloadTime).count()
+           << L" us max";
+
+    MessageBoxW(hwnd, report.str().c_str(), L"Card Memory Usage", MB_OK | MB_ICONINFORMATION);
+}
+
 void LayoutControls(HWND hwnd, int width, int height) {
     const int clientWidth = width;
     const int clientHeight = height;
@@ -327,7 +664,7 @@ void LayoutControls(HWND hwnd, int width, int height) {
 }
 
 bool IdExists(const std::wstring& id) {
-    return std::any_of(g_state.cards.begin(), g_state.cards.end(),
+    return std::any_of(g_state.deck.cards.begin(), g_state.deck.cards.end(),
                        [&id](const Card& card) { return card.id == id; });
 }
 
@@ -396,8 +733,9 @@ void HandleSaveNewCard(HWND hwnd, const NewCardWindowState& state) {
     }
 
     const std::wstring id = GenerateUniqueId();
-    g_state.cards.push_back({id, question, answer});
-    g_state.currentCardIndex = g_state.cards.size() - 1;
+    g_state.deck.cards.push_back({id, question, answer});
+    g_state.reviewItems.push_back({g_state.deck.cards.size() - 1, CardDirection::Forward});
+    g_state.currentItemIndex = g_state.reviewItems.size() - 1;
     LoadCurrentCard(g_state.hMainWnd);
 
     MessageBoxW(hwnd, (L"New card saved with ID: " + id).c_str(), L"New Card",
@@ -477,6 +815,8 @@ void InitializeMenu(HWND hwnd) {
     HMENU hViewMenu = CreateMenu();
 
     AppendMenuW(hFileMenu, MF_STRING, ID_MENU_FILE_NEW_CARD, L"&New Card");
+    AppendMenuW(hViewMenu, MF_STRING, ID_MENU_VIEW_CARD_MEMORY, L"Card &Memory Usage...");
+    AppendMenuW(hViewMenu, MF_STRING, ID_MENU_VIEW_CARD_STATISTICS, L"Card &Statistics...");
 
     AppendMenuW(hMenuBar, MF_POPUP, reinterpret_cast<UINT_PTR>(hFileMenu), L"&File");
     AppendMenuW(hMenuBar, MF_POPUP, reinterpret_cast<UINT_PTR>(hEditMenu), L"&Edit");
@@ -515,6 +855,81 @@ bool HandleKeyDown(HWND hwnd, WPARAM key) {
     return false;
 }
 
+// Accepts a byte count with an optional K, M or G suffix; false for
+// anything else or a count that does not fit in size_t.
+bool ParseByteSize(const std::wstring& text, size_t& bytes) {
+    if (text.empty() || text[0] < L'0' || text[0] > L'9') {
+        return false;
+    }
+    size_t consumed = 0;
+    unsigned long long value = 0;
+    try {
+        value = std::stoull(text, &consumed);
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    const std::wstring suffix = text.substr(consumed);
+    unsigned shift = 0;
+    if (suffix == L"K" || suffix == L"k") {
+        shift = 10;
+    } else if (suffix == L"M" || suffix == L"m") {
+        shift = 20;
+    } else if (suffix == L"G" || suffix == L"g") {
+        shift = 30;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    if (value > (std::numeric_limits<size_t>::max() >> shift)) {
+        return false;
+    }
+
+    bytes = static_cast<size_t>(value << shift);
+    return true;
+}
+
+// Returns false, after telling the user, when an option has a bad value.
+bool ParseCommandLine(AppOptions& options) {
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv) {
+        return true;
+    }
+
+    const std::wstring budgetPrefix = L"--card-memory-budget=";
+    const std::wstring deckPrefix = L"--deck=";
+    const std::wstring prefaultPrefix = L"--deck-prefault=";
+    for (int i = 1; i < argc; ++i) {
+        const std::wstring arg = argv[i];
+        if (arg.rfind(budgetPrefix, 0) == 0) {
+            if (!ParseByteSize(arg.substr(budgetPrefix.size()), options.cardMemoryBudget)) {
+                const std::wstring message =
+                    L"Invalid option " + arg +
+                    L"\n\nGive a byte count with an optional K, M or G suffix.";
+                MessageBoxW(nullptr, message.c_str(), L"Q/A Trainer", MB_OK | MB_ICONERROR);
+                LocalFree(argv);
+                return false;
+            }
+        } else if (arg.rfind(deckPrefix, 0) == 0) {
+            options.deckPath = arg.substr(deckPrefix.size());
+            options.deckPathGiven = true;
+        } else if (arg.rfind(prefaultPrefix, 0) == 0) {
+            if (!ParsePrefaultMode(ToUtf8(arg.substr(prefaultPrefix.size())),
+                                   options.deckMapping.prefault)) {
+                const std::wstring message =
+                    L"Invalid option " + arg + L"\n\nUse none, populate or background.";
+                MessageBoxW(nullptr, message.c_str(), L"Q/A Trainer", MB_OK | MB_ICONERROR);
+                LocalFree(argv);
+                return false;
+            }
+        } else if (arg == L"--deck-huge-pages") {
+            options.deckMapping.hugePages = true;
+        }
+    }
+    LocalFree(argv);
+    return true;
+}
+
 void InitializeDpiAwareness() {
     HMODULE user32 = LoadLibraryW(L"user32.dll");
     if (user32) {
@@ -534,8 +949,19 @@ void InitializeDpiAwareness() {
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
     case WM_CREATE: {
-        g_state.cards = LoadCards();
-        g_state.answerLog.open("answers.log", std::ios::out | std::ios::app);
+        g_state.deck = LoadDeck();
+        g_state.reviewItems = BuildReviewItems(g_state.deck.cards);
+        if (!CompileDeckTemplates(g_state.deck, g_state.questionTemplate,
+                                  g_state.answerTemplate)) {
+            MessageBoxW(hwnd, L"The deck's display templates are malformed and were ignored.",
+                        L"Q/A Trainer", MB_OK | MB_ICONWARNING);
+            g_state.questionTemplate = CompiledTemplate{};
+            g_state.answerTemplate = CompiledTemplate{};
+        }
+        InitializeCardBodyCache();
+        LoadCardStats();
+        LoadActivityRollups();
+        g_state.answerLog.open("answers.log", std::ios::out | std::ios::app | std::ios::binary);
         g_state.hMainWnd = hwnd;
 
         InitializeMenu(hwnd);
@@ -606,12 +1032,19 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
         case ID_MENU_FILE_NEW_CARD:
             CreateNewCardWindow(GetModuleHandleW(nullptr));
             break;
+        case ID_MENU_VIEW_CARD_MEMORY:
+            ShowCardMemoryReport(hwnd);
+            break;
+        case ID_MENU_VIEW_CARD_STATISTICS:
+            ShowCardStatistics(hwnd);
+            break;
         default:
             break;
         }
         return 0;
     }
     case WM_DESTROY:
+        SaveActivityRollups();
         if (g_state.hFont) {
             DeleteObject(g_state.hFont);
             g_state.hFont = nullptr;
@@ -626,6 +1059,9 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 
 int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE, LPWSTR, int nCmdShow) {
     InitializeDpiAwareness();
+    if (!ParseCommandLine(g_state.options)) {
+        return 1;
+    }
 
     WNDCLASSEXW mainWc{};
     mainWc.cbSize = sizeof(WNDCLASSEXW);
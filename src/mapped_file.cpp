@@ -0,0 +1,215 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr size_t PREFAULT_STRIDE = 4096;
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+#if defined(_WIN32)
+bool MappedFile::Open(const std::filesystem::path& path, const MapOptions& options) {
+    Close();
+
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    open = true;
+    size = static_cast<size_t>(fileSize.QuadPart);
+    if (size == 0) {
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        Close();
+        return false;
+    }
+    mappingHandle = mapping;
+
+    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!data) {
+        Close();
+        return false;
+    }
+
+    if (options.prefault == PrefaultMode::Populate) {
+        Prefault();
+    } else if (options.prefault == PrefaultMode::Background) {
+        prefaultThread = std::thread([this]() { Prefault(); });
+    }
+    return true;
+}
+
+void MappedFile::Close() {
+    stopPrefault = true;
+    if (prefaultThread.joinable()) {
+        prefaultThread.join();
+    }
+    stopPrefault = false;
+
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+    if (mappingHandle) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle) {
+        CloseHandle(fileHandle);
+    }
+    data = nullptr;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+    size = 0;
+    open = false;
+}
+
+void MappedFile::Release(size_t end) {
+    SYSTEM_INFO info{};
+    GetSystemInfo(&info);
+    end -= end % info.dwPageSize;
+    if (data && end > 0) {
+        // Unlocking pages that were never locked removes them from the
+        // working set, which is all that is wanted here.
+        VirtualUnlock(const_cast<char*>(data), std::min<size_t>(end, size));
+    }
+}
+
+void MappedFile::Prefault() {
+    // PrefetchVirtualMemory issues one large read instead of a fault per
+    // page; it only exists from Windows 8 on, so look it up at runtime.
+    using PrefetchVirtualMemoryFunc =
+        BOOL(WINAPI*)(HANDLE, ULONG_PTR, PWIN32_MEMORY_RANGE_ENTRY, ULONG);
+    static const auto prefetchVirtualMemory = reinterpret_cast<PrefetchVirtualMemoryFunc>(
+        GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory"));
+    if (prefetchVirtualMemory) {
+        WIN32_MEMORY_RANGE_ENTRY range{const_cast<char*>(data), size};
+        prefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+
+    volatile char sink = 0;
+    for (size_t offset = 0; offset < size && !stopPrefault; offset += PREFAULT_STRIDE) {
+        sink = sink + data[offset];
+    }
+}
+#else
+bool MappedFile::Open(const std::filesystem::path& path, const MapOptions& options) {
+    Close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat status {};
+    if (fstat(fd, &status) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    open = true;
+    size = static_cast<size_t>(status.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+    if (options.prefault == PrefaultMode::Populate) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void* mapped = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        open = false;
+        size = 0;
+        return false;
+    }
+    data = static_cast<const char*>(mapped);
+
+#if defined(MADV_HUGEPAGE)
+    if (options.hugePages) {
+        madvise(mapped, size, MADV_HUGEPAGE);
+    }
+#endif
+
+#if !defined(MAP_POPULATE)
+    if (options.prefault == PrefaultMode::Populate) {
+        Prefault();
+    }
+#endif
+    if (options.prefault == PrefaultMode::Background) {
+        prefaultThread = std::thread([this]() { Prefault(); });
+    }
+    return true;
+}
+
+void MappedFile::Close() {
+    stopPrefault = true;
+    if (prefaultThread.joinable()) {
+        prefaultThread.join();
+    }
+    stopPrefault = false;
+
+    if (data) {
+        munmap(const_cast<char*>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    open = false;
+}
+
+void MappedFile::Release(size_t end) {
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    end -= end % pageSize;
+    if (data && end > 0) {
+        madvise(const_cast<char*>(data), std::min<size_t>(end, size), MADV_DONTNEED);
+    }
+}
+
+void MappedFile::Prefault() {
+    madvise(const_cast<char*>(data), size, MADV_WILLNEED);
+
+    volatile char sink = 0;
+    for (size_t offset = 0; offset < size && !stopPrefault; offset += PREFAULT_STRIDE) {
+        sink = sink + data[offset];
+    }
+}
+#endif
+
+bool ParsePrefaultMode(std::string_view text, PrefaultMode& mode) {
+    if (text == "none") {
+        mode = PrefaultMode::None;
+    } else if (text == "populate") {
+        mode = PrefaultMode::Populate;
+    } else if (text == "background") {
+        mode = PrefaultMode::Background;
+    } else {
+        return false;
+    }
+    return true;
+}
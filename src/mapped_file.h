@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+#include <thread>
+
+// How the pages of a mapping are brought in before first use.
+enum class PrefaultMode {
+    None,        // fault pages in lazily as they are touched
+    Populate,    // fault the whole file in before Open returns
+    Background,  // fault the file in on a helper thread while the caller proceeds
+};
+
+struct MapOptions {
+    // Ask for transparent huge pages. Only honoured on Linux; Windows cannot
+    // back file views with large pages.
+    bool hugePages{false};
+    PrefaultMode prefault{PrefaultMode::None};
+};
+
+// Read-only view of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::filesystem::path& path, const MapOptions& options);
+    void Close();
+
+    // Drops the pages before end from the process, so a front-to-back
+    // reader keeps a constant resident size; they fault back in if touched.
+    void Release(size_t end);
+
+    bool IsOpen() const { return open; }
+    std::string_view View() const { return {data, size}; }
+
+private:
+    void Prefault();
+
+    const char* data{nullptr};
+    size_t size{0};
+    bool open{false};
+#if defined(_WIN32)
+    void* fileHandle{nullptr};
+    void* mappingHandle{nullptr};
+#endif
+    std::thread prefaultThread{};
+    std::atomic<bool> stopPrefault{false};
+};
+
+bool ParsePrefaultMode(std::string_view text, PrefaultMode& mode);
@@ -0,0 +1,101 @@
+#include "quantile_sketch.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Bucket i holds (gamma^(i-1), gamma^i].
+const double GAMMA = (1.0 + SKETCH_RELATIVE_ACCURACY) / (1.0 - SKETCH_RELATIVE_ACCURACY);
+const double LOG_GAMMA = std::log(GAMMA);
+
+int32_t BucketIndex(double value) {
+    return static_cast<int32_t>(std::ceil(std::log(value) / LOG_GAMMA));
+}
+
+// The point of the bucket whose relative distance to both ends is
+// SKETCH_RELATIVE_ACCURACY.
+double BucketValue(int32_t index) {
+    return 2.0 * std::pow(GAMMA, index) / (GAMMA + 1.0);
+}
+
+void CollapseLowest(QuantileSketch& sketch) {
+    if (sketch.buckets.size() <= MAX_SKETCH_BUCKETS) {
+        return;
+    }
+    const size_t excess = sketch.buckets.size() - MAX_SKETCH_BUCKETS;
+    for (size_t i = 0; i < excess; ++i) {
+        sketch.buckets[excess].count += sketch.buckets[i].count;
+    }
+    sketch.buckets.erase(sketch.buckets.begin(), sketch.buckets.begin() + excess);
+}
+
+void UpdateRange(QuantileSketch& sketch, double min, double max, uint64_t added) {
+    sketch.min = sketch.count == 0 ? min : std::min(sketch.min, min);
+    sketch.max = sketch.count == 0 ? max : std::max(sketch.max, max);
+    sketch.count += added;
+}
+}
+
+void AddToSketch(QuantileSketch& sketch, double value) {
+    UpdateRange(sketch, value, value, 1);
+    if (!(value >= 1.0)) {
+        ++sketch.zeroCount;
+        return;
+    }
+
+    const int32_t index = BucketIndex(value);
+    const auto bucket = std::lower_bound(
+        sketch.buckets.begin(), sketch.buckets.end(), index,
+        [](const SketchBucket& existing, int32_t wanted) { return existing.index < wanted; });
+    if (bucket != sketch.buckets.end() && bucket->index == index) {
+        ++bucket->count;
+        return;
+    }
+    sketch.buckets.insert(bucket, {index, 1});
+    CollapseLowest(sketch);
+}
+
+void MergeSketch(QuantileSketch& into, const QuantileSketch& other) {
+    if (other.count == 0) {
+        return;
+    }
+    UpdateRange(into, other.min, other.max, other.count);
+    into.zeroCount += other.zeroCount;
+
+    std::vector<SketchBucket> merged;
+    merged.reserve(into.buckets.size() + other.buckets.size());
+    auto left = into.buckets.begin();
+    auto right = other.buckets.begin();
+    while (left != into.buckets.end() || right != other.buckets.end()) {
+        if (right == other.buckets.end() ||
+            (left != into.buckets.end() && left->index < right->index)) {
+            merged.push_back(*left++);
+        } else if (left == into.buckets.end() || right->index < left->index) {
+            merged.push_back(*right++);
+        } else {
+            merged.push_back({left->index, left->count + right->count});
+            ++left;
+            ++right;
+        }
+    }
+    into.buckets = std::move(merged);
+    CollapseLowest(into);
+}
+
+double SketchQuantile(const QuantileSketch& sketch, double q) {
+    if (sketch.count == 0) {
+        return 0.0;
+    }
+    const double rank = std::clamp(q, 0.0, 1.0) * static_cast<double>(sketch.count - 1);
+    uint64_t seen = sketch.zeroCount;
+    if (static_cast<double>(seen) > rank) {
+        return sketch.min;
+    }
+    for (const SketchBucket& bucket : sketch.buckets) {
+        seen += bucket.count;
+        if (static_cast<double>(seen) > rank) {
+            return std::clamp(BucketValue(bucket.index), sketch.min, sketch.max);
+        }
+    }
+    return sketch.max;
+}
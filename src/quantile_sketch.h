@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// DDSketch: quantiles of positive values within a fixed relative error.
+// Values fall into logarithmic buckets, so a sketch is a handful of counts
+// per order of magnitude and two sketches merge by adding counts bucket by
+// bucket, exactly, in any order. Only non-empty buckets are stored, which
+// keeps the per-card sketches of a large deck small.
+
+// Quantiles come back within this fraction of a value that has that rank.
+constexpr double SKETCH_RELATIVE_ACCURACY = 0.01;
+// Past this many buckets the lowest ones are merged; it takes values
+// spanning 10^8 for that to happen.
+constexpr size_t MAX_SKETCH_BUCKETS = 1024;
+
+struct SketchBucket {
+    int32_t index;
+    uint32_t count;
+};
+
+struct QuantileSketch {
+    // Ascending by index.
+    std::vector<SketchBucket> buckets{};
+    // Values below 1, which have no logarithmic bucket.
+    uint64_t zeroCount{0};
+    uint64_t count{0};
+    double min{0.0};
+    double max{0.0};
+};
+
+void AddToSketch(QuantileSketch& sketch, double value);
+
+void MergeSketch(QuantileSketch& into, const QuantileSketch& other);
+
+// The value at quantile q (0 to 1); 0 for an empty sketch.
+double SketchQuantile(const QuantileSketch& sketch, double q);
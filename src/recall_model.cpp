@@ -0,0 +1,254 @@
+#include "recall_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <thread>
+
+namespace {
+// Below this many examples per thread, starting a thread and averaging its
+// weights costs more than the shard it would train on.
+constexpr size_t PARALLEL_RECALL_MIN_EXAMPLES = 1 << 16;
+// Weight of the latest outcome in RecallState::learnerRecall.
+constexpr float LEARNER_RECALL_RATE = 0.05f;
+
+float Sigmoid(float z) {
+    return 1.0f / (1.0f + std::exp(-std::min(std::max(z, -30.0f), 30.0f)));
+}
+
+// Weighted sum of one example's standardized features. The lanes are
+// independent until the final sum, so the loop is one vector operation.
+float Score(const RecallModel& model, const float* x) {
+    float lanes[RECALL_FEATURE_COUNT];
+    for (size_t f = 0; f < RECALL_FEATURE_COUNT; ++f) {
+        lanes[f] = (x[f] - model.means[f]) * model.scales[f] * model.weights[f];
+    }
+    float sum = 0.0f;
+    for (size_t f = 0; f < RECALL_FEATURE_COUNT; ++f) {
+        sum += lanes[f];
+    }
+    return sum;
+}
+
+// SGD over examples [begin, end) in mini-batches visited in a shuffled
+// order, updating model's weights.
+void TrainShard(const RecallExamples& examples, size_t begin, size_t end,
+                const RecallTrainingOptions& options, float learningRate, uint64_t seed,
+                RecallModel& model) {
+    const size_t batchSize = std::max<size_t>(1, options.batchSize);
+    std::vector<size_t> batches((end - begin + batchSize - 1) / batchSize);
+    std::iota(batches.begin(), batches.end(), size_t{0});
+    std::mt19937_64 random(seed);
+    std::shuffle(batches.begin(), batches.end(), random);
+
+    for (const size_t batch : batches) {
+        const size_t first = begin + batch * batchSize;
+        const size_t last = std::min(end, first + batchSize);
+        float gradient[RECALL_FEATURE_COUNT]{};
+        for (size_t i = first; i < last; ++i) {
+            const float* x = examples.features.data() + i * RECALL_FEATURE_COUNT;
+            const float error = Sigmoid(Score(model, x)) - examples.recalled[i];
+            for (size_t f = 0; f < RECALL_FEATURE_COUNT; ++f) {
+                gradient[f] += error * (x[f] - model.means[f]) * model.scales[f];
+            }
+        }
+        const float step = learningRate / static_cast<float>(last - first);
+        for (size_t f = 0; f < RECALL_FEATURE_COUNT; ++f) {
+            // The bias is not shrunk.
+            const float decay = f == 0 ? 0.0f : options.l2 * model.weights[f];
+            model.weights[f] -= step * gradient[f] + learningRate * decay;
+        }
+    }
+}
+}
+
+bool BuildRecallFeatures(const RecallState& state, uint32_t card, uint32_t time,
+                         RecallFeatures& features) {
+    if (card >= state.reviews.size() || state.reviews[card] == 0) {
+        return false;
+    }
+    const float reviews = static_cast<float>(state.reviews[card]);
+    const uint32_t elapsed = time > state.lastTimes[card] ? time - state.lastTimes[card] : 0;
+    const uint32_t thinkMs = state.lastThinkMs[card];
+    float* x = features.values;
+    x[0] = 1.0f;
+    x[1] = std::log1p(static_cast<float>(elapsed) / 86400.0f);
+    x[2] = (static_cast<float>(state.recalls[card]) + 1.0f) / (reviews + 2.0f);
+    x[3] = static_cast<float>(state.lapses[card]) / reviews;
+    x[4] = std::log1p(reviews);
+    x[5] = state.lastRatings[card] == ReviewRating::Bad ? 1.0f : 0.0f;
+    x[6] = thinkMs == NO_RESPONSE_TIME ? 0.0f : std::log1p(static_cast<float>(thinkMs) / 1000.0f);
+    x[7] = state.learnerRecall;
+    return true;
+}
+
+void AddRecallObservation(RecallState& state, uint32_t card, uint32_t time, ReviewRating rating,
+                          uint32_t thinkMs) {
+    if (card >= state.reviews.size()) {
+        const size_t size = static_cast<size_t>(card) + 1;
+        state.lastTimes.resize(size);
+        state.reviews.resize(size);
+        state.recalls.resize(size);
+        state.lapses.resize(size);
+        state.lastRatings.resize(size, ReviewRating::Bad);
+        state.lastThinkMs.resize(size, NO_RESPONSE_TIME);
+    }
+    const bool recalled = rating != ReviewRating::Bad;
+    // Counted as in CardStats: a Bad rating right after a Meh or Good one.
+    state.lapses[card] +=
+        !recalled && state.reviews[card] != 0 && state.lastRatings[card] != ReviewRating::Bad;
+    ++state.reviews[card];
+    state.recalls[card] += recalled ? 1 : 0;
+    state.lastTimes[card] = time;
+    state.lastRatings[card] = rating;
+    state.lastThinkMs[card] = thinkMs;
+    state.learnerRecall += LEARNER_RECALL_RATE * ((recalled ? 1.0f : 0.0f) - state.learnerRecall);
+}
+
+RecallExamples BuildRecallExamples(const ReviewHistory& history, size_t cardCount) {
+    RecallState state;
+    state.lastTimes.resize(cardCount);
+    state.reviews.resize(cardCount);
+    state.recalls.resize(cardCount);
+    state.lapses.resize(cardCount);
+    state.lastRatings.resize(cardCount, ReviewRating::Bad);
+    state.lastThinkMs.resize(cardCount, NO_RESPONSE_TIME);
+
+    RecallExamples examples;
+    examples.features.reserve(history.cards.size() * RECALL_FEATURE_COUNT);
+    examples.recalled.reserve(history.cards.size());
+    for (size_t i = 0; i < history.cards.size(); ++i) {
+        const uint32_t card = history.cards[i];
+        if (card >= cardCount) {
+            continue;
+        }
+        RecallFeatures features;
+        if (BuildRecallFeatures(state, card, history.times[i], features)) {
+            examples.features.insert(examples.features.end(), features.values,
+                                     features.values + RECALL_FEATURE_COUNT);
+            examples.recalled.push_back(history.ratings[i] != ReviewRating::Bad ? 1 : 0);
+        }
+        AddRecallObservation(state, card, history.times[i], history.ratings[i],
+                             history.thinkMs[i]);
+    }
+    return examples;
+}
+
+RecallModel TrainRecallModel(const RecallExamples& examples, size_t begin, size_t end,
+                             const RecallTrainingOptions& options) {
+    RecallModel model;
+    end = std::min(end, examples.recalled.size());
+    begin = std::min(begin, end);
+    const size_t count = end - begin;
+    model.scales[0] = 1.0f;
+    if (count == 0) {
+        return model;
+    }
+
+    double sums[RECALL_FEATURE_COUNT]{};
+    double squares[RECALL_FEATURE_COUNT]{};
+    for (size_t i = begin; i < end; ++i) {
+        const float* x = examples.features.data() + i * RECALL_FEATURE_COUNT;
+        for (size_t f = 1; f < RECALL_FEATURE_COUNT; ++f) {
+            sums[f] += x[f];
+            squares[f] += double{x[f]} * x[f];
+        }
+    }
+    for (size_t f = 1; f < RECALL_FEATURE_COUNT; ++f) {
+        const double mean = sums[f] / static_cast<double>(count);
+        const double variance =
+            std::max(0.0, squares[f] / static_cast<double>(count) - mean * mean);
+        model.means[f] = static_cast<float>(mean);
+        model.scales[f] = variance > 1e-12 ? static_cast<float>(1.0 / std::sqrt(variance)) : 0.0f;
+    }
+
+    const size_t hardwareThreads =
+        options.threads != 0 ? options.threads
+                             : std::max<size_t>(1, std::thread::hardware_concurrency());
+    const size_t partCount = std::max<size_t>(
+        1, std::min(hardwareThreads, count / PARALLEL_RECALL_MIN_EXAMPLES));
+    std::vector<RecallModel> parts(partCount);
+    for (size_t epoch = 0; epoch < options.epochs; ++epoch) {
+        const float learningRate = options.learningRate / static_cast<float>(1 + epoch);
+        std::vector<std::thread> workers;
+        for (size_t part = 0; part < partCount; ++part) {
+            const auto train = [&, part]() {
+                parts[part] = model;
+                TrainShard(examples, begin + count / partCount * part,
+                           part + 1 == partCount ? end : begin + count / partCount * (part + 1),
+                           options, learningRate, options.seed + epoch * partCount + part,
+                           parts[part]);
+            };
+            if (part + 1 == partCount) {
+                train();
+            } else {
+                workers.emplace_back(train);
+            }
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        for (size_t f = 0; f < RECALL_FEATURE_COUNT; ++f) {
+            float sum = 0.0f;
+            for (const RecallModel& part : parts) {
+                sum += part.weights[f];
+            }
+            model.weights[f] = sum / static_cast<float>(partCount);
+        }
+    }
+    return model;
+}
+
+float PredictRecall(const RecallModel& model, const RecallFeatures& features) {
+    return Sigmoid(Score(model, features.values));
+}
+
+RecallEvaluation EvaluateRecallModel(const RecallModel& model, const RecallExamples& examples,
+                                     size_t begin, size_t end) {
+    RecallEvaluation evaluation;
+    end = std::min(end, examples.recalled.size());
+    begin = std::min(begin, end);
+    evaluation.examples = end - begin;
+    if (begin == end) {
+        return evaluation;
+    }
+
+    std::vector<std::pair<float, uint8_t>> scored(end - begin);
+    size_t positives = 0;
+    for (size_t i = begin; i < end; ++i) {
+        const float recall =
+            Sigmoid(Score(model, examples.features.data() + i * RECALL_FEATURE_COUNT));
+        scored[i - begin] = {recall, examples.recalled[i]};
+        positives += examples.recalled[i];
+        const double p = std::min(std::max<double>(recall, 1e-6), 1.0 - 1e-6);
+        evaluation.logLoss -= examples.recalled[i] != 0 ? std::log(p) : std::log(1.0 - p);
+    }
+    const size_t count = scored.size();
+    evaluation.logLoss /= static_cast<double>(count);
+    const double share = std::min(
+        std::max(static_cast<double>(positives) / static_cast<double>(count), 1e-6), 1.0 - 1e-6);
+    evaluation.baselineLogLoss = -(share * std::log(share) + (1.0 - share) * std::log(1.0 - share));
+
+    // Mann-Whitney: the rank sum of the recalled examples, tied scores
+    // sharing their mean rank.
+    std::sort(scored.begin(), scored.end());
+    double rankSum = 0.0;
+    for (size_t i = 0; i < count;) {
+        size_t tied = i;
+        size_t tiedPositives = 0;
+        while (tied < count && scored[tied].first == scored[i].first) {
+            tiedPositives += scored[tied].second;
+            ++tied;
+        }
+        rankSum += static_cast<double>(tiedPositives) * static_cast<double>(i + 1 + tied) / 2.0;
+        i = tied;
+    }
+    const size_t negatives = count - positives;
+    const double positiveCount = static_cast<double>(positives);
+    evaluation.auc = positives == 0 || negatives == 0
+                         ? 0.5
+                         : (rankSum - positiveCount * (positiveCount + 1.0) / 2.0) /
+                               (positiveCount * static_cast<double>(negatives));
+    return evaluation;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "review_stats.h"
+
+// Probability that a card is recalled (rated Meh or Good) at its next
+// review, by logistic regression over features of what came before it.
+// Features are built from a running RecallState, the same way when
+// training on a logged history and when scoring a card now, so a model
+// never sees the outcome it predicts. Each example is one row of
+// RECALL_FEATURE_COUNT floats, a single vector register wide; training
+// runs mini-batch SGD on separate threads over contiguous shards of the
+// examples and averages their weights after each epoch.
+
+// Bias, log days since the card's last review, the card's smoothed recall
+// share, lapses per review and log review count, whether its last rating
+// was Bad, the log of its last think time and the learner's recent recall
+// share.
+constexpr size_t RECALL_FEATURE_COUNT = 8;
+
+struct RecallFeatures {
+    float values[RECALL_FEATURE_COUNT]{};
+};
+
+// What the features of a card's next review depend on, by deck index.
+struct RecallState {
+    std::vector<uint32_t> lastTimes{};
+    std::vector<uint32_t> reviews{};
+    std::vector<uint32_t> recalls{};
+    std::vector<uint32_t> lapses{};
+    std::vector<ReviewRating> lastRatings{};
+    std::vector<uint32_t> lastThinkMs{};
+    // Moving average of all the learner's outcomes, recent ones weighing most.
+    float learnerRecall{0.8f};
+};
+
+// Features of reviewing card at time; cards never reviewed have none and
+// false is returned.
+bool BuildRecallFeatures(const RecallState& state, uint32_t card, uint32_t time,
+                         RecallFeatures& features);
+
+// Folds in a review of card, growing state to cover it.
+void AddRecallObservation(RecallState& state, uint32_t card, uint32_t time, ReviewRating rating,
+                          uint32_t thinkMs);
+
+struct RecallExamples {
+    // Example i's features at i * RECALL_FEATURE_COUNT.
+    std::vector<float> features{};
+    std::vector<uint8_t> recalled{};
+};
+
+// One example per review of a card reviewed before, replaying the history
+// in order through a RecallState; the examples keep the history's order.
+RecallExamples BuildRecallExamples(const ReviewHistory& history, size_t cardCount);
+
+struct RecallModel {
+    float weights[RECALL_FEATURE_COUNT]{};
+    // Features are standardized with these before weighting; the bias
+    // feature has mean 0 and scale 1.
+    float means[RECALL_FEATURE_COUNT]{};
+    float scales[RECALL_FEATURE_COUNT]{};
+};
+
+struct RecallTrainingOptions {
+    size_t epochs{8};
+    size_t batchSize{256};
+    float learningRate{0.5f};
+    float l2{1e-4f};
+    // 0 uses one per hardware thread.
+    size_t threads{0};
+    uint64_t seed{1};
+};
+
+// Trains on examples [begin, end).
+RecallModel TrainRecallModel(const RecallExamples& examples, size_t begin, size_t end,
+                             const RecallTrainingOptions& options);
+
+float PredictRecall(const RecallModel& model, const RecallFeatures& features);
+
+struct RecallEvaluation {
+    double auc{0.0};
+    // Mean negative log likelihood, and that of always predicting the
+    // examples' recall share.
+    double logLoss{0.0};
+    double baselineLogLoss{0.0};
+    size_t examples{0};
+};
+
+// Scores examples [begin, end).
+RecallEvaluation EvaluateRecallModel(const RecallModel& model, const RecallExamples& examples,
+                                     size_t begin, size_t end);
@@ -0,0 +1,291 @@
+#include "retention_curves.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace {
+// Below this many reviews per thread, starting a thread costs more than the
+// part of the history it would bin.
+constexpr size_t PARALLEL_RETENTION_MIN_REVIEWS = 1 << 20;
+constexpr double SECONDS_PER_DAY = 86400.0;
+constexpr double SQRT_HALF = 0.70710678118654752;
+
+size_t RetentionBin(uint32_t elapsed) {
+    // frexp gives elapsed / 60 = m * 2^e with m in [0.5, 1); the upper half
+    // of the octave starts at m = sqrt(1/2).
+    int exponent = 0;
+    const double mantissa = std::frexp(elapsed / double{RETENTION_MIN_INTERVAL}, &exponent);
+    const size_t bin = 2 * static_cast<size_t>(exponent - 1) + (mantissa >= SQRT_HALF ? 1 : 0);
+    return std::min(bin, RETENTION_BIN_COUNT - 1);
+}
+
+void AddTrial(RetentionCurves& curves, uint32_t group, uint32_t previous, uint32_t time,
+              ReviewRating rating) {
+    // A log whose clock went back gives no interval.
+    if (group < curves.groups && time >= previous + RETENTION_MIN_INTERVAL) {
+        AddRetentionTrial(curves, group, time - previous, rating);
+    }
+}
+
+// Where each card was first and last seen in one run of the history; 0 for
+// cards the run does not review.
+struct RunEnds {
+    std::vector<uint32_t> firstTimes{};
+    std::vector<ReviewRating> firstRatings{};
+    std::vector<uint32_t> lastTimes{};
+};
+
+// Bins the trials of history[begin, end) whose previous review is in the
+// same run, and records the run's ends for those that straddle two runs.
+void BinRun(const ReviewHistory& history, size_t begin, size_t end,
+            const std::vector<uint32_t>& groupOfCard, size_t cardCount, RetentionCurves& curves,
+            RunEnds& ends) {
+    ends.firstTimes.assign(cardCount, 0);
+    ends.firstRatings.assign(cardCount, ReviewRating::Bad);
+    ends.lastTimes.assign(cardCount, 0);
+    const size_t groupedCards = std::min(cardCount, groupOfCard.size());
+    for (size_t i = begin; i < end; ++i) {
+        const uint32_t card = history.cards[i];
+        if (card >= groupedCards || groupOfCard[card] == NO_RETENTION_GROUP) {
+            continue;
+        }
+        const uint32_t time = history.times[i];
+        if (ends.lastTimes[card] != 0) {
+            AddTrial(curves, groupOfCard[card], ends.lastTimes[card], time, history.ratings[i]);
+        } else {
+            ends.firstTimes[card] = time;
+            ends.firstRatings[card] = history.ratings[i];
+        }
+        ends.lastTimes[card] = time;
+    }
+}
+
+// Weighted least squares sums of one model over every group at once.
+struct FitSums {
+    std::vector<double> weights{};
+    std::vector<double> xs{};
+    std::vector<double> ys{};
+    std::vector<double> xxs{};
+    std::vector<double> xys{};
+};
+
+void SolveFit(const FitSums& sums, size_t group, RetentionFit& fit) {
+    const double w = sums.weights[group];
+    const double determinant = w * sums.xxs[group] - sums.xs[group] * sums.xs[group];
+    if (fit.points < 2 || !(std::abs(determinant) > 1e-12 * w * w)) {
+        fit.points = 0;
+        return;
+    }
+    const double slope = (w * sums.xys[group] - sums.xs[group] * sums.ys[group]) / determinant;
+    fit.scale = std::exp((sums.ys[group] - slope * sums.xs[group]) / w);
+    fit.decay = -slope;
+}
+}
+
+uint32_t RetentionBinStart(size_t bin) {
+    return static_cast<uint32_t>(
+        std::ceil(RETENTION_MIN_INTERVAL * std::exp2(static_cast<double>(bin) / 2.0)));
+}
+
+RetentionCurves MakeRetentionCurves(size_t groups) {
+    RetentionCurves curves;
+    curves.groups = groups;
+    curves.trials.assign(groups * RETENTION_BIN_COUNT, 0);
+    curves.recalled.assign(groups * RETENTION_BIN_COUNT, 0);
+    curves.elapsedSeconds.assign(groups * RETENTION_BIN_COUNT, 0);
+    return curves;
+}
+
+void AddRetentionTrial(RetentionCurves& curves, uint32_t group, uint32_t elapsed,
+                       ReviewRating rating) {
+    if (group >= curves.groups || elapsed < RETENTION_MIN_INTERVAL) {
+        return;
+    }
+    const size_t cell = group * RETENTION_BIN_COUNT + RetentionBin(elapsed);
+    ++curves.trials[cell];
+    curves.recalled[cell] += rating != ReviewRating::Bad ? 1 : 0;
+    curves.elapsedSeconds[cell] += elapsed;
+}
+
+RetentionCurves ComputeRetentionCurves(const ReviewHistory& history, size_t cardCount,
+                                       const std::vector<uint32_t>& groupOfCard, size_t groups,
+                                       size_t threads) {
+    // Each thread bins a contiguous run with a table of card ends of its
+    // own, so a run must be long enough to pay for clearing that table.
+    const size_t reviews = history.cards.size();
+    const size_t hardwareThreads =
+        threads != 0 ? threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+    const size_t partCount = std::max<size_t>(
+        1, std::min(hardwareThreads,
+                    reviews / std::max(PARALLEL_RETENTION_MIN_REVIEWS, cardCount)));
+
+    std::vector<RetentionCurves> parts(partCount, MakeRetentionCurves(groups));
+    std::vector<RunEnds> ends(partCount);
+    std::vector<std::thread> workers;
+    for (size_t part = 0; part < partCount; ++part) {
+        const auto bin = [&, part]() {
+            BinRun(history, reviews / partCount * part,
+                   part + 1 == partCount ? reviews : reviews / partCount * (part + 1),
+                   groupOfCard, cardCount, parts[part], ends[part]);
+        };
+        if (part + 1 == partCount) {
+            bin();
+        } else {
+            workers.emplace_back(bin);
+        }
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+
+    // A card's first review in a run follows its last review in the runs
+    // before. Each thread walks a range of cards through the runs in order,
+    // binning those trials into the curves of the range's own run.
+    for (size_t part = 0; part < partCount && partCount > 1; ++part) {
+        const auto stitch = [&, part]() {
+            const size_t begin = cardCount / partCount * part;
+            const size_t end =
+                part + 1 == partCount ? cardCount : cardCount / partCount * (part + 1);
+            for (size_t card = begin; card < end; ++card) {
+                uint32_t previous = ends[0].lastTimes[card];
+                for (size_t later = 1; later < partCount; ++later) {
+                    const RunEnds& run = ends[later];
+                    if (previous != 0 && run.firstTimes[card] != 0) {
+                        AddTrial(parts[part], groupOfCard[card], previous, run.firstTimes[card],
+                                 run.firstRatings[card]);
+                    }
+                    previous = run.lastTimes[card] != 0 ? run.lastTimes[card] : previous;
+                }
+            }
+        };
+        if (part + 1 == partCount) {
+            stitch();
+        } else {
+            workers.emplace_back(stitch);
+        }
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (size_t part = 1; part < partCount; ++part) {
+        MergeRetentionCurves(parts[0], parts[part]);
+    }
+    return std::move(parts[0]);
+}
+
+void MergeRetentionCurves(RetentionCurves& into, const RetentionCurves& other) {
+    for (size_t cell = 0; cell < into.trials.size() && cell < other.trials.size(); ++cell) {
+        into.trials[cell] += other.trials[cell];
+        into.recalled[cell] += other.recalled[cell];
+        into.elapsedSeconds[cell] += other.elapsedSeconds[cell];
+    }
+}
+
+std::vector<GroupRetention> FitRetentionCurves(const RetentionCurves& curves) {
+    const size_t groups = curves.groups;
+    std::vector<GroupRetention> fits(groups);
+
+    // Lay the points out bin by bin, each bin a row over all groups, so the
+    // sums below run down contiguous rows with one accumulator per group
+    // and vectorize. A bin too thin to fit gets weight 0.
+    const size_t cells = groups * RETENTION_BIN_COUNT;
+    std::vector<double> weights(cells);
+    std::vector<double> days(cells);
+    std::vector<double> logDays(cells);
+    std::vector<double> logRecalls(cells);
+    for (size_t group = 0; group < groups; ++group) {
+        for (size_t bin = 0; bin < RETENTION_BIN_COUNT; ++bin) {
+            const size_t cell = group * RETENTION_BIN_COUNT + bin;
+            const size_t row = bin * groups + group;
+            const uint64_t trials = curves.trials[cell];
+            fits[group].trials += trials;
+            // A bin with no recalls has no log share, only a bound on it.
+            if (trials < RETENTION_MIN_BIN_TRIALS || curves.recalled[cell] == 0) {
+                continue;
+            }
+            ++fits[group].exponential.points;
+            ++fits[group].powerLaw.points;
+            // The log of a share of n trials varies as about 1 / (n * share), so
+            // bins far down the curve weigh less than their trial count.
+            const double recall = static_cast<double>(curves.recalled[cell]) / trials;
+            weights[row] = static_cast<double>(curves.recalled[cell]);
+            days[row] = curves.elapsedSeconds[cell] / SECONDS_PER_DAY / trials;
+            logDays[row] = std::log(days[row]);
+            logRecalls[row] = std::log(recall);
+        }
+    }
+
+    const auto sumModel = [&](const std::vector<double>& xs) {
+        FitSums sums{std::vector<double>(groups), std::vector<double>(groups),
+                     std::vector<double>(groups), std::vector<double>(groups),
+                     std::vector<double>(groups)};
+        for (size_t bin = 0; bin < RETENTION_BIN_COUNT; ++bin) {
+            const double* w = weights.data() + bin * groups;
+            const double* x = xs.data() + bin * groups;
+            const double* y = logRecalls.data() + bin * groups;
+            for (size_t group = 0; group < groups; ++group) {
+                sums.weights[group] += w[group];
+                sums.xs[group] += w[group] * x[group];
+                sums.ys[group] += w[group] * y[group];
+                sums.xxs[group] += w[group] * x[group] * x[group];
+                sums.xys[group] += w[group] * x[group] * y[group];
+            }
+        }
+        return sums;
+    };
+    const FitSums exponential = sumModel(days);
+    const FitSums powerLaw = sumModel(logDays);
+
+    for (size_t group = 0; group < groups; ++group) {
+        GroupRetention& fit = fits[group];
+        SolveFit(exponential, group, fit.exponential);
+        SolveFit(powerLaw, group, fit.powerLaw);
+        for (RetentionFit* model : {&fit.exponential, &fit.powerLaw}) {
+            if (model->points < 2) {
+                continue;
+            }
+            double squares = 0.0;
+            double weight = 0.0;
+            for (size_t bin = 0; bin < RETENTION_BIN_COUNT; ++bin) {
+                const size_t row = bin * groups + group;
+                if (weights[row] == 0.0) {
+                    continue;
+                }
+                const size_t cell = group * RETENTION_BIN_COUNT + bin;
+                const double trials = static_cast<double>(curves.trials[cell]);
+                const double error =
+                    PredictRetention(*model, days[row]) - curves.recalled[cell] / trials;
+                squares += trials * error * error;
+                weight += trials;
+            }
+            model->error = std::sqrt(squares / weight);
+        }
+    }
+    return fits;
+}
+
+double PredictRetention(const RetentionFit& fit, double days) {
+    if (fit.points < 2) {
+        return 0.0;
+    }
+    const double recall = fit.model == RetentionModel::Exponential
+                              ? fit.scale * std::exp(-fit.decay * days)
+                              : fit.scale * std::pow(days, -fit.decay);
+    return std::min(recall, 1.0);
+}
+
+double RetentionHalfLifeDays(const RetentionFit& fit) {
+    if (fit.points < 2) {
+        return 0.0;
+    }
+    if (fit.decay <= 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    // A curve that starts below one half is already there.
+    return fit.model == RetentionModel::Exponential
+               ? std::max(0.0, std::log(2.0 * fit.scale) / fit.decay)
+               : std::pow(2.0 * fit.scale, 1.0 / fit.decay);
+}
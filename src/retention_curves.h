@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "review_stats.h"
+
+// Forgetting curves: the share of reviews recalled (rated Meh or Good)
+// against the time since the card's previous review. Each review after a
+// card's first is one trial, counted into half-octave bins of elapsed time
+// for the group its card belongs to: the whole deck, or a difficulty tier.
+// Exponential and power-law models are fitted to the binned curves by
+// weighted least squares on the log of the recall share.
+
+// Reviews less than this many seconds after the previous one are retries
+// within a session and are not counted.
+constexpr uint32_t RETENTION_MIN_INTERVAL = 60;
+// Bin b covers elapsed times from RetentionBinStart(b) up to the next
+// bin's start; the last bin, from about two years, has no end.
+constexpr size_t RETENTION_BIN_COUNT = 40;
+// Bins with fewer trials are too noisy to fit.
+constexpr uint32_t RETENTION_MIN_BIN_TRIALS = 5;
+// Cards in no group.
+constexpr uint32_t NO_RETENTION_GROUP = UINT32_MAX;
+
+uint32_t RetentionBinStart(size_t bin);
+
+struct RetentionCurves {
+    size_t groups{0};
+    // Group g's bin b at g * RETENTION_BIN_COUNT + b.
+    std::vector<uint64_t> trials{};
+    std::vector<uint64_t> recalled{};
+    // Sum of the trials' elapsed times, for the bin's mean.
+    std::vector<uint64_t> elapsedSeconds{};
+};
+
+RetentionCurves MakeRetentionCurves(size_t groups);
+
+// Counts one review elapsed seconds after the card's previous one.
+void AddRetentionTrial(RetentionCurves& curves, uint32_t group, uint32_t elapsed,
+                       ReviewRating rating);
+
+// Curves of the history, each card counted in groupOfCard[card] (cards past
+// its end or with NO_RETENTION_GROUP are skipped), on up to threads
+// threads (0 uses one per hardware thread).
+RetentionCurves ComputeRetentionCurves(const ReviewHistory& history, size_t cardCount,
+                                       const std::vector<uint32_t>& groupOfCard, size_t groups,
+                                       size_t threads);
+
+// Adds the trials of other, which has as many groups; curves from several
+// learners' logs combine into a cohort's.
+void MergeRetentionCurves(RetentionCurves& into, const RetentionCurves& other);
+
+enum class RetentionModel : uint8_t { Exponential, PowerLaw };
+
+// Recall after t days is scale * exp(-decay * t) for the exponential model
+// and scale * t^-decay for the power law.
+struct RetentionFit {
+    RetentionModel model{RetentionModel::Exponential};
+    double scale{0.0};
+    double decay{0.0};
+    // Trial-weighted root mean square difference from the observed shares.
+    double error{0.0};
+    // Bins fitted; below two the fit is unset.
+    size_t points{0};
+};
+
+struct GroupRetention {
+    RetentionFit exponential{RetentionModel::Exponential};
+    RetentionFit powerLaw{RetentionModel::PowerLaw};
+    uint64_t trials{0};
+};
+
+// Both models for every group, fitted side by side.
+std::vector<GroupRetention> FitRetentionCurves(const RetentionCurves& curves);
+
+double PredictRetention(const RetentionFit& fit, double days);
+
+// Days until predicted recall falls to one half; infinite when the fit does
+// not decay, 0 when it is unset.
+double RetentionHalfLifeDays(const RetentionFit& fit);
@@ -0,0 +1,294 @@
+#include "review_cohort.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "mapped_file.h"
+#include "review_log.h"
+
+namespace {
+// Merged records handed to the counting threads at a time.
+constexpr size_t COHORT_BATCH_RECORDS = 1 << 16;
+// A cursor releases the pages behind it once it is this far past them, or
+// further when the resident budget allows.
+constexpr size_t MIN_COHORT_RELEASE_BYTES = 64 << 10;
+constexpr uint64_t EXHAUSTED_KEY = UINT64_MAX;
+
+struct LogCursor {
+    MappedFile file{};
+    size_t position{0};
+    size_t released{0};
+    // The record at the cursor, valid until the log is exhausted.
+    std::string_view line{};
+    uint32_t time{0};
+};
+
+// Moves to the next record with a valid time; false at the end of the log.
+bool Advance(LogCursor& cursor, size_t releaseBytes, uint64_t& skipped) {
+    const std::string_view log = cursor.file.View();
+    while (cursor.position < log.size()) {
+        const size_t end = std::min(log.find('\n', cursor.position), log.size());
+        const std::string_view line = Trim(log.substr(cursor.position, end - cursor.position));
+        cursor.position = end + 1;
+        if (cursor.position - cursor.released >= releaseBytes) {
+            cursor.file.Release(cursor.position);
+            cursor.released = cursor.position;
+        }
+        if (line.empty()) {
+            continue;
+        }
+        if (ParseReviewTime(line.substr(0, line.find('|')), cursor.time)) {
+            cursor.line = line;
+            return true;
+        }
+        ++skipped;
+    }
+    return false;
+}
+
+// Tournament over the cursors' keys: nodes[0] is the leaf with the
+// smallest key and nodes[1 .. k - 1] the loser of each match, leaf i
+// sitting below node (k + i) / 2. Replacing the winner's key replays only
+// its path, log2(k) comparisons against stored losers.
+struct LoserTree {
+    std::vector<uint64_t> keys{};
+    std::vector<uint32_t> nodes{};
+};
+
+uint32_t BuildMatches(LoserTree& tree, size_t node) {
+    const size_t leaves = tree.keys.size();
+    if (node >= leaves) {
+        return static_cast<uint32_t>(node - leaves);
+    }
+    const uint32_t left = BuildMatches(tree, 2 * node);
+    const uint32_t right = BuildMatches(tree, 2 * node + 1);
+    const bool leftWins = tree.keys[left] < tree.keys[right];
+    tree.nodes[node] = leftWins ? right : left;
+    return leftWins ? left : right;
+}
+
+void BuildLoserTree(LoserTree& tree) {
+    tree.nodes.assign(tree.keys.size(), 0);
+    tree.nodes[0] = tree.keys.size() > 1 ? BuildMatches(tree, 1) : 0;
+}
+
+void ReplayWinner(LoserTree& tree) {
+    uint32_t winner = tree.nodes[0];
+    for (size_t node = (tree.keys.size() + winner) / 2; node >= 1; node /= 2) {
+        if (tree.keys[tree.nodes[node]] < tree.keys[winner]) {
+            std::swap(tree.nodes[node], winner);
+        }
+    }
+    tree.nodes[0] = winner;
+}
+
+// Keys are unique, so learners whose reviews share a second come out in
+// the order their logs were given.
+uint64_t CursorKey(const LogCursor& cursor, size_t learner) {
+    return (uint64_t{cursor.time} << 32) | learner;
+}
+
+struct MergedRecord {
+    std::string_view line{};
+    uint32_t time{0};
+};
+
+// Per-card counters updated by all counting threads at once.
+struct CohortTable {
+    std::vector<std::atomic<uint32_t>> counts{};
+    std::vector<std::atomic<uint32_t>> firstTimes{};
+    std::vector<std::atomic<uint32_t>> lastTimes{};
+    std::atomic<uint64_t> reviews{0};
+    std::atomic<uint64_t> skipped{0};
+};
+
+void CountRecords(const MergedRecord* records, size_t count,
+                  const std::unordered_map<std::string_view, uint32_t>& cardOfId,
+                  CohortTable& table) {
+    uint64_t reviews = 0;
+    uint64_t skipped = 0;
+    for (size_t i = 0; i < count; ++i) {
+        ReviewRecord record;
+        ReviewRating rating{};
+        std::string_view cardId;
+        std::string_view suffix;
+        if (!ParseReviewRecord(records[i].line, record) ||
+            !ParseReviewRating(record.rating, rating)) {
+            ++skipped;
+            continue;
+        }
+        SplitItemKey(record.itemKey, cardId, suffix);
+        const auto card = cardOfId.find(cardId);
+        if (card == cardOfId.end()) {
+            ++skipped;
+            continue;
+        }
+        ++reviews;
+        const uint32_t time = records[i].time;
+        table.counts[3 * card->second + static_cast<size_t>(rating)].fetch_add(
+            1, std::memory_order_relaxed);
+        // First and last are 0 until set; times are never 0 in practice.
+        std::atomic<uint32_t>& first = table.firstTimes[card->second];
+        uint32_t seen = first.load(std::memory_order_relaxed);
+        while ((seen == 0 || time < seen) &&
+               !first.compare_exchange_weak(seen, time, std::memory_order_relaxed)) {
+        }
+        std::atomic<uint32_t>& last = table.lastTimes[card->second];
+        seen = last.load(std::memory_order_relaxed);
+        while (time > seen && !last.compare_exchange_weak(seen, time, std::memory_order_relaxed)) {
+        }
+    }
+    table.reviews.fetch_add(reviews, std::memory_order_relaxed);
+    table.skipped.fetch_add(skipped, std::memory_order_relaxed);
+}
+
+// Counting threads: each batch is split between the workers and the
+// merging thread, which waits for all of them before reusing the batch.
+struct CountingCrew {
+    std::mutex mutex{};
+    std::condition_variable changed{};
+    const std::vector<MergedRecord>* batch{nullptr};
+    uint64_t generation{0};
+    size_t busy{0};
+    bool stopping{false};
+};
+
+void CountSlice(const std::vector<MergedRecord>& batch, size_t slice, size_t slices,
+                const std::unordered_map<std::string_view, uint32_t>& cardOfId,
+                CohortTable& table) {
+    const size_t begin = batch.size() / slices * slice;
+    const size_t end = slice + 1 == slices ? batch.size() : batch.size() / slices * (slice + 1);
+    CountRecords(batch.data() + begin, end - begin, cardOfId, table);
+}
+}
+
+bool RunCohortQuery(const std::vector<std::filesystem::path>& logs, const std::vector<Card>& cards,
+                    const CohortOptions& options, CohortReport& report, std::string& error) {
+    report = CohortReport{};
+    std::vector<std::unique_ptr<LogCursor>> cursors;
+    cursors.reserve(logs.size());
+    for (const std::filesystem::path& path : logs) {
+        cursors.push_back(std::make_unique<LogCursor>());
+        LogCursor& cursor = *cursors.back();
+        if (!cursor.file.Open(path, MapOptions{})) {
+            error = "cannot map " + path.u8string();
+            return false;
+        }
+        // Start each log at the range by bisection rather than reading up to it.
+        const std::string_view log = cursor.file.View();
+        cursor.position = FindReviewTimeRange(log, options.from, UINT32_MAX).data() - log.data();
+        cursor.released = cursor.position;
+    }
+
+    std::vector<std::string> ids;
+    ids.reserve(cards.size());
+    std::unordered_map<std::string_view, uint32_t> cardOfId;
+    cardOfId.reserve(cards.size());
+    for (const Card& card : cards) {
+        ids.push_back(ToUtf8(card.id));
+        cardOfId.emplace(ids.back(), static_cast<uint32_t>(ids.size() - 1));
+    }
+    CohortTable table;
+    table.counts = std::vector<std::atomic<uint32_t>>(3 * cards.size());
+    table.firstTimes = std::vector<std::atomic<uint32_t>>(cards.size());
+    table.lastTimes = std::vector<std::atomic<uint32_t>>(cards.size());
+
+    const size_t hardwareThreads =
+        options.threads != 0 ? options.threads
+                             : std::max<size_t>(1, std::thread::hardware_concurrency());
+    CountingCrew crew;
+    std::vector<std::thread> workers;
+    for (size_t worker = 0; worker + 1 < hardwareThreads; ++worker) {
+        workers.emplace_back([&, worker]() {
+            uint64_t done = 0;
+            for (;;) {
+                std::unique_lock<std::mutex> lock(crew.mutex);
+                crew.changed.wait(lock, [&]() { return crew.stopping || crew.generation != done; });
+                if (crew.stopping) {
+                    return;
+                }
+                done = crew.generation;
+                const std::vector<MergedRecord>& batch = *crew.batch;
+                lock.unlock();
+                CountSlice(batch, worker, hardwareThreads, cardOfId, table);
+                lock.lock();
+                if (--crew.busy == 0) {
+                    crew.changed.notify_all();
+                }
+            }
+        });
+    }
+    const auto countBatch = [&](const std::vector<MergedRecord>& batch) {
+        if (!workers.empty()) {
+            std::lock_guard<std::mutex> lock(crew.mutex);
+            crew.batch = &batch;
+            crew.busy = workers.size();
+            ++crew.generation;
+        }
+        crew.changed.notify_all();
+        CountSlice(batch, hardwareThreads - 1, hardwareThreads, cardOfId, table);
+        std::unique_lock<std::mutex> lock(crew.mutex);
+        crew.changed.wait(lock, [&]() { return crew.busy == 0; });
+    };
+
+    // The resident budget is shared out between the cursors.
+    const size_t releaseBytes = std::max(MIN_COHORT_RELEASE_BYTES,
+                                         options.residentBytes / std::max<size_t>(1, logs.size()));
+    uint64_t skipped = 0;
+    LoserTree tree;
+    tree.keys.resize(cursors.size(), EXHAUSTED_KEY);
+    for (size_t learner = 0; learner < cursors.size(); ++learner) {
+        if (Advance(*cursors[learner], releaseBytes, skipped)) {
+            tree.keys[learner] = CursorKey(*cursors[learner], learner);
+        }
+    }
+    BuildLoserTree(tree);
+
+    std::vector<MergedRecord> batch;
+    batch.reserve(COHORT_BATCH_RECORDS);
+    while (!tree.keys.empty() && tree.keys[tree.nodes[0]] != EXHAUSTED_KEY) {
+        const uint32_t learner = tree.nodes[0];
+        LogCursor& cursor = *cursors[learner];
+        if (cursor.time > options.to) {
+            break;
+        }
+        if (cursor.time >= options.from) {
+            batch.push_back({cursor.line, cursor.time});
+            if (batch.size() == COHORT_BATCH_RECORDS) {
+                countBatch(batch);
+                batch.clear();
+            }
+        }
+        tree.keys[learner] = Advance(cursor, releaseBytes, skipped)
+                                 ? CursorKey(cursor, learner)
+                                 : EXHAUSTED_KEY;
+        ReplayWinner(tree);
+    }
+    countBatch(batch);
+    {
+        std::lock_guard<std::mutex> lock(crew.mutex);
+        crew.stopping = true;
+    }
+    crew.changed.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    report.cards.resize(cards.size());
+    for (size_t card = 0; card < cards.size(); ++card) {
+        for (size_t rating = 0; rating < 3; ++rating) {
+            report.cards[card].counts[rating] = table.counts[3 * card + rating].load();
+        }
+        report.cards[card].firstTime = table.firstTimes[card].load();
+        report.cards[card].lastTime = table.lastTimes[card].load();
+    }
+    report.reviews = table.reviews.load();
+    report.skipped = table.skipped.load() + skipped;
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "deck.h"
+
+// Queries over the answer logs of many learners at once. The logs are
+// k-way merged in time order with a loser tree, one cursor per log started
+// at the range by bisection, and the merged records are handed in
+// fixed-size batches to threads that count them per card. Pages a cursor
+// has read are released as it goes, so memory is bounded by
+// CohortOptions::residentBytes and the per-card table, not by the number or
+// length of the logs.
+
+struct CohortOptions {
+    // ParseReviewTime range of the reviews counted; the merge stops at to.
+    uint32_t from{0};
+    uint32_t to{UINT32_MAX};
+    // 0 uses one per hardware thread.
+    size_t threads{0};
+    // Log pages kept mapped in, shared between the cursors.
+    size_t residentBytes{size_t{256} << 20};
+};
+
+// One card's reviews across all learners. Counts are indexed by
+// ReviewRating.
+struct CohortCardStats {
+    uint32_t counts[3]{};
+    uint32_t firstTime{0};
+    uint32_t lastTime{0};
+};
+
+struct CohortReport {
+    // By deck index.
+    std::vector<CohortCardStats> cards{};
+    uint64_t reviews{0};
+    // Records that do not parse or name no card of the deck.
+    uint64_t skipped{0};
+};
+
+// Each log must be in time order, as the trainer writes it. False with
+// error set when a log cannot be opened.
+bool RunCohortQuery(const std::vector<std::filesystem::path>& logs, const std::vector<Card>& cards,
+                    const CohortOptions& options, CohortReport& report, std::string& error);
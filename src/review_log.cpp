@@ -0,0 +1,300 @@
+#include "review_log.h"
+
+#include <algorithm>
+#include <charconv>
+#include <unordered_map>
+
+namespace {
+// "<name>=<value>" with a lower-case name, as the optional trailing fields are.
+bool IsNamedField(std::string_view field, std::string_view& name, std::string_view& value) {
+    const size_t equals = field.find('=');
+    if (equals == 0 || equals == std::string_view::npos) {
+        return false;
+    }
+    for (size_t i = 0; i < equals; ++i) {
+        if (field[i] < 'a' || field[i] > 'z') {
+            return false;
+        }
+    }
+    name = field.substr(0, equals);
+    value = field.substr(equals + 1);
+    return true;
+}
+
+template <typename Number>
+bool ParseNumber(std::string_view text, int base, Number& number) {
+    const char* const end = text.data() + text.size();
+    const auto [stop, status] = std::from_chars(text.data(), end, number, base);
+    return status == std::errc{} && stop == end;
+}
+
+// Start of the first line beginning at or after offset.
+size_t LineStartFrom(std::string_view log, size_t offset) {
+    if (offset == 0 || log[offset - 1] == '\n') {
+        return offset;
+    }
+    const size_t newline = log.find('\n', offset);
+    return newline == std::string_view::npos ? log.size() : newline + 1;
+}
+
+// Start of the first line in [begin, end) with a valid time; end if none.
+size_t NextTimedLine(std::string_view log, size_t begin, size_t end, uint32_t& time) {
+    while (begin < end) {
+        const size_t newline = std::min(log.find('\n', begin), log.size());
+        const std::string_view line = log.substr(begin, newline - begin);
+        if (ParseReviewTime(Trim(line.substr(0, line.find('|'))), time)) {
+            return begin;
+        }
+        begin = newline + 1;
+    }
+    return end;
+}
+
+// Start of the first line whose time is at least time. Every line before
+// low is earlier; the record of the line at high, if any, is not.
+size_t LowerBoundTime(std::string_view log, uint32_t time) {
+    size_t low = 0;
+    size_t high = log.size();
+    uint32_t probe = 0;
+    while (low < high) {
+        // When no line starts in the back half, probe the front instead.
+        const size_t start = LineStartFrom(log, low + (high - low) / 2);
+        const size_t probed = start < high ? start : low;
+        const size_t timed = NextTimedLine(log, probed, high, probe);
+        if (timed == high || probe >= time) {
+            high = probed;
+        } else {
+            low = LineStartFrom(log, timed + 1);
+        }
+    }
+    return low;
+}
+}
+
+bool ParseReviewRecord(std::string_view line, ReviewRecord& record) {
+    record = ReviewRecord{};
+    const size_t first = line.find('|');
+    if (first == std::string_view::npos) {
+        return false;
+    }
+
+    // Peel the named fields off the end, so that ids containing '|' still
+    // parse as they did before the fields existed.
+    size_t last = line.rfind('|');
+    std::string_view name;
+    std::string_view value;
+    while (last > first && IsNamedField(line.substr(last + 1), name, value)) {
+        if (name == "fp" && !ParseNumber(value, 16, record.fingerprint)) {
+            record.fingerprint = 0;
+        } else if (name == "think" && !ParseNumber(value, 10, record.thinkMs)) {
+            record.thinkMs = NO_RESPONSE_TIME;
+        } else if (name == "rate" && !ParseNumber(value, 10, record.rateMs)) {
+            record.rateMs = NO_RESPONSE_TIME;
+        }
+        line = line.substr(0, last);
+        last = line.rfind('|');
+    }
+    if (last == first) {
+        return false;
+    }
+
+    record.time = line.substr(0, first);
+    record.itemKey = line.substr(first + 1, last - first - 1);
+    record.rating = line.substr(last + 1);
+    return true;
+}
+
+bool ParseReviewRating(std::string_view text, ReviewRating& rating) {
+    if (text == "bad") {
+        rating = ReviewRating::Bad;
+    } else if (text == "meh") {
+        rating = ReviewRating::Meh;
+    } else if (text == "good") {
+        rating = ReviewRating::Good;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ParseReviewTime(std::string_view text, uint32_t& seconds) {
+    // Digit positions of "YYYY-MM-DD HH:MM:SS".
+    constexpr size_t FIELD_BEGINS[] = {0, 5, 8, 11, 14, 17};
+    constexpr size_t FIELD_LENGTHS[] = {4, 2, 2, 2, 2, 2};
+    if (text.size() != 19 || text[4] != '-' || text[7] != '-' || text[10] != ' ' ||
+        text[13] != ':' || text[16] != ':') {
+        return false;
+    }
+    int64_t fields[6] = {};
+    for (size_t i = 0; i < 6; ++i) {
+        for (size_t j = FIELD_BEGINS[i]; j < FIELD_BEGINS[i] + FIELD_LENGTHS[i]; ++j) {
+            if (text[j] < '0' || text[j] > '9') {
+                return false;
+            }
+            fields[i] = fields[i] * 10 + (text[j] - '0');
+        }
+    }
+    const auto [year, month, day, hour, minute, second] = fields;
+    if (year < 1970 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return false;
+    }
+
+    // Days since 1970-01-01 of a proleptic Gregorian date; March-based years
+    // put the leap day last.
+    const int64_t marchYear = month <= 2 ? year - 1 : year;
+    const int64_t era = marchYear / 400;
+    const int64_t yearOfEra = marchYear - era * 400;
+    const int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    const int64_t days = era * 146097 + dayOfEra - 719468;
+    const int64_t total = days * 86400 + hour * 3600 + minute * 60 + second;
+    if (total > UINT32_MAX) {
+        return false;
+    }
+    seconds = static_cast<uint32_t>(total);
+    return true;
+}
+
+std::string FingerprintToHex(uint64_t fingerprint) {
+    static constexpr char DIGITS[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (size_t i = hex.size(); i-- > 0; fingerprint >>= 4) {
+        hex[i] = DIGITS[fingerprint & 0xf];
+    }
+    return hex;
+}
+
+void SplitItemKey(std::string_view key, std::string_view& cardId, std::string_view& suffix) {
+    cardId = key;
+    suffix = {};
+    const size_t at = key.rfind('@');
+    if (at == std::string_view::npos) {
+        return;
+    }
+    const std::string_view item = key.substr(at + 1);
+    const bool gap = item.size() > 1 && item[0] == 'c' &&
+                     item.find_first_not_of("0123456789", 1) == std::string_view::npos;
+    if (item == "reverse" || gap) {
+        cardId = key.substr(0, at);
+        suffix = key.substr(at);
+    }
+}
+
+std::vector<size_t> SplitAtLines(std::string_view log, size_t parts) {
+    std::vector<size_t> bounds{0};
+    for (size_t part = 1; part < parts && bounds.back() < log.size(); ++part) {
+        const size_t newline =
+            log.find('\n', std::max(bounds.back(), log.size() / parts * part));
+        if (newline == std::string_view::npos) {
+            break;
+        }
+        bounds.push_back(newline + 1);
+    }
+    if (bounds.back() < log.size() || bounds.size() == 1) {
+        bounds.push_back(log.size());
+    }
+    return bounds;
+}
+
+std::string MigrateReviewLog(std::string_view log, const std::vector<Card>& cards,
+                             const std::vector<CardGenerator>& generators,
+                             MigrationStats& stats) {
+    stats = MigrationStats{};
+
+    // Fingerprints shared by several cards cannot say which one a record
+    // belongs to; they map to null.
+    std::unordered_map<std::string, uint64_t> fingerprintOfId;
+    std::unordered_map<uint64_t, const std::string*> idOfFingerprint;
+    size_t cardCount = cards.size();
+    for (const CardGenerator& generator : generators) {
+        cardCount += generator.cardCount;
+    }
+    fingerprintOfId.reserve(cardCount);
+    idOfFingerprint.reserve(cardCount);
+    const auto addCard = [&](const Card& card) {
+        const uint64_t fingerprint = card.fingerprint != 0
+                                         ? card.fingerprint
+                                         : CardFingerprint(card.question, card.answer);
+        const auto [entry, added] = fingerprintOfId.emplace(ToUtf8(card.id), fingerprint);
+        if (!added) {
+            return;
+        }
+        const auto [owner, unique] = idOfFingerprint.emplace(fingerprint, &entry->first);
+        if (!unique) {
+            owner->second = nullptr;
+        }
+    };
+    for (const Card& card : cards) {
+        addCard(card);
+    }
+    for (const CardGenerator& generator : generators) {
+        Card card;
+        for (size_t ordinal = 0; ordinal < generator.cardCount; ++ordinal) {
+            GenerateCard(generator, ordinal, card);
+            addCard(card);
+        }
+    }
+
+    std::string migrated;
+    migrated.reserve(log.size());
+    size_t position = 0;
+    while (position < log.size()) {
+        const size_t end = std::min(log.find('\n', position), log.size());
+        const size_t next = std::min(end + 1, log.size());
+        const std::string_view rawLine = log.substr(position, next - position);
+        const std::string_view line = Trim(log.substr(position, end - position));
+        position = next;
+
+        ReviewRecord record;
+        if (!ParseReviewRecord(line, record)) {
+            migrated += rawLine;
+            continue;
+        }
+        std::string_view cardId;
+        std::string_view suffix;
+        SplitItemKey(record.itemKey, cardId, suffix);
+        const auto byId = fingerprintOfId.find(std::string(cardId));
+        const bool known = byId != fingerprintOfId.end();
+
+        if (record.fingerprint == 0) {
+            if (!known) {
+                ++stats.orphaned;
+                migrated += rawLine;
+                continue;
+            }
+            ++stats.unverified;
+            migrated += line;
+            migrated += "|fp=" + FingerprintToHex(byId->second) + "\n";
+            continue;
+        }
+        if (known && byId->second == record.fingerprint) {
+            ++stats.kept;
+            migrated += line;
+            migrated += '\n';
+            continue;
+        }
+        const auto byFingerprint = idOfFingerprint.find(record.fingerprint);
+        if (byFingerprint != idOfFingerprint.end() && byFingerprint->second != nullptr) {
+            ++stats.renamed;
+            const size_t keyBegin = static_cast<size_t>(record.itemKey.data() - line.data());
+            migrated += line.substr(0, keyBegin);
+            migrated += *byFingerprint->second;
+            migrated += suffix;
+            migrated += line.substr(keyBegin + record.itemKey.size());
+            migrated += '\n';
+            continue;
+        }
+        ++(known ? stats.stale : stats.orphaned);
+        migrated += rawLine;
+    }
+    return migrated;
+}
+
+std::string_view FindReviewTimeRange(std::string_view log, uint32_t from, uint32_t to) {
+    if (from > to) {
+        return log.substr(0, 0);
+    }
+    const size_t begin = LowerBoundTime(log, from);
+    const size_t end = to == UINT32_MAX ? log.size() : LowerBoundTime(log, to + 1);
+    return log.substr(begin, std::max(begin, end) - begin);
+}
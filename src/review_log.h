@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "deck.h"
+
+// The answer log (answers.log) holds one review per line:
+//
+//     <time>|<item key>|<rating>[|<name>=<value>]...
+//
+// where the item key is ReviewItemKey and fp=<16 hex digits> records the
+// CardFingerprint of the card as it was answered. think=<ms> is the time
+// from showing the question to revealing the answer and rate=<ms> from
+// there to the rating, both on the monotonic clock. Older lines lack some
+// or all of these fields.
+
+// Response time of a record that has none.
+constexpr uint32_t NO_RESPONSE_TIME = UINT32_MAX;
+
+// Ordered from worst to best, as logged: "bad", "meh", "good".
+enum class ReviewRating : uint8_t { Bad, Meh, Good };
+
+struct ReviewRecord {
+    std::string_view time{};
+    std::string_view itemKey{};
+    std::string_view rating{};
+    // 0 when the line has no fp field.
+    uint64_t fingerprint{0};
+    uint32_t thinkMs{NO_RESPONSE_TIME};
+    uint32_t rateMs{NO_RESPONSE_TIME};
+};
+
+// False for blank or malformed lines. The views point into line.
+bool ParseReviewRecord(std::string_view line, ReviewRecord& record);
+
+bool ParseReviewRating(std::string_view text, ReviewRating& rating);
+
+// Seconds since 1970 of a "YYYY-MM-DD HH:MM:SS" log time. The log holds
+// local time, so this is only good for differences between reviews.
+bool ParseReviewTime(std::string_view text, uint32_t& seconds);
+
+std::string FingerprintToHex(uint64_t fingerprint);
+
+// Splits an item key ("<id>", "<id>@reverse", "<id>@c<gap>") into the card
+// id and the suffix naming the item, "" for the front side.
+void SplitItemKey(std::string_view key, std::string_view& cardId, std::string_view& suffix);
+
+// Offsets that cut log into up to parts runs of whole lines of about equal
+// size, for reading on separate threads: run i is [bounds[i], bounds[i + 1]).
+std::vector<size_t> SplitAtLines(std::string_view log, size_t parts);
+
+// The whole lines of log with ParseReviewTime times in [from, to], found by
+// bisecting the byte offsets without reading the lines in between: each
+// probe moves to the next line start and reads one time. The log must be in
+// time order, as the trainer appends it; lines without a valid time go with
+// the record after them.
+std::string_view FindReviewTimeRange(std::string_view log, uint32_t from, uint32_t to);
+
+struct MigrationStats {
+    // Records whose card still has the same id and text.
+    size_t kept{0};
+    // Records moved to the card that now has their text under another id.
+    size_t renamed{0};
+    // Records whose card kept its id but changed its text; kept as they are.
+    size_t stale{0};
+    // Records whose card is gone; kept as they are.
+    size_t orphaned{0};
+    // Records without a fingerprint whose card still exists; kept and given
+    // the card's current fingerprint.
+    size_t unverified{0};
+};
+
+// Rewrites an answer log against cards and the cards generators expand to:
+// each record is matched to its card by id and fingerprint in O(1), so
+// history follows cards whose id changed. Records that match no card, or
+// whose card's text changed, and lines that are not records are kept as
+// they are.
+std::string MigrateReviewLog(std::string_view log, const std::vector<Card>& cards,
+                             const std::vector<CardGenerator>& generators,
+                             MigrationStats& stats);
@@ -0,0 +1,298 @@
+#include "review_rollups.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+
+#include "checksum.h"
+#include "deck.h"
+
+namespace {
+constexpr char ROLLUP_SNAPSHOT_MAGIC[8] = {'Q', 'A', 'R', 'O', 'L', 'L', '\r', '\n'};
+constexpr uint16_t ROLLUP_SNAPSHOT_VERSION = 1;
+// Below this many log bytes per thread, starting a thread costs more than
+// parsing its share.
+constexpr size_t PARALLEL_ROLLUP_MIN_BYTES = 8 << 20;
+// The snapshot checks this much of the log before its offset, which is
+// enough to notice a log that was migrated or replaced.
+constexpr size_t ROLLUP_CHECK_BYTES = 4096;
+
+struct RollupSnapshotHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t periodCount;
+    // CRC32C of the ROLLUP_CHECK_BYTES of the log before logOffset.
+    uint32_t logTailCrc;
+    uint64_t logOffset;
+    // CRC32C of the series, and of the header bytes before headerCrc.
+    uint32_t bodyCrc;
+    uint32_t headerCrc;
+};
+
+uint32_t HeaderCrc(const RollupSnapshotHeader& header) {
+    return Crc32c(std::string_view(reinterpret_cast<const char*>(&header),
+                                   offsetof(RollupSnapshotHeader, headerCrc)),
+                  0);
+}
+
+uint32_t LogTailCrc(std::string_view log, uint64_t offset) {
+    const size_t end = static_cast<size_t>(offset);
+    const size_t begin = end - std::min(end, ROLLUP_CHECK_BYTES);
+    return Crc32c(log.substr(begin, end - begin), 0);
+}
+
+// Adds count reviews with rating in period, growing the series to cover it.
+void AddToSeries(RollupSeries& series, uint32_t period, size_t rating, uint32_t count) {
+    const size_t periods = series.totals.size() / 3;
+    if (periods == 0) {
+        series.firstPeriod = period;
+        series.totals.assign(3, 0);
+    } else if (period < series.firstPeriod) {
+        // Rare: a log whose clock went back past the first period.
+        const size_t added = series.firstPeriod - period;
+        series.totals.insert(series.totals.begin(), 3 * added, 0);
+        series.firstPeriod = period;
+    } else if (period - series.firstPeriod >= periods) {
+        // Idle periods carry the totals of the last active one.
+        const size_t grown = static_cast<size_t>(period - series.firstPeriod) + 1;
+        const uint32_t last[3] = {series.totals[3 * periods - 3], series.totals[3 * periods - 2],
+                                  series.totals[3 * periods - 1]};
+        series.totals.reserve(3 * grown);
+        for (size_t i = periods; i < grown; ++i) {
+            series.totals.insert(series.totals.end(), last, last + 3);
+        }
+    }
+    for (size_t i = 3 * (period - series.firstPeriod) + rating; i < series.totals.size(); i += 3) {
+        series.totals[i] += count;
+    }
+}
+
+// Running total of rating through period, which may lie outside the series.
+uint32_t TotalThrough(const RollupSeries& series, uint32_t period, size_t rating) {
+    const size_t periods = series.totals.size() / 3;
+    if (periods == 0 || period < series.firstPeriod) {
+        return 0;
+    }
+    const size_t index = std::min<size_t>(period - series.firstPeriod, periods - 1);
+    return series.totals[3 * index + rating];
+}
+
+// Adds the reviews of other to into, period by period.
+void MergeSeries(RollupSeries& into, const RollupSeries& other) {
+    if (other.totals.empty()) {
+        return;
+    }
+    if (into.totals.empty()) {
+        into = other;
+        return;
+    }
+    const uint32_t first = std::min(into.firstPeriod, other.firstPeriod);
+    const uint32_t last =
+        std::max(into.firstPeriod + static_cast<uint32_t>(into.totals.size() / 3),
+                 other.firstPeriod + static_cast<uint32_t>(other.totals.size() / 3)) - 1;
+    std::vector<uint32_t> totals;
+    totals.reserve(3 * (static_cast<size_t>(last - first) + 1));
+    for (uint32_t period = first; period <= last; ++period) {
+        for (size_t rating = 0; rating < 3; ++rating) {
+            totals.push_back(TotalThrough(into, period, rating) +
+                             TotalThrough(other, period, rating));
+        }
+    }
+    into.firstPeriod = first;
+    into.totals = std::move(totals);
+}
+
+void FoldLines(ActivityRollups& rollups, std::string_view lines) {
+    size_t position = 0;
+    while (position < lines.size()) {
+        const size_t end = std::min(lines.find('\n', position), lines.size());
+        const std::string_view line = Trim(lines.substr(position, end - position));
+        position = end + 1;
+
+        ReviewRecord record;
+        ReviewRating rating{};
+        uint32_t time = 0;
+        if (ParseReviewRecord(line, record) && ParseReviewRating(record.rating, rating) &&
+            ParseReviewTime(record.time, time)) {
+            AddToRollups(rollups, time, rating);
+        }
+    }
+}
+
+template <typename Value>
+void AppendRaw(std::string& out, const Value& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename Value>
+bool ReadRaw(std::string_view& data, Value& value) {
+    if (data.size() < sizeof(value)) {
+        return false;
+    }
+    std::memcpy(&value, data.data(), sizeof(value));
+    data.remove_prefix(sizeof(value));
+    return true;
+}
+}
+
+uint32_t PeriodOf(uint32_t time, RollupPeriod period) {
+    const uint32_t day = time / 86400;
+    switch (period) {
+    case RollupPeriod::Day:
+        return day;
+    case RollupPeriod::Week:
+        // 1970-01-01 was a Thursday.
+        return (day + 3) / 7;
+    case RollupPeriod::Month:
+    default: {
+        // Inverse of the days-from-civil count in ParseReviewTime.
+        const uint32_t shifted = day + 719468;
+        const uint32_t era = shifted / 146097;
+        const uint32_t dayOfEra = shifted - era * 146097;
+        const uint32_t yearOfEra =
+            (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        const uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        const uint32_t marchMonth = (5 * dayOfYear + 2) / 153;
+        const uint32_t month = marchMonth < 10 ? marchMonth + 3 : marchMonth - 9;
+        const uint32_t year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0);
+        return (year - 1970) * 12 + month - 1;
+    }
+    }
+}
+
+uint32_t PeriodStart(uint32_t number, RollupPeriod period) {
+    switch (period) {
+    case RollupPeriod::Day:
+        return number * 86400;
+    case RollupPeriod::Week:
+        return number == 0 ? 0 : (number * 7 - 3) * 86400;
+    case RollupPeriod::Month:
+    default: {
+        const uint32_t year = 1970 + number / 12;
+        const uint32_t month = number % 12 + 1;
+        const uint32_t marchYear = month <= 2 ? year - 1 : year;
+        const uint32_t era = marchYear / 400;
+        const uint32_t yearOfEra = marchYear - era * 400;
+        const uint32_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5;
+        const uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return (era * 146097 + dayOfEra - 719468) * 86400;
+    }
+    }
+}
+
+void AddToRollups(ActivityRollups& rollups, uint32_t time, ReviewRating rating) {
+    for (size_t p = 0; p < ROLLUP_PERIOD_COUNT; ++p) {
+        AddToSeries(rollups.series[p], PeriodOf(time, static_cast<RollupPeriod>(p)),
+                    static_cast<size_t>(rating), 1);
+    }
+}
+
+ActivityCounts RollupRange(const ActivityRollups& rollups, RollupPeriod period, uint32_t first,
+                           uint32_t last) {
+    ActivityCounts counts;
+    const RollupSeries& series = rollups.series[static_cast<size_t>(period)];
+    if (first > last) {
+        return counts;
+    }
+    for (size_t rating = 0; rating < 3; ++rating) {
+        counts.counts[rating] = TotalThrough(series, last, rating) -
+                                (first == 0 ? 0 : TotalThrough(series, first - 1, rating));
+    }
+    return counts;
+}
+
+void CatchUpRollups(ActivityRollups& rollups, std::string_view log, size_t threads) {
+    if (rollups.logOffset >= log.size()) {
+        return;
+    }
+    // A line still being written is left for the next catch-up.
+    const size_t lastNewline = log.rfind('\n');
+    if (lastNewline == std::string_view::npos || lastNewline < rollups.logOffset) {
+        return;
+    }
+    const std::string_view lines =
+        log.substr(static_cast<size_t>(rollups.logOffset),
+                   lastNewline + 1 - static_cast<size_t>(rollups.logOffset));
+
+    const size_t hardwareThreads =
+        threads != 0 ? threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+    const std::vector<size_t> bounds = SplitAtLines(
+        lines,
+        std::max<size_t>(1, std::min(hardwareThreads, lines.size() / PARALLEL_ROLLUP_MIN_BYTES)));
+    const size_t partCount = bounds.size() - 1;
+
+    std::vector<ActivityRollups> parts(partCount);
+    std::vector<std::thread> workers;
+    for (size_t part = 0; part < partCount; ++part) {
+        const auto fold = [&, part]() {
+            FoldLines(parts[part], lines.substr(bounds[part], bounds[part + 1] - bounds[part]));
+        };
+        if (part + 1 == partCount) {
+            fold();
+        } else {
+            workers.emplace_back(fold);
+        }
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (const ActivityRollups& part : parts) {
+        for (size_t p = 0; p < ROLLUP_PERIOD_COUNT; ++p) {
+            MergeSeries(rollups.series[p], part.series[p]);
+        }
+    }
+    rollups.logOffset = lastNewline + 1;
+}
+
+std::string SerializeRollups(const ActivityRollups& rollups, std::string_view log) {
+    std::string body;
+    for (const RollupSeries& series : rollups.series) {
+        AppendRaw(body, series.firstPeriod);
+        AppendRaw(body, static_cast<uint32_t>(series.totals.size() / 3));
+        body.append(reinterpret_cast<const char*>(series.totals.data()),
+                    series.totals.size() * sizeof(uint32_t));
+    }
+
+    RollupSnapshotHeader header{};
+    std::memcpy(header.magic, ROLLUP_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = ROLLUP_SNAPSHOT_VERSION;
+    header.periodCount = static_cast<uint16_t>(ROLLUP_PERIOD_COUNT);
+    header.logOffset = std::min<uint64_t>(rollups.logOffset, log.size());
+    header.logTailCrc = LogTailCrc(log, header.logOffset);
+    header.bodyCrc = Crc32c(body, 0);
+    header.headerCrc = HeaderCrc(header);
+
+    std::string snapshot;
+    AppendRaw(snapshot, header);
+    return snapshot + body;
+}
+
+bool ParseRollups(std::string_view snapshot, std::string_view log, ActivityRollups& rollups) {
+    rollups = ActivityRollups{};
+    RollupSnapshotHeader header{};
+    if (!ReadRaw(snapshot, header) ||
+        std::memcmp(header.magic, ROLLUP_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != ROLLUP_SNAPSHOT_VERSION ||
+        header.periodCount != ROLLUP_PERIOD_COUNT ||
+        header.headerCrc != HeaderCrc(header) ||
+        header.bodyCrc != Crc32c(snapshot, 0) || header.logOffset > log.size() ||
+        header.logTailCrc != LogTailCrc(log, header.logOffset)) {
+        return false;
+    }
+
+    ActivityRollups parsed;
+    for (RollupSeries& series : parsed.series) {
+        uint32_t periods = 0;
+        if (!ReadRaw(snapshot, series.firstPeriod) || !ReadRaw(snapshot, periods) ||
+            snapshot.size() / (3 * sizeof(uint32_t)) < periods) {
+            return false;
+        }
+        series.totals.resize(static_cast<size_t>(periods) * 3);
+        std::memcpy(series.totals.data(), snapshot.data(), series.totals.size() * sizeof(uint32_t));
+        snapshot.remove_prefix(series.totals.size() * sizeof(uint32_t));
+    }
+    parsed.logOffset = header.logOffset;
+    rollups = std::move(parsed);
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "review_log.h"
+
+// Review counts by rating per day, week and month of the answer log. Each
+// rating is added in O(1) as it is logged; a range of periods is read from
+// running totals in O(1). The rollups remember how much of the log they
+// cover, so a snapshot saved at exit is brought up to date by folding only
+// the lines appended since.
+//
+// A snapshot (answers.rollup) is a RollupSnapshotHeader followed by, for
+// each period in RollupPeriod order, uint32 firstPeriod, uint32 period count
+// and the series' totals, all little-endian.
+
+enum class RollupPeriod : uint8_t { Day, Week, Month };
+
+constexpr size_t ROLLUP_PERIOD_COUNT = 3;
+
+// Number of the day, week (from Monday) or month holding a ParseReviewTime
+// time, counted from the one holding 1970-01-01.
+uint32_t PeriodOf(uint32_t time, RollupPeriod period);
+
+// ParseReviewTime time at which a period starts.
+uint32_t PeriodStart(uint32_t number, RollupPeriod period);
+
+struct RollupSeries {
+    uint32_t firstPeriod{0};
+    // Reviews from firstPeriod through firstPeriod + i, by rating, at
+    // 3 * i + rating.
+    std::vector<uint32_t> totals{};
+};
+
+struct ActivityRollups {
+    RollupSeries series[ROLLUP_PERIOD_COUNT]{};
+    // Bytes at the start of the answer log folded in; always whole lines.
+    uint64_t logOffset{0};
+};
+
+// Reviews by ReviewRating.
+struct ActivityCounts {
+    uint32_t counts[3]{};
+};
+
+// Folds one review in. O(1) unless the review is earlier than the last
+// period of a series, which then moves the totals after it.
+void AddToRollups(ActivityRollups& rollups, uint32_t time, ReviewRating rating);
+
+// Reviews in periods first through last.
+ActivityCounts RollupRange(const ActivityRollups& rollups, RollupPeriod period, uint32_t first,
+                           uint32_t last);
+
+// Folds the complete lines of log past rollups.logOffset, splitting them
+// across up to threads threads (0 uses one per hardware thread). On empty
+// rollups this rebuilds them from the whole log.
+void CatchUpRollups(ActivityRollups& rollups, std::string_view log, size_t threads);
+
+// Snapshot of rollups, which cover the start of log.
+std::string SerializeRollups(const ActivityRollups& rollups, std::string_view log);
+
+// False when the snapshot is damaged or log no longer starts with the lines
+// it covered; rollups is then left empty.
+bool ParseRollups(std::string_view snapshot, std::string_view log, ActivityRollups& rollups);
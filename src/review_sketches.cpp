@@ -0,0 +1,242 @@
+#include "review_sketches.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "checksum.h"
+#include "deck.h"
+#include "review_log.h"
+#include "review_rollups.h"
+
+namespace {
+// Below this many log bytes per thread, starting a thread costs more than
+// parsing its share.
+constexpr size_t PARALLEL_SKETCH_MIN_BYTES = 8 << 20;
+
+// Row r's counter for hash; the two halves of the hash give every row its
+// own index without hashing again.
+size_t CounterIndex(uint64_t hash, size_t row) {
+    const uint32_t step = static_cast<uint32_t>(hash >> 32) | 1;
+    const uint32_t index = static_cast<uint32_t>(hash) + static_cast<uint32_t>(row) * step;
+    return row * COUNT_MIN_WIDTH + (index & (COUNT_MIN_WIDTH - 1));
+}
+
+// Increments the key's counters and returns its new estimate.
+uint32_t AddToCountMin(CountMinSketch& sketch, uint64_t hash) {
+    uint32_t estimate = UINT32_MAX;
+    for (size_t row = 0; row < COUNT_MIN_DEPTH; ++row) {
+        uint32_t& counter = sketch.counters[CounterIndex(hash, row)];
+        estimate = std::min(estimate, ++counter);
+    }
+    return estimate;
+}
+
+void SwapHeapEntries(TopKSketch& sketch, size_t a, size_t b) {
+    std::swap(sketch.heap[a], sketch.heap[b]);
+    sketch.positions[sketch.heap[a].hash] = a;
+    sketch.positions[sketch.heap[b].hash] = b;
+}
+
+void SiftUp(TopKSketch& sketch, size_t position) {
+    while (position > 0) {
+        const size_t parent = (position - 1) / 2;
+        if (sketch.heap[parent].count <= sketch.heap[position].count) {
+            return;
+        }
+        SwapHeapEntries(sketch, parent, position);
+        position = parent;
+    }
+}
+
+void SiftDown(TopKSketch& sketch, size_t position) {
+    for (;;) {
+        size_t smallest = position;
+        for (const size_t child : {2 * position + 1, 2 * position + 2}) {
+            if (child < sketch.heap.size() &&
+                sketch.heap[child].count < sketch.heap[smallest].count) {
+                smallest = child;
+            }
+        }
+        if (smallest == position) {
+            return;
+        }
+        SwapHeapEntries(sketch, smallest, position);
+        position = smallest;
+    }
+}
+
+// Puts a key whose estimate is now estimate in the heap if it ranks there.
+void Offer(TopKSketch& sketch, std::string_view key, uint64_t hash, uint32_t estimate) {
+    if (sketch.capacity == 0 ||
+        (sketch.heap.size() == sketch.capacity && estimate <= sketch.heap[0].count)) {
+        // A key already in the heap has a count of at least the minimum
+        // and gained one since, so it never takes this path.
+        return;
+    }
+    const auto found = sketch.positions.find(hash);
+    if (found != sketch.positions.end()) {
+        sketch.heap[found->second].count = estimate;
+        SiftDown(sketch, found->second);
+    } else if (sketch.heap.size() < sketch.capacity) {
+        sketch.heap.push_back({std::string(key), hash, estimate});
+        sketch.positions[hash] = sketch.heap.size() - 1;
+        SiftUp(sketch, sketch.heap.size() - 1);
+    } else {
+        sketch.positions.erase(sketch.heap[0].hash);
+        sketch.heap[0] = {std::string(key), hash, estimate};
+        sketch.positions[hash] = 0;
+        SiftDown(sketch, 0);
+    }
+}
+
+void SketchLines(ReviewLogSketches& sketches, std::string_view lines) {
+    auto day = sketches.cardsByDay.end();
+    size_t position = 0;
+    while (position < lines.size()) {
+        const size_t end = std::min(lines.find('\n', position), lines.size());
+        const std::string_view line = Trim(lines.substr(position, end - position));
+        position = end + 1;
+
+        ReviewRecord record;
+        ReviewRating rating{};
+        uint32_t time = 0;
+        if (!ParseReviewRecord(line, record) || !ParseReviewRating(record.rating, rating) ||
+            !ParseReviewTime(record.time, time)) {
+            continue;
+        }
+        std::string_view cardId;
+        std::string_view suffix;
+        SplitItemKey(record.itemKey, cardId, suffix);
+        const uint64_t hash = Xxh64(cardId, 0);
+
+        ++sketches.reviews;
+        AddToHyperLogLog(sketches.cards, hash);
+        // Logs are in time order, so the day rarely changes between lines.
+        const uint32_t number = PeriodOf(time, RollupPeriod::Day);
+        if (day == sketches.cardsByDay.end() || day->first != number) {
+            day = sketches.cardsByDay.try_emplace(number).first;
+        }
+        AddToHyperLogLog(day->second, hash);
+        if (rating == ReviewRating::Bad) {
+            AddToTopK(sketches.failures, cardId, hash);
+        }
+    }
+}
+}
+
+uint32_t EstimateCount(const CountMinSketch& sketch, uint64_t hash) {
+    uint32_t estimate = UINT32_MAX;
+    for (size_t row = 0; row < COUNT_MIN_DEPTH; ++row) {
+        estimate = std::min(estimate, sketch.counters[CounterIndex(hash, row)]);
+    }
+    return estimate;
+}
+
+void AddToTopK(TopKSketch& sketch, std::string_view key, uint64_t hash) {
+    Offer(sketch, key, hash, AddToCountMin(sketch.counts, hash));
+}
+
+void MergeTopK(TopKSketch& into, const TopKSketch& other) {
+    for (size_t i = 0; i < into.counts.counters.size(); ++i) {
+        into.counts.counters[i] += other.counts.counters[i];
+    }
+    // Only the keys of the two heaps are candidates, re-estimated from the
+    // merged counters. A key whose occurrences were split between the two
+    // can rank in the merge without having ranked in either heap; it is
+    // missed, so the merged heap is approximate.
+    std::vector<HeavyHitter> candidates = std::move(into.heap);
+    for (const HeavyHitter& hitter : other.heap) {
+        if (into.positions.count(hitter.hash) == 0) {
+            candidates.push_back(hitter);
+        }
+    }
+    into.capacity = std::max(into.capacity, other.capacity);
+    into.heap.clear();
+    into.positions.clear();
+    for (const HeavyHitter& candidate : candidates) {
+        Offer(into, candidate.key, candidate.hash, EstimateCount(into.counts, candidate.hash));
+    }
+}
+
+std::vector<HeavyHitter> TopKeys(const TopKSketch& sketch) {
+    std::vector<HeavyHitter> keys = sketch.heap;
+    std::sort(keys.begin(), keys.end(), [](const HeavyHitter& a, const HeavyHitter& b) {
+        return a.count != b.count ? a.count > b.count : a.key < b.key;
+    });
+    return keys;
+}
+
+void AddToHyperLogLog(HyperLogLog& sketch, uint64_t hash) {
+    // The top bits pick the register, which keeps the longest run of
+    // leading zeros (plus one) seen in the rest.
+    const size_t index = static_cast<size_t>(hash >> (64 - HYPERLOGLOG_PRECISION));
+    uint64_t rest = hash << HYPERLOGLOG_PRECISION;
+    uint8_t rank = 1;
+    while (rank <= 64 - HYPERLOGLOG_PRECISION && (rest & (uint64_t{1} << 63)) == 0) {
+        ++rank;
+        rest <<= 1;
+    }
+    sketch.registers[index] = std::max(sketch.registers[index], rank);
+}
+
+void MergeHyperLogLog(HyperLogLog& into, const HyperLogLog& other) {
+    for (size_t i = 0; i < into.registers.size(); ++i) {
+        into.registers[i] = std::max(into.registers[i], other.registers[i]);
+    }
+}
+
+double EstimateDistinct(const HyperLogLog& sketch) {
+    const double registers = static_cast<double>(sketch.registers.size());
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (const uint8_t rank : sketch.registers) {
+        sum += std::ldexp(1.0, -rank);
+        zeros += rank == 0 ? 1 : 0;
+    }
+    const double estimate = 0.7213 / (1.0 + 1.079 / registers) * registers * registers / sum;
+    // Small counts leave registers empty; counting those is more accurate.
+    if (estimate <= 2.5 * registers && zeros != 0) {
+        return registers * std::log(registers / static_cast<double>(zeros));
+    }
+    return estimate;
+}
+
+ReviewLogSketches SketchReviewLog(std::string_view log, size_t topK, size_t threads) {
+    const size_t hardwareThreads =
+        threads != 0 ? threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+    const std::vector<size_t> bounds = SplitAtLines(
+        log,
+        std::max<size_t>(1, std::min(hardwareThreads, log.size() / PARALLEL_SKETCH_MIN_BYTES)));
+    const size_t partCount = bounds.size() - 1;
+
+    std::vector<ReviewLogSketches> parts(partCount);
+    std::vector<std::thread> workers;
+    for (size_t part = 0; part < partCount; ++part) {
+        parts[part].failures.capacity = topK;
+        const auto sketch = [&, part]() {
+            SketchLines(parts[part], log.substr(bounds[part], bounds[part + 1] - bounds[part]));
+        };
+        if (part + 1 == partCount) {
+            sketch();
+        } else {
+            workers.emplace_back(sketch);
+        }
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (size_t part = 1; part < partCount; ++part) {
+        MergeReviewLogSketches(parts[0], parts[part]);
+    }
+    return std::move(parts[0]);
+}
+
+void MergeReviewLogSketches(ReviewLogSketches& into, const ReviewLogSketches& other) {
+    into.reviews += other.reviews;
+    MergeTopK(into.failures, other.failures);
+    MergeHyperLogLog(into.cards, other.cards);
+    for (const auto& [day, cards] : other.cardsByDay) {
+        MergeHyperLogLog(into.cardsByDay[day], cards);
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Fixed-size summaries of answer logs too large to count exactly: which
+// cards fail most often (Count-Min sketch with a heap of the current top
+// keys) and how many distinct cards were reviewed (HyperLogLog). Both
+// merge, so logs are read in line-aligned runs on separate threads and the
+// results of several learners' logs combine into one.
+
+// Count-Min counters per row and rows; an estimate exceeds the true count
+// by at most 2/width of all counts added, with probability 1 - 2^-depth.
+constexpr size_t COUNT_MIN_WIDTH = 4096;
+constexpr size_t COUNT_MIN_DEPTH = 4;
+// 2^precision HyperLogLog registers; estimates are within about
+// 1.04 / sqrt(2^precision), 1.6% here.
+constexpr unsigned HYPERLOGLOG_PRECISION = 12;
+
+struct CountMinSketch {
+    // Row r at r * COUNT_MIN_WIDTH.
+    std::vector<uint32_t> counters = std::vector<uint32_t>(COUNT_MIN_WIDTH * COUNT_MIN_DEPTH);
+};
+
+// Never below the true count of the key with this hash.
+uint32_t EstimateCount(const CountMinSketch& sketch, uint64_t hash);
+
+struct HeavyHitter {
+    std::string key{};
+    uint64_t hash{0};
+    uint32_t count{0};
+};
+
+struct TopKSketch {
+    size_t capacity{20};
+    CountMinSketch counts{};
+    // Min-heap on count of the keys with the highest estimates.
+    std::vector<HeavyHitter> heap{};
+    // Heap position of each key in it, by hash.
+    std::unordered_map<uint64_t, size_t> positions{};
+};
+
+// Counts one occurrence of key; hash is Xxh64(key, 0).
+void AddToTopK(TopKSketch& sketch, std::string_view key, uint64_t hash);
+
+// Adds the counts of other and rebuilds the heap from the keys of both
+// heaps. A key that ranked in neither is left out even if its combined
+// count would rank.
+void MergeTopK(TopKSketch& into, const TopKSketch& other);
+
+// The heap's keys by count, highest first.
+std::vector<HeavyHitter> TopKeys(const TopKSketch& sketch);
+
+struct HyperLogLog {
+    std::vector<uint8_t> registers = std::vector<uint8_t>(size_t{1} << HYPERLOGLOG_PRECISION);
+};
+
+void AddToHyperLogLog(HyperLogLog& sketch, uint64_t hash);
+
+void MergeHyperLogLog(HyperLogLog& into, const HyperLogLog& other);
+
+double EstimateDistinct(const HyperLogLog& sketch);
+
+struct ReviewLogSketches {
+    uint64_t reviews{0};
+    // Bad ratings by card id.
+    TopKSketch failures{};
+    // Distinct card ids over the whole log and per day (PeriodOf).
+    HyperLogLog cards{};
+    std::map<uint32_t, HyperLogLog> cardsByDay{};
+};
+
+// Reads every record of an answer log in one pass, on up to threads
+// threads (0 uses one per hardware thread); topK keys are kept.
+ReviewLogSketches SketchReviewLog(std::string_view log, size_t topK, size_t threads);
+
+void MergeReviewLogSketches(ReviewLogSketches& into, const ReviewLogSketches& other);
@@ -0,0 +1,217 @@
+#include "review_stats.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+// Below this many reviews per thread, starting a thread costs more than the
+// part of the history it would reduce.
+constexpr size_t PARALLEL_STATS_MIN_REVIEWS = 1 << 20;
+
+void Fold(CardStats& stats, uint32_t time, ReviewRating rating) {
+    const bool first = ReviewCount(stats) == 0;
+    stats.lapses += rating == ReviewRating::Bad && !first && stats.lastRating != ReviewRating::Bad;
+    ++stats.counts[static_cast<size_t>(rating)];
+    stats.firstRating = first ? rating : stats.firstRating;
+    stats.lastRating = rating;
+    // Times are kept as a range, so a log whose clock went back still gives
+    // a sensible interval.
+    stats.firstTime = first ? time : std::min(stats.firstTime, time);
+    stats.lastTime = std::max(stats.lastTime, time);
+}
+
+// Reduces history[begin, end) into stats, which has cardCount entries.
+void FoldReviews(const ReviewHistory& history, size_t begin, size_t end, CardStats* stats,
+                 size_t cardCount) {
+    const uint32_t* cards = history.cards.data();
+    const uint32_t* times = history.times.data();
+    const ReviewRating* ratings = history.ratings.data();
+    for (size_t i = begin; i < end; ++i) {
+        if (cards[i] < cardCount) {
+            Fold(stats[cards[i]], times[i], ratings[i]);
+        }
+    }
+}
+
+// Appends the reviews in later to those in into; a lapse can span the two.
+void Combine(CardStats& into, const CardStats& later) {
+    if (ReviewCount(later) == 0) {
+        return;
+    }
+    if (ReviewCount(into) == 0) {
+        into = later;
+        return;
+    }
+    into.lapses += later.lapses + (later.firstRating == ReviewRating::Bad &&
+                                   into.lastRating != ReviewRating::Bad);
+    for (size_t rating = 0; rating < 3; ++rating) {
+        into.counts[rating] += later.counts[rating];
+    }
+    into.firstTime = std::min(into.firstTime, later.firstTime);
+    into.lastTime = std::max(into.lastTime, later.lastTime);
+    into.lastRating = later.lastRating;
+}
+}
+
+uint32_t ReviewCount(const CardStats& stats) {
+    return stats.counts[0] + stats.counts[1] + stats.counts[2];
+}
+
+double RetentionRate(const CardStats& stats) {
+    const uint32_t reviews = ReviewCount(stats);
+    return reviews == 0 ? 0.0
+                        : static_cast<double>(reviews - stats.counts[0]) /
+                              static_cast<double>(reviews);
+}
+
+double AverageIntervalDays(const CardStats& stats) {
+    // Consecutive intervals sum to the span from the first review to the last.
+    const uint32_t reviews = ReviewCount(stats);
+    return reviews < 2 ? 0.0
+                       : static_cast<double>(stats.lastTime - stats.firstTime) /
+                             (86400.0 * (reviews - 1));
+}
+
+size_t LoadReviewHistory(std::string_view log, const std::vector<Card>& cards,
+                         ReviewHistory& history) {
+    history = ReviewHistory{};
+    std::vector<std::string> ids;
+    ids.reserve(cards.size());
+    std::unordered_map<std::string_view, uint32_t> cardOfId;
+    cardOfId.reserve(cards.size());
+    for (const Card& card : cards) {
+        ids.push_back(ToUtf8(card.id));
+        cardOfId.emplace(ids.back(), static_cast<uint32_t>(ids.size() - 1));
+    }
+
+    size_t skipped = 0;
+    size_t position = 0;
+    while (position < log.size()) {
+        const size_t end = std::min(log.find('\n', position), log.size());
+        const std::string_view line = Trim(log.substr(position, end - position));
+        position = end + 1;
+        if (line.empty()) {
+            continue;
+        }
+
+        ReviewRecord record;
+        ReviewRating rating{};
+        uint32_t time = 0;
+        std::string_view cardId;
+        std::string_view suffix;
+        if (!ParseReviewRecord(line, record) || !ParseReviewRating(record.rating, rating) ||
+            !ParseReviewTime(record.time, time)) {
+            ++skipped;
+            continue;
+        }
+        SplitItemKey(record.itemKey, cardId, suffix);
+        const auto card = cardOfId.find(cardId);
+        if (card == cardOfId.end()) {
+            ++skipped;
+            continue;
+        }
+        AppendReview(history, card->second, time, rating, record.thinkMs, record.rateMs);
+    }
+    return skipped;
+}
+
+void AppendReview(ReviewHistory& history, uint32_t card, uint32_t time, ReviewRating rating,
+                  uint32_t thinkMs, uint32_t rateMs) {
+    history.cards.push_back(card);
+    history.times.push_back(time);
+    history.ratings.push_back(rating);
+    history.thinkMs.push_back(thinkMs);
+    history.rateMs.push_back(rateMs);
+}
+
+void AddReview(std::vector<CardStats>& stats, uint32_t card, uint32_t time, ReviewRating rating) {
+    if (card >= stats.size()) {
+        stats.resize(static_cast<size_t>(card) + 1);
+    }
+    Fold(stats[card], time, rating);
+}
+
+std::vector<CardStats> ComputeCardStats(const ReviewHistory& history, size_t cardCount,
+                                        size_t threads) {
+    // Each thread reduces a contiguous run into a table of its own, so a run
+    // must be long enough to pay for clearing and merging that table.
+    const size_t reviews = history.cards.size();
+    const size_t hardwareThreads =
+        threads != 0 ? threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+    const size_t partCount = std::max<size_t>(
+        1, std::min(hardwareThreads,
+                    reviews / std::max(PARALLEL_STATS_MIN_REVIEWS, cardCount)));
+
+    std::vector<std::vector<CardStats>> parts(partCount);
+    std::vector<std::thread> workers;
+    for (size_t part = 0; part < partCount; ++part) {
+        const auto reduce = [&, part]() {
+            parts[part].resize(cardCount);
+            FoldReviews(history, reviews / partCount * part,
+                        part + 1 == partCount ? reviews : reviews / partCount * (part + 1),
+                        parts[part].data(), cardCount);
+        };
+        if (part + 1 == partCount) {
+            reduce();
+        } else {
+            workers.emplace_back(reduce);
+        }
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+
+    // Merge the tables in history order, each thread taking a range of cards.
+    std::vector<CardStats>& stats = parts[0];
+    for (size_t part = 0; part < partCount && partCount > 1; ++part) {
+        const auto merge = [&, part]() {
+            const size_t begin = cardCount / partCount * part;
+            const size_t end =
+                part + 1 == partCount ? cardCount : cardCount / partCount * (part + 1);
+            for (size_t later = 1; later < partCount; ++later) {
+                for (size_t card = begin; card < end; ++card) {
+                    Combine(stats[card], parts[later][card]);
+                }
+            }
+        };
+        if (part + 1 == partCount) {
+            merge();
+        } else {
+            workers.emplace_back(merge);
+        }
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    return std::move(stats);
+}
+
+void AddResponseTimes(std::vector<CardResponseTimes>& times, uint32_t card, uint32_t thinkMs,
+                      uint32_t rateMs) {
+    if (thinkMs == NO_RESPONSE_TIME && rateMs == NO_RESPONSE_TIME) {
+        return;
+    }
+    if (card >= times.size()) {
+        times.resize(static_cast<size_t>(card) + 1);
+    }
+    if (thinkMs != NO_RESPONSE_TIME) {
+        AddToSketch(times[card].think, thinkMs);
+    }
+    if (rateMs != NO_RESPONSE_TIME) {
+        AddToSketch(times[card].rate, rateMs);
+    }
+}
+
+std::vector<CardResponseTimes> ComputeResponseTimes(const ReviewHistory& history,
+                                                    size_t cardCount) {
+    std::vector<CardResponseTimes> times(cardCount);
+    for (size_t i = 0; i < history.cards.size(); ++i) {
+        if (history.cards[i] < cardCount) {
+            AddResponseTimes(times, history.cards[i], history.thinkMs[i], history.rateMs[i]);
+        }
+    }
+    return times;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "deck.h"
+#include "quantile_sketch.h"
+#include "review_log.h"
+
+// Per-card statistics over the review history. The history is kept
+// column-wise, one compact entry per review, in the order the reviews
+// happened; a full recompute splits it into contiguous runs reduced on
+// separate threads, and new reviews are folded in one at a time.
+
+struct ReviewHistory {
+    // Card index in the deck; every item of a card counts towards it.
+    std::vector<uint32_t> cards{};
+    // ParseReviewTime seconds.
+    std::vector<uint32_t> times{};
+    std::vector<ReviewRating> ratings{};
+    // Milliseconds, or NO_RESPONSE_TIME where the log has none.
+    std::vector<uint32_t> thinkMs{};
+    std::vector<uint32_t> rateMs{};
+};
+
+// One card's reviews. Counts are indexed by ReviewRating.
+struct CardStats {
+    uint32_t counts[3]{};
+    // Bad ratings right after a Meh or Good one: the card was known and
+    // then forgotten.
+    uint32_t lapses{0};
+    // Earliest and latest review.
+    uint32_t firstTime{0};
+    uint32_t lastTime{0};
+    ReviewRating firstRating{ReviewRating::Bad};
+    ReviewRating lastRating{ReviewRating::Bad};
+};
+
+uint32_t ReviewCount(const CardStats& stats);
+
+// Share of reviews rated Meh or Good; 0 for an unreviewed card.
+double RetentionRate(const CardStats& stats);
+
+// Mean time between consecutive reviews, in days; 0 below two reviews.
+double AverageIntervalDays(const CardStats& stats);
+
+// Reads the answer log into history, keeping the records of cards in deck
+// order. Returns the number of records that name no card or do not parse.
+size_t LoadReviewHistory(std::string_view log, const std::vector<Card>& cards,
+                         ReviewHistory& history);
+
+void AppendReview(ReviewHistory& history, uint32_t card, uint32_t time, ReviewRating rating,
+                  uint32_t thinkMs, uint32_t rateMs);
+
+// Folds one review, later than all before it, into stats, growing it to
+// cover card if needed.
+void AddReview(std::vector<CardStats>& stats, uint32_t card, uint32_t time, ReviewRating rating);
+
+// Statistics of cards 0 .. cardCount - 1 from the whole history, on up to
+// threads threads (0 uses one per hardware thread).
+std::vector<CardStats> ComputeCardStats(const ReviewHistory& history, size_t cardCount,
+                                        size_t threads);
+
+// Think and rate time distributions of one card, in milliseconds. Sketches
+// of the same card from several learners' logs can be merged.
+struct CardResponseTimes {
+    QuantileSketch think{};
+    QuantileSketch rate{};
+};
+
+// Adds the times that are not NO_RESPONSE_TIME, growing times to cover card.
+void AddResponseTimes(std::vector<CardResponseTimes>& times, uint32_t card, uint32_t thinkMs,
+                      uint32_t rateMs);
+
+std::vector<CardResponseTimes> ComputeResponseTimes(const ReviewHistory& history,
+                                                    size_t cardCount);
@@ -0,0 +1,106 @@
+#include "session_fatigue.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Think times are clamped to this range before their log is taken, so a
+// stray double click or a walk away from the desk counts as a bounded
+// deviation.
+constexpr double MIN_THINK_MS = 200.0;
+constexpr double MAX_THINK_MS = 120000.0;
+// Floors under the baseline's failure rate and log think spread: a warm-up
+// without a single Bad rating must not make the first one look extreme.
+constexpr double MIN_FAILURE_RATE = 0.05;
+constexpr double MIN_LOG_THINK_SPREAD = 0.1;
+
+// Keeps the baseline, which outlives sessions.
+void StartSession(FatigueDetector& detector, uint32_t time) {
+    detector.sessionStart = time;
+    detector.lastTime = time;
+    detector.reviews = 0;
+    detector.failureSum = 0.0f;
+    detector.thinkSum = 0.0f;
+}
+
+void AddToBaseline(FatigueDetector& detector, double failed, bool timed, double logThink) {
+    const double keep = 1.0 - 1.0 / std::max<uint32_t>(1, detector.options.baselineMemory);
+    detector.baselineReviews = detector.baselineReviews * keep + 1.0;
+    detector.baselineFailures = detector.baselineFailures * keep + failed;
+    if (timed) {
+        detector.baselineTimed = detector.baselineTimed * keep + 1.0;
+        detector.baselineLogThink = detector.baselineLogThink * keep + logThink;
+        detector.baselineLogThinkSquares =
+            detector.baselineLogThinkSquares * keep + logThink * logThink;
+    }
+}
+}
+
+bool AddFatigueRating(FatigueDetector& detector, uint32_t time, ReviewRating rating,
+                      uint32_t thinkMs, FatigueEvent& event) {
+    const FatigueOptions& options = detector.options;
+    if (detector.reviews == 0 ||
+        (time > detector.lastTime && time - detector.lastTime > options.sessionGap)) {
+        StartSession(detector, time);
+    }
+    detector.lastTime = std::max(detector.lastTime, time);
+    ++detector.reviews;
+
+    const double failed = rating == ReviewRating::Bad ? 1.0 : 0.0;
+    const bool timed = thinkMs != NO_RESPONSE_TIME;
+    const double logThink =
+        timed ? std::log(std::min(std::max<double>(thinkMs, MIN_THINK_MS), MAX_THINK_MS)) : 0.0;
+    if (detector.reviews <= options.warmupReviews || detector.baselineReviews == 0.0) {
+        AddToBaseline(detector, failed, timed, logThink);
+        detector.recentFailures =
+            static_cast<float>(detector.baselineFailures / detector.baselineReviews);
+        detector.recentLogThink = detector.baselineTimed == 0.0
+                                      ? 0.0f
+                                      : static_cast<float>(detector.baselineLogThink /
+                                                           detector.baselineTimed);
+        return false;
+    }
+
+    const float smoothing = options.smoothing;
+    detector.recentFailures += smoothing * (static_cast<float>(failed) - detector.recentFailures);
+    const double baselineFailureRate = detector.baselineFailures / detector.baselineReviews;
+    const double failureRate =
+        std::min(std::max(baselineFailureRate, MIN_FAILURE_RATE), 1.0 - MIN_FAILURE_RATE);
+    const double failureDeviation =
+        (failed - failureRate) / std::sqrt(failureRate * (1.0 - failureRate));
+    detector.failureSum = std::max(
+        0.0f, detector.failureSum + static_cast<float>(failureDeviation) - options.allowance);
+
+    const double thinkMean =
+        detector.baselineTimed == 0.0 ? 0.0 : detector.baselineLogThink / detector.baselineTimed;
+    if (timed && detector.baselineTimed >= 2.0) {
+        const double variance =
+            detector.baselineLogThinkSquares / detector.baselineTimed - thinkMean * thinkMean;
+        const double spread =
+            std::max(std::sqrt(std::max(variance, 0.0)), MIN_LOG_THINK_SPREAD);
+        const double thinkDeviation = (logThink - thinkMean) / spread;
+        detector.recentLogThink +=
+            smoothing * (static_cast<float>(logThink) - detector.recentLogThink);
+        detector.thinkSum = std::max(
+            0.0f, detector.thinkSum + static_cast<float>(thinkDeviation) - options.allowance);
+    }
+
+    if (detector.failureSum <= options.threshold && detector.thinkSum <= options.threshold) {
+        return false;
+    }
+    event.signal = detector.failureSum > options.threshold ? FatigueSignal::MoreFailures
+                                                           : FatigueSignal::SlowerAnswers;
+    event.sessionReviews = detector.reviews;
+    event.sessionSeconds = detector.lastTime - detector.sessionStart;
+    event.baselineRecall = static_cast<float>(1.0 - baselineFailureRate);
+    event.recentRecall = 1.0f - detector.recentFailures;
+    event.baselineThinkMs =
+        detector.baselineTimed == 0.0 ? 0.0f : static_cast<float>(std::exp(thinkMean));
+    event.recentThinkMs =
+        detector.baselineTimed == 0.0 ? 0.0f : std::exp(detector.recentLogThink);
+    // Start accumulating afresh, so a session that carries on raises the
+    // next event only after as much drift again.
+    detector.failureSum = 0.0f;
+    detector.thinkSum = 0.0f;
+    return true;
+}
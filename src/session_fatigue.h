@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "review_log.h"
+
+// Watches the ratings of a study session for signs of fatigue: more Bad
+// ratings and slower answers than when the learner is fresh. The first
+// ratings of each session feed an exponentially weighted baseline that
+// carries over from session to session. After them, each rating's
+// deviation from the baseline, standardized, feeds a one-sided CUSUM per
+// signal. The CUSUM raises an event once enough drift has piled up and
+// then starts over. Exponential moving averages give the recent values
+// the event reports. Everything is updated in O(1) per rating.
+
+struct FatigueOptions {
+    // Ratings at the start of a session that feed the baseline instead of
+    // being tested against it.
+    uint32_t warmupReviews{20};
+    // Warm-up ratings the baseline remembers, older ones fading out.
+    uint32_t baselineMemory{200};
+    // Standardized drift per rating the CUSUM ignores, and the total that
+    // raises an event.
+    float allowance{0.5f};
+    float threshold{10.0f};
+    // A pause this long, in seconds, starts a new session.
+    uint32_t sessionGap{20 * 60};
+    // Weight of the latest rating in the recent averages.
+    float smoothing{0.1f};
+};
+
+enum class FatigueSignal : uint8_t { MoreFailures, SlowerAnswers };
+
+struct FatigueEvent {
+    FatigueSignal signal{FatigueSignal::MoreFailures};
+    uint32_t sessionReviews{0};
+    uint32_t sessionSeconds{0};
+    // Share of Meh and Good ratings, and typical think time in milliseconds
+    // (the exponential of the mean log), in the baseline and lately.
+    float baselineRecall{0.0f};
+    float recentRecall{0.0f};
+    float baselineThinkMs{0.0f};
+    float recentThinkMs{0.0f};
+};
+
+struct FatigueDetector {
+    FatigueOptions options{};
+    uint32_t sessionStart{0};
+    uint32_t lastTime{0};
+    uint32_t reviews{0};
+    // Decayed sums over the warm-up ratings of all sessions so far.
+    double baselineReviews{0.0};
+    double baselineFailures{0.0};
+    double baselineTimed{0.0};
+    double baselineLogThink{0.0};
+    double baselineLogThinkSquares{0.0};
+    float recentFailures{0.0f};
+    float recentLogThink{0.0f};
+    float failureSum{0.0f};
+    float thinkSum{0.0f};
+};
+
+// Folds in a rating given at time (ParseReviewTime seconds); thinkMs may be
+// NO_RESPONSE_TIME. True with event set when the rating tips a signal over
+// the threshold.
+bool AddFatigueRating(FatigueDetector& detector, uint32_t time, ReviewRating rating,
+                      uint32_t thinkMs, FatigueEvent& event);